@@ -0,0 +1,92 @@
+// File: backgroundModel.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 17, 2024
+// Running background model, see backgroundModel.h. At the default quarter scale a 1080p frame
+// is modelled on a 480x270 plane, so the per-pixel model costs little next to the downscale
+// and the final blend.
+
+#include "backgroundModel.h"
+#include "filterKernels.h"
+
+void initBackgroundModel(BackgroundModel& model, float scale, int learnFrames) {
+    model.scale = std::min(std::max(scale, 0.05f), 1.0f);
+    model.learnFrames = std::max(1, learnFrames);
+    model.alpha = 8;
+    model.foregroundAlpha = 1;
+    model.minThreshold = 12;
+    resetBackgroundModel(model);
+}
+
+void resetBackgroundModel(BackgroundModel& model) {
+    model.framesLearned = 0;
+}
+
+bool segmentForeground(BackgroundModel& model, const cv::Mat& frame, cv::Mat& mask) {
+    if (frame.empty() || frame.type() != CV_8UC3) {
+        return false;
+    }
+
+    // Downscale before converting, the luma conversion then only touches the small plane
+    cv::resize(frame, model.small, cv::Size(), model.scale, model.scale, cv::INTER_AREA);
+    cv::cvtColor(model.small, model.luma, cv::COLOR_BGR2GRAY);
+    if (model.mean.size() != model.luma.size()) {
+        model.framesLearned = 0;
+    }
+    model.mean.create(model.luma.size(), CV_16U);
+    model.dev.create(model.luma.size(), CV_16U);
+    model.smallMask.create(model.luma.size(), CV_8U);
+
+    const FilterKernels& kernels = filterKernels();
+    const int cols = model.luma.cols;
+    if (model.framesLearned == 0) {
+        // The first frame is the mean, with no deviation yet
+        for (int y = 0; y < model.luma.rows; ++y) {
+            kernels.fixedScaleRow(model.mean.ptr<uint16_t>(y), model.luma.ptr<uchar>(y), cols, 256);
+        }
+        model.dev.setTo(cv::Scalar::all(0));
+    }
+    else {
+        // While learning, every frame counts the same (a cumulative average), afterwards the
+        // model follows slow lighting changes
+        bool learning = model.framesLearned < model.learnFrames;
+        int alpha = learning ? std::max(1, 256 / (model.framesLearned + 1)) : model.alpha;
+        int foregroundAlpha = learning ? alpha : model.foregroundAlpha;
+        cv::parallel_for_(cv::Range(0, model.luma.rows), [&](const cv::Range& range) {
+            for (int y = range.start; y < range.end; ++y) {
+                kernels.backgroundRow(model.mean.ptr<uint16_t>(y), model.dev.ptr<uint16_t>(y), model.luma.ptr<uchar>(y),
+                    model.smallMask.ptr<uchar>(y), cols, alpha, foregroundAlpha, model.minThreshold);
+            }
+        });
+    }
+    model.framesLearned = std::min(model.framesLearned + 1, model.learnFrames + 1);
+
+    if (model.framesLearned <= model.learnFrames) {
+        mask.create(frame.size(), CV_8U);
+        mask.setTo(cv::Scalar::all(255));
+        return false;
+    }
+
+    // Remove speckles and fill pinholes, then upsample. The linear interpolation gives the soft
+    // edges used by replaceBackground.
+    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
+    cv::morphologyEx(model.smallMask, model.cleanMask, cv::MORPH_OPEN, kernel);
+    cv::morphologyEx(model.cleanMask, model.cleanMask, cv::MORPH_CLOSE, kernel);
+    cv::resize(model.cleanMask, mask, frame.size(), 0, 0, cv::INTER_LINEAR);
+    return true;
+}
+
+int replaceBackground(const cv::Mat& frame, const cv::Mat& background, const cv::Mat& mask, cv::Mat& dst) {
+    if (frame.empty() || frame.type() != CV_8UC3 || background.size() != frame.size() ||
+        background.type() != frame.type() || mask.size() != frame.size() || mask.type() != CV_8U) {
+        return -1; // Invalid images
+    }
+
+    dst.create(frame.size(), frame.type());
+    const FilterKernels& kernels = filterKernels();
+    cv::parallel_for_(cv::Range(0, frame.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            kernels.blendMaskRow(frame.ptr<uchar>(y), background.ptr<uchar>(y), mask.ptr<uchar>(y), dst.ptr<uchar>(y), frame.cols);
+        }
+    });
+    return 0;
+}
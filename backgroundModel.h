@@ -0,0 +1,38 @@
+// File: backgroundModel.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 17, 2024
+// Foreground segmentation without a green screen. Each pixel of a downscaled luma plane keeps
+// a running mean and mean absolute deviation (a simplified single Gaussian), learned from the
+// first frames and then updated slowly. The mask is cleaned and upsampled to the frame size.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+
+struct BackgroundModel {
+    float scale;            // size of the luma plane relative to the frame
+    int learnFrames;        // frames averaged before segmenting
+    int framesLearned;      // frames seen since the last reset
+    int alpha;              // learning rate of background pixels, out of 256
+    int foregroundAlpha;    // learning rate of foreground pixels, so objects that stay get absorbed
+    int minThreshold;       // smallest luma difference counted as foreground
+
+    cv::Mat small;          // downscaled frame
+    cv::Mat luma;           // its luma
+    cv::Mat mean;           // CV_16U, 8.8 fixed point
+    cv::Mat dev;            // CV_16U, 8.8 fixed point
+    cv::Mat smallMask;      // CV_8U mask at the luma size
+    cv::Mat cleanMask;
+};
+
+void initBackgroundModel(BackgroundModel& model, float scale = 0.25f, int learnFrames = 30);
+
+// Forget the learned background, the next frames are learned again
+void resetBackgroundModel(BackgroundModel& model);
+
+// Learn from the frame and segment it. mask gets the frame size, 255 on the foreground with soft
+// edges. Returns false while the background is still being learned, mask is then all foreground.
+bool segmentForeground(BackgroundModel& model, const cv::Mat& frame, cv::Mat& mask);
+
+// dst = frame where mask is set, background elsewhere, blended along the soft edges.
+// background must have the frame size and type.
+int replaceBackground(const cv::Mat& frame, const cv::Mat& background, const cv::Mat& mask, cv::Mat& dst);
@@ -0,0 +1,238 @@
+// File: colorLut.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 21, 2024
+// .cube loading, the bricked table layout and the built-in looks, see colorLut.h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include "colorLut.h"
+#include "filterKernels.h"
+
+// Points per brick axis, bricks share their boundary points
+static const int brickPoints = COLOR_LUT_BRICK_CELLS + 1;
+
+int buildColorLut(ColorLut& lut, int size, const std::vector<float>& values, const float domainMin[3], const float domainMax[3]) {
+    if (size < 2 || size > COLOR_LUT_MAX_SIZE || values.size() != (size_t)size * size * size * 3) {
+        return -1;
+    }
+    lut.size = size;
+
+    // Input value -> cell and position inside it, one table per axis. The .cube domain is in RGB
+    // order, the tables in the BGR order of the pixels.
+    const int bricksPerAxis = (size - 2) / COLOR_LUT_BRICK_CELLS + 1;
+    const int brickStride[3] = { 1, bricksPerAxis, bricksPerAxis * bricksPerAxis };
+    const int cellStride[3] = { 1, brickPoints, brickPoints * brickPoints };
+    const int pointsPerBrick = brickPoints * brickPoints * brickPoints;
+    for (int axis = 0; axis < 3; axis++) {
+        double low = domainMin != NULL ? domainMin[2 - axis] : 0.0;
+        double high = domainMax != NULL ? domainMax[2 - axis] : 1.0;
+        if (!(high > low)) {
+            return -1;
+        }
+        for (int v = 0; v < 256; v++) {
+            double t = std::min(std::max((v / 255.0 - low) / (high - low), 0.0), 1.0);
+            int position = static_cast<int>(std::lround(t * (size - 1) * 256.0));
+            int cell = std::min(position >> 8, size - 2);
+            int brick = cell / COLOR_LUT_BRICK_CELLS;
+            lut.offsets[axis][v] = brick * brickStride[axis] * pointsPerBrick + (cell % COLOR_LUT_BRICK_CELLS) * cellStride[axis];
+            lut.fractions[axis][v] = static_cast<uint16_t>(position - cell * 256);
+        }
+    }
+
+    // Copy the points into the bricks, in 8.7 fixed point. Bricks at the far end of an axis are
+    // only partly used, their extra points repeat the last one.
+    lut.bricks.assign((size_t)bricksPerAxis * bricksPerAxis * bricksPerAxis * pointsPerBrick * 4, 0);
+    for (int br = 0; br < bricksPerAxis; br++) {
+        for (int bg = 0; bg < bricksPerAxis; bg++) {
+            for (int bb = 0; bb < bricksPerAxis; bb++) {
+                uint16_t* brick = &lut.bricks[(size_t)((br * bricksPerAxis + bg) * bricksPerAxis + bb) * pointsPerBrick * 4];
+                for (int i = 0; i < pointsPerBrick; i++) {
+                    int r = std::min(br * COLOR_LUT_BRICK_CELLS + i / (brickPoints * brickPoints), size - 1);
+                    int g = std::min(bg * COLOR_LUT_BRICK_CELLS + i / brickPoints % brickPoints, size - 1);
+                    int b = std::min(bb * COLOR_LUT_BRICK_CELLS + i % brickPoints, size - 1);
+                    const float* rgb = &values[((size_t)(b * size + g) * size + r) * 3];
+                    for (int c = 0; c < 3; c++) {
+                        double value = std::min(std::max((double)rgb[2 - c], 0.0), 1.0);
+                        brick[i * 4 + c] = static_cast<uint16_t>(std::lround(value * 255.0 * 128.0));
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int loadCubeLut(const std::string& path, ColorLut& lut) {
+    std::ifstream file(path);
+    if (!file) {
+        printf("Unable to open LUT %s\n", path.c_str());
+        return -1;
+    }
+
+    std::string line, title;
+    int size = 0;
+    float domainMin[3] = { 0.0f, 0.0f, 0.0f }, domainMax[3] = { 1.0f, 1.0f, 1.0f };
+    std::vector<float> values;
+    while (std::getline(file, line)) {
+        std::istringstream words(line);
+        std::string keyword;
+        if (!(words >> keyword) || keyword[0] == '#') {
+            continue;
+        }
+        if (keyword == "TITLE") {
+            size_t quote = line.find('"');
+            title = quote == std::string::npos ? "" : line.substr(quote + 1, line.rfind('"') - quote - 1);
+        }
+        else if (keyword == "LUT_3D_SIZE") {
+            words >> size;
+            if (size < 2 || size > COLOR_LUT_MAX_SIZE) {
+                printf("%s: unsupported LUT size %d\n", path.c_str(), size);
+                return -1;
+            }
+            values.reserve((size_t)size * size * size * 3);
+        }
+        else if (keyword == "DOMAIN_MIN") {
+            words >> domainMin[0] >> domainMin[1] >> domainMin[2];
+        }
+        else if (keyword == "DOMAIN_MAX") {
+            words >> domainMax[0] >> domainMax[1] >> domainMax[2];
+        }
+        else if (keyword == "LUT_1D_SIZE") {
+            printf("%s: 1D LUTs are not supported\n", path.c_str());
+            return -1;
+        }
+        else if (isdigit((unsigned char)keyword[0]) || keyword[0] == '-' || keyword[0] == '.') {
+            float r = std::stof(keyword), g, b;
+            if (!(words >> g >> b)) {
+                printf("%s: bad table line: %s\n", path.c_str(), line.c_str());
+                return -1;
+            }
+            values.push_back(r);
+            values.push_back(g);
+            values.push_back(b);
+        }
+        // Other keywords (LUT_3D_INPUT_RANGE and vendor extensions) don't change the table
+    }
+
+    if (size == 0 || values.size() != (size_t)size * size * size * 3) {
+        printf("%s: expected %d^3 table entries, found %d\n", path.c_str(), size, (int)values.size() / 3);
+        return -1;
+    }
+    if (buildColorLut(lut, size, values, domainMin, domainMax) != 0) {
+        printf("%s: bad domain\n", path.c_str());
+        return -1;
+    }
+    lut.title = title.empty() ? path : title;
+    return 0;
+}
+
+// Built-in looks, sampled from the row kernels of the filters. Sizes are picked so the lattice
+// steps (255 / (size - 1)) are whole numbers and hit the filter inputs exactly; strongcolor has
+// a hard threshold and gets a finer lattice.
+typedef void (*PresetRow)(const FilterKernels& kernels, const uint8_t* src, uint8_t* dst, int width);
+
+struct PresetEntry {
+    const char* name;
+    int size;
+    PresetRow row;
+};
+
+static void identityPresetRow(const FilterKernels&, const uint8_t* src, uint8_t* dst, int width) {
+    memcpy(dst, src, (size_t)width * 3);
+}
+
+static void sepiaPresetRow(const FilterKernels& kernels, const uint8_t* src, uint8_t* dst, int width) {
+    kernels.sepiaRow(src, dst, width);
+}
+
+static void altGreyPresetRow(const FilterKernels& kernels, const uint8_t* src, uint8_t* dst, int width) {
+    kernels.altGreyRow(src, dst, width);
+}
+
+static void strongColorPresetRow(const FilterKernels& kernels, const uint8_t* src, uint8_t* dst, int width) {
+    kernels.strongColorRow(src, dst, width, 128);
+}
+
+static const PresetEntry presetTable[] = {
+    { "identity", 2, identityPresetRow },
+    { "sepia", 18, sepiaPresetRow },
+    { "altgrey", 18, altGreyPresetRow },
+    { "strongcolor", 52, strongColorPresetRow },
+};
+
+static void buildPreset(const PresetEntry& preset, ColorLut& lut) {
+    const int size = preset.size;
+    const FilterKernels& kernels = filterKernels();
+    std::vector<uint8_t> input((size_t)size * 3), output((size_t)size * 3);
+    std::vector<float> values;
+    values.reserve((size_t)size * size * size * 3);
+
+    // One row of lattice points at a time, red changing fastest
+    for (int b = 0; b < size; b++) {
+        for (int g = 0; g < size; g++) {
+            for (int r = 0; r < size; r++) {
+                input[r * 3] = static_cast<uint8_t>(b * 255 / (size - 1));
+                input[r * 3 + 1] = static_cast<uint8_t>(g * 255 / (size - 1));
+                input[r * 3 + 2] = static_cast<uint8_t>(r * 255 / (size - 1));
+            }
+            preset.row(kernels, input.data(), output.data(), size);
+            for (int r = 0; r < size; r++) {
+                values.push_back(output[r * 3 + 2] / 255.0f);
+                values.push_back(output[r * 3 + 1] / 255.0f);
+                values.push_back(output[r * 3] / 255.0f);
+            }
+        }
+    }
+    buildColorLut(lut, size, values);
+    lut.title = preset.name;
+}
+
+const ColorLut* colorLutPreset(const std::string& name) {
+    static std::mutex presetMutex;
+    static std::map<std::string, ColorLut> built;
+
+    for (const PresetEntry& preset : presetTable) {
+        if (name == preset.name) {
+            std::lock_guard<std::mutex> lock(presetMutex);
+            auto found = built.find(name);
+            if (found == built.end()) {
+                found = built.insert(std::make_pair(name, ColorLut())).first;
+                buildPreset(preset, found->second);
+            }
+            return &found->second;
+        }
+    }
+    return NULL;
+}
+
+std::vector<std::string> colorLutPresetNames() {
+    std::vector<std::string> names;
+    for (const PresetEntry& preset : presetTable) {
+        names.push_back(preset.name);
+    }
+    return names;
+}
+
+int applyColorLut(cv::Mat& src, cv::Mat& dst, const ColorLut& lut) {
+    if (src.empty() || src.type() != CV_8UC3 || lut.bricks.empty()) {
+        return -1; // Invalid source image or empty LUT
+    }
+
+    dst.create(src.size(), src.type());
+
+    const FilterKernels& kernels = filterKernels();
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            kernels.lut3dRow(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols, lut.bricks.data(),
+                &lut.offsets[0][0], &lut.fractions[0][0]);
+        }
+    });
+
+    return 0; // Success
+}
@@ -0,0 +1,45 @@
+// File: colorLut.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 21, 2024
+// Colour grading with 3D lookup tables. Looks come from standard .cube files (up to 65^3 points)
+// or from the built-in colour filters, and all of them run on the same tetrahedral interpolation
+// kernel, in parallel across rows.
+//
+// Layout: the lattice is split into bricks of 4x4x4 cells. Each brick stores its 5x5x5 points,
+// sharing its faces with the neighbours, so all corners of a cell are within one 1000 byte block
+// instead of three planes apart. A point is B, G, R and a pad, 8.7 fixed point, 8 bytes.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define COLOR_LUT_MAX_SIZE 65
+#define COLOR_LUT_BRICK_CELLS 4
+
+struct ColorLut {
+    std::string title;
+    int size;                           // points per axis, 2 to COLOR_LUT_MAX_SIZE
+    std::vector<uint16_t> bricks;       // 4 values per point, see above
+    int32_t offsets[3][256];            // per axis (B, G, R): offset of the cell of an input value, in points
+    uint16_t fractions[3][256];         // per axis: position of the input value inside its cell, out of 256
+};
+
+// Load a .cube file with a 3D table. Returns -1 if the file can't be read or isn't a 3D LUT.
+int loadCubeLut(const std::string& path, ColorLut& lut);
+
+// Build a LUT from a grid of colours: values holds size^3 RGB triples in 0..1, red changing
+// fastest as in .cube files. domainMin and domainMax are the RGB inputs of the first and last points.
+int buildColorLut(ColorLut& lut, int size, const std::vector<float>& values,
+    const float domainMin[3] = NULL, const float domainMax[3] = NULL);
+
+// Built-in looks: "identity", "sepia", "altgrey" and "strongcolor", sampled from the filters of
+// the same name. Returns NULL for an unknown name. The tables are built on first use.
+const ColorLut* colorLutPreset(const std::string& name);
+
+// Names of the built-in looks
+std::vector<std::string> colorLutPresetNames();
+
+// Grade an 8-bit BGR image through the LUT, dst may be src
+int applyColorLut(cv::Mat& src, cv::Mat& dst, const ColorLut& lut);
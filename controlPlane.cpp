@@ -0,0 +1,388 @@
+// File: controlPlane.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 19, 2024
+// Key and text command handling of the control plane, and the stdin and socket inputs
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include "controlPlane.h"
+#include "perfCounters.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+// Toggle modes: key in the window, command name, the label printed on a change and whether the
+// mode is one of the effects. The effects are in the order the render loop tries them.
+struct ModeEntry {
+    char key;
+    const char* name;
+    bool ControlParams::* flag;
+    const char* label;
+    bool effect;
+};
+
+static const ModeEntry modeTable[] = {
+    { 'g', "grey", &ControlParams::greyScaleMode, "Grey Scale", true },
+    { 'h', "altgrey", &ControlParams::altGreyScaleMode, "Alternate Grey Scale", true },
+    { 't', "sepia", &ControlParams::sepiaToneMode, "Sepia Tone Filter", true },
+    { 'v', "vignette", &ControlParams::vignetteMode, "Vignette Filter", true },
+    { 'b', "blur", &ControlParams::blurEnabled, "Blur Filter", true },
+    { 'x', "sobelx", &ControlParams::sobelXMode, "Sobel X Filter", true },
+    { 'y', "sobely", &ControlParams::sobelYMode, "Sobel Y Filter", true },
+    { 'm', "magnitude", &ControlParams::gradientMagnitudeMode, "Gradient Magnitude", true },
+    { 'l', "quantize", &ControlParams::blurQuantizeMode, "Blur and Quantize", true },
+    { 'r', "cartoon", &ControlParams::cartoonMode, "Cartoon", true },
+    { 'f', "faces", &ControlParams::faceDetectionMode, "Face Detection", true },
+    { 'n', "strongcolor", &ControlParams::pickStrongColorMode, "Strong Color Mode", true },
+    { 'c', "hearts", &ControlParams::heartsMode, "Halo", true },
+    { 'p', "emboss", &ControlParams::embossingEnabled, "Embossing", true },
+    { 'u', "motionblur", &ControlParams::motionBlurMode, "Motion Blur", true },
+    { 'k', "ghost", &ControlParams::ghostTrailsMode, "Ghost Trails", true },
+    { 'j', "motion", &ControlParams::motionHighlightMode, "Motion Highlight", true },
+    { 'z', "denoise", &ControlParams::temporalDenoiseMode, "Temporal Denoise", true },
+    { 'L', "grade", &ControlParams::gradeEnabled, "Colour Grading", false },
+    { 'A', "autolevels", &ControlParams::autoLevelsEnabled, "Auto Brightness and Contrast", false },
+    { 'C', "localeq", &ControlParams::localEqualizeEnabled, "Local Equalization", false },
+    { 'P', "privacy", &ControlParams::privacyEnabled, "Face Privacy", false },
+    { 'B', "privacyblur", &ControlParams::privacyBlur, "Privacy Blur", false },
+    { 'S', "stabilize", &ControlParams::stabilizeEnabled, "Stabilization", false },
+    { 'G', "grid", &ControlParams::gridEnabled, "Comparison Grid", false },
+    { 'o', "governor", &ControlParams::governorEnabled, "Quality Governor", false },
+    { 'i', "stats", &ControlParams::statsEnabled, "Statistics", false },
+    { 'H', "counters", &ControlParams::countersEnabled, "Hardware Counters", false },
+};
+
+ControlParams defaultControlParams() {
+    ControlParams params;
+    memset(&params, 0, sizeof(params));
+    params.vignetteStrength = 0.8;
+    params.vignetteRadius = 0.7;
+    params.blurSigma = 0.0f;
+    params.brightness = 1.0f;
+    params.contrast = 1.0f;
+    params.quantizeLevels = 10;
+    params.strongColorThreshold = 128;
+    return params;
+}
+
+ControlChannel::ControlChannel() : params(defaultControlParams()), stopping(false), listenFd(-1) {
+}
+
+ControlChannel::~ControlChannel() {
+    stop();
+}
+
+static std::string modeMessage(const ModeEntry& mode, bool enabled) {
+    return std::string(mode.label) + (enabled ? " Enabled" : " Disabled");
+}
+
+bool ControlChannel::applyKey(int key) {
+    for (const ModeEntry& mode : modeTable) {
+        if (key == mode.key) {
+            bool enabled = false;
+            update([&](ControlParams& p) {
+                p.*mode.flag = !(p.*mode.flag);
+                enabled = p.*mode.flag;
+            });
+            printf("%s\n", modeMessage(mode, enabled).c_str());
+            return true;
+        }
+    }
+
+    ControlParams next;
+    switch (key) {
+    //Blur strength on '[' and ']'
+    case ']':
+        update([&](ControlParams& p) { p.blurSigma += 1.0f; next = p; });
+        printf("Blur Sigma: %.1f\n", next.blurSigma);
+        return true;
+    case '[':
+        update([&](ControlParams& p) { p.blurSigma = std::max(0.0f, p.blurSigma - 1.0f); next = p; });
+        printf("Blur Sigma: %.1f\n", next.blurSigma);
+        return true;
+    //Brightness on 'w' and 'e', contrast on 'a' and 'd'
+    case 'w':
+        update([&](ControlParams& p) { p.brightness += 0.1f; next = p; });
+        printf("Brightness: %.2f\n", next.brightness);
+        return true;
+    case 'e':
+        update([&](ControlParams& p) { p.brightness -= 0.1f; next = p; });
+        printf("Brightness: %.2f\n", next.brightness);
+        return true;
+    case 'a':
+        update([&](ControlParams& p) { p.contrast += 0.1f; next = p; });
+        printf("Contrast: %.2f\n", next.contrast);
+        return true;
+    case 'd':
+        update([&](ControlParams& p) { p.contrast -= 0.1f; next = p; });
+        printf("Contrast: %.2f\n", next.contrast);
+        return true;
+    case 's':
+        update([](ControlParams& p) { p.saveRequests++; });
+        return true;
+    case 'q':
+        update([](ControlParams& p) { p.quit = true; });
+        return true;
+    default:
+        return false;
+    }
+}
+
+const char* activeEffectName(const ControlParams& params) {
+    if (params.gridEnabled) {
+        return "grid";
+    }
+    for (const ModeEntry& mode : modeTable) {
+        if (mode.effect && params.*mode.flag) {
+            return mode.name;
+        }
+    }
+    return "none";
+}
+
+static std::string statusText(const ControlParams& p) {
+    std::ostringstream text;
+    text << "modes:";
+    for (const ModeEntry& mode : modeTable) {
+        if (p.*mode.flag) {
+            text << " " << mode.name;
+        }
+    }
+    text << " | brightness " << p.brightness << " contrast " << p.contrast << " quantize-levels " << p.quantizeLevels
+        << " blur-sigma " << p.blurSigma << " vignette-strength " << p.vignetteStrength << " " << p.vignetteRadius
+        << " threshold " << p.strongColorThreshold;
+    return text.str();
+}
+
+bool ControlChannel::applyCommand(const std::string& line, std::string& reply) {
+    std::istringstream words(line);
+    std::string command;
+    if (!(words >> command)) {
+        reply.clear();
+        return true;
+    }
+
+    // Mode switches
+    for (const ModeEntry& mode : modeTable) {
+        if (command == mode.name) {
+            std::string state = "toggle";
+            words >> state;
+            if (state != "on" && state != "off" && state != "toggle") {
+                reply = "expected on, off or toggle";
+                return false;
+            }
+            bool enabled = false;
+            update([&](ControlParams& p) {
+                p.*mode.flag = state == "toggle" ? !(p.*mode.flag) : state == "on";
+                enabled = p.*mode.flag;
+            });
+            reply = modeMessage(mode, enabled);
+            return true;
+        }
+    }
+
+    if (command == "key") {
+        std::string key;
+        if (!(words >> key) || key.size() != 1 || !applyKey(key[0])) {
+            reply = "unknown key";
+            return false;
+        }
+        reply = "ok";
+        return true;
+    }
+    if (command == "save" || command == "quit") {
+        applyKey(command[0]);
+        reply = "ok";
+        return true;
+    }
+    if (command == "status") {
+        reply = statusText(params.load());
+        return true;
+    }
+
+    // Numeric parameters
+    double value = 0.0, second = -1.0;
+    if (!(words >> value)) {
+        reply = "unknown command " + command;
+        return false;
+    }
+    if (command == "brightness") {
+        update([&](ControlParams& p) { p.brightness = static_cast<float>(value); });
+    }
+    else if (command == "contrast") {
+        update([&](ControlParams& p) { p.contrast = static_cast<float>(value); });
+    }
+    else if (command == "quantize-levels" && value >= 1.0 && value <= 255.0) {
+        update([&](ControlParams& p) { p.quantizeLevels = static_cast<int>(value); });
+    }
+    else if (command == "blur-sigma" && value >= 0.0) {
+        update([&](ControlParams& p) { p.blurSigma = static_cast<float>(value); });
+    }
+    else if (command == "threshold" && value >= 0.0 && value <= 255.0) {
+        update([&](ControlParams& p) { p.strongColorThreshold = static_cast<int>(value); });
+    }
+    else if (command == "vignette-strength" && value >= 0.0 && value <= 1.0) {
+        bool hasRadius = static_cast<bool>(words >> second) && second > 0.0;
+        update([&](ControlParams& p) {
+            p.vignetteStrength = value;
+            if (hasRadius) {
+                p.vignetteRadius = second;
+            }
+        });
+    }
+    else {
+        reply = "unknown command or value out of range: " + line;
+        return false;
+    }
+    reply = statusText(params.load());
+    return true;
+}
+
+// The stdin thread is detached: a blocked read can't be interrupted portably. It reaches the
+// channel only through the link it shares, so a line read after stop, or after the channel was
+// destroyed, ends the thread instead of touching freed memory.
+void ControlChannel::startStdin() {
+    if (stdinLink) {
+        return;
+    }
+    stdinLink = std::make_shared<StdinLink>();
+    stdinLink->channel = this;
+    std::shared_ptr<StdinLink> link = stdinLink;
+    std::thread([link] {
+        excludeThreadFromProfiling();
+        std::string line, reply;
+        while (std::getline(std::cin, line)) {
+            std::lock_guard<std::mutex> lock(link->mutex);
+            if (link->channel == NULL) {
+                return;
+            }
+            link->channel->applyCommand(line, reply);
+            if (!reply.empty()) {
+                printf("%s\n", reply.c_str());
+            }
+        }
+    }).detach();
+}
+
+// Waits for a command the stdin thread is applying
+void ControlChannel::detachStdin() {
+    if (stdinLink) {
+        std::lock_guard<std::mutex> lock(stdinLink->mutex);
+        stdinLink->channel = NULL;
+    }
+}
+
+#ifdef _WIN32
+
+bool ControlChannel::startSocket(const std::string& path) {
+    printf("Control sockets are not supported on this platform (%s)\n", path.c_str());
+    return false;
+}
+
+void ControlChannel::socketLoop() {
+}
+
+void ControlChannel::stop() {
+    stopping = true;
+    detachStdin();
+}
+
+#else
+
+bool ControlChannel::startSocket(const std::string& path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path) || listenFd >= 0) {
+        return false;
+    }
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 4) != 0) {
+        close(fd);
+        return false;
+    }
+
+    listenFd = fd;
+    socketPath = path;
+    socketThread = std::thread(&ControlChannel::socketLoop, this);
+    return true;
+}
+
+// Wait until fd is readable, waking up regularly to notice stop()
+static bool waitReadable(int fd, const std::atomic<bool>& stopping) {
+    while (!stopping) {
+        pollfd p = { fd, POLLIN, 0 };
+        int ready = poll(&p, 1, 200);
+        if (ready > 0) {
+            return true;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Serves one client at a time, a command per line, answering each with one line
+void ControlChannel::socketLoop() {
+    excludeThreadFromProfiling();
+    while (waitReadable(listenFd, stopping)) {
+        int client = accept(listenFd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+
+        std::string pending, reply;
+        char buffer[512];
+        while (waitReadable(client, stopping)) {
+            ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            pending.append(buffer, n);
+            size_t newline;
+            while ((newline = pending.find('\n')) != std::string::npos) {
+                std::string line = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                applyCommand(line, reply);
+                reply += "\n";
+                send(client, reply.data(), reply.size(), MSG_NOSIGNAL);
+            }
+        }
+        close(client);
+    }
+}
+
+void ControlChannel::stop() {
+    stopping = true;
+    detachStdin();
+    if (socketThread.joinable()) {
+        socketThread.join();
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+        listenFd = -1;
+    }
+}
+
+#endif
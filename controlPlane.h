@@ -0,0 +1,134 @@
+// File: controlPlane.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 19, 2024
+// Control plane of vidDisplay. Every change of the effect parameters publishes a new snapshot
+// through a SeqLock; the render loop takes one snapshot per frame without locking, so controls
+// never wait for a frame and frames never wait for controls. Changes come from key presses in
+// the window, from text commands on stdin, or from a local (unix domain) socket.
+//
+// Commands, one per line:
+//   <mode> on|off|toggle    modes: grey altgrey sepia vignette blur sobelx sobely magnitude quantize
+//                                  cartoon faces strongcolor hearts emboss motionblur ghost motion denoise
+//                                  grade autolevels localeq privacy privacyblur stabilize grid governor stats
+//                                  counters
+//   brightness <value>      contrast <value>        quantize-levels <n>      blur-sigma <sigma>
+//   vignette-strength <strength> [radius]           threshold <strong color threshold>
+//   key <c>                 same as pressing c in the window
+//   save    quit    status
+
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "seqLock.h"
+
+struct ControlParams {
+    // Effect modes, the render loop applies the first one enabled in this order
+    bool greyScaleMode;
+    bool altGreyScaleMode;
+    bool sepiaToneMode;
+    bool vignetteMode;
+    bool blurEnabled;
+    bool sobelXMode;
+    bool sobelYMode;
+    bool gradientMagnitudeMode;
+    bool blurQuantizeMode;
+    bool cartoonMode;
+    bool faceDetectionMode;
+    bool pickStrongColorMode;
+    bool heartsMode;
+    bool embossingEnabled;
+    bool motionBlurMode;
+    bool ghostTrailsMode;
+    bool motionHighlightMode;
+    bool temporalDenoiseMode;
+
+    bool gradeEnabled;          // colour grading with the --lut table before the effect
+    bool autoLevelsEnabled;     // automatic brightness and contrast before the effect
+    bool localEqualizeEnabled;  // tile-based local equalization before the effect
+    bool privacyEnabled;        // anonymize the faces before the effect
+    bool privacyBlur;           // blur the faces instead of the mosaic
+    bool stabilizeEnabled;      // remove camera shake from the shown frame
+    bool gridEnabled;           // show the --grid chains side by side instead of one effect
+    bool governorEnabled;
+    bool statsEnabled;
+    bool countersEnabled;       // hardware counters of the filters, see perfCounters.h
+
+    // Effect parameters
+    double vignetteStrength;
+    double vignetteRadius;
+    float blurSigma;            // 0 keeps the original 5x5 blur kernels
+    float brightness;
+    float contrast;
+    int quantizeLevels;
+    int strongColorThreshold;
+
+    // One-shot requests, the render loop acts when the count changes
+    int saveRequests;
+    bool quit;
+};
+
+class ControlChannel {
+public:
+    ControlChannel();
+    ~ControlChannel();
+
+    // Latest parameters, lock-free
+    ControlParams snapshot() const { return params.load(); }
+
+    // Number of changes published so far
+    uint64_t version() const { return params.version(); }
+
+    // Apply a key press from the window, returns false for keys without a meaning
+    bool applyKey(int key);
+
+    // Apply a text command, reply gets the answer for the sender. Returns false if it wasn't understood.
+    bool applyCommand(const std::string& line, std::string& reply);
+
+    // Read commands from stdin on a background thread. The thread may block in a read past the
+    // channel's lifetime; it stops touching the channel once stop has run.
+    void startStdin();
+
+    // Accept commands on a unix domain socket at path, returns false if it can't listen
+    bool startSocket(const std::string& path);
+
+    // Stop the socket thread, remove the socket file and cut the stdin thread off
+    void stop();
+
+private:
+    // Copy, modify and publish the parameters. Only writers take the mutex.
+    template <typename Change>
+    void update(Change change) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        ControlParams next = params.load();
+        change(next);
+        params.store(next);
+    }
+
+    void socketLoop();
+    void detachStdin();
+
+    // Shared by the channel and its stdin thread, which owns it after the channel is gone.
+    // channel is NULL from stop on.
+    struct StdinLink {
+        std::mutex mutex;
+        ControlChannel* channel;
+    };
+
+    SeqLock<ControlParams> params;
+    std::mutex writerMutex;
+    std::atomic<bool> stopping;
+    std::thread socketThread;
+    int listenFd;
+    std::string socketPath;
+    std::shared_ptr<StdinLink> stdinLink;
+};
+
+// Parameters vidDisplay starts with
+ControlParams defaultControlParams();
+
+// Command name of the effect the render loop applies with these parameters, "none" without one
+const char* activeEffectName(const ControlParams& params);
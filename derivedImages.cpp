@@ -0,0 +1,132 @@
+// File: derivedImages.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 20, 2024
+// Lazy per-frame derived images, see derivedImages.h
+
+#include "derivedImages.h"
+#include "filter.h"
+
+static const char* derivedNames[DERIVED_KINDS] = { "grey", "half equalized", "sobel x", "sobel y", "hsv" };
+static const char* pyramidNames[DERIVED_PYRAMIDS] = { "BGR", "Grey" };
+
+void initDerivedImages(DerivedImages& derived) {
+    derived.frame = NULL;
+    derived.stats = NULL;
+    for (int i = 0; i < DERIVED_KINDS; i++) {
+        derived.images[i].release();
+        derived.valid[i] = false;
+        derived.computed[i] = 0;
+        derived.reused[i] = 0;
+    }
+    for (int i = 0; i < DERIVED_PYRAMIDS; i++) {
+        initImagePyramid(derived.pyramids[i]);
+        derived.pyramidValid[i] = false;
+    }
+}
+
+void beginDerivedFrame(DerivedImages& derived, cv::Mat& frame) {
+    derived.frame = &frame;
+    derived.stats = NULL;
+    for (int i = 0; i < DERIVED_KINDS; i++) {
+        derived.valid[i] = false;
+    }
+    for (int i = 0; i < DERIVED_PYRAMIDS; i++) {
+        derived.pyramidValid[i] = false;
+    }
+}
+
+void useFrameStats(DerivedImages& derived, FrameStatsEngine* stats) {
+    derived.stats = stats;
+}
+
+const cv::Mat& derivedImage(DerivedImages& derived, DerivedKind kind) {
+    cv::Mat& image = derived.images[kind];
+    if (derived.valid[kind]) {
+        derived.reused[kind]++;
+        return image;
+    }
+
+    // The outputs keep their buffers from the last frame, so same-size frames don't allocate
+    cv::Mat& frame = *derived.frame;
+    switch (kind) {
+    case DERIVED_GREY:
+        cv::cvtColor(frame, image, cv::COLOR_BGR2GRAY);
+        break;
+    case DERIVED_HALF_EQUALIZED: {
+        // Equalized out of the pyramid level, which stays available to the other stages
+        const cv::Mat& half = pyramidLevel(derivedPyramid(derived, PYRAMID_GREY), 1);
+        if (derived.stats != NULL) {
+            equalizationLut(derived.stats->wait(), derived.equalizeLut);
+            cv::LUT(half, derived.equalizeLut, image);
+        }
+        else {
+            cv::equalizeHist(half, image);
+        }
+        break;
+    }
+    case DERIVED_SOBEL_X:
+        sobelX3x3(frame, image);
+        break;
+    case DERIVED_SOBEL_Y:
+        sobelY3x3(frame, image);
+        break;
+    case DERIVED_HSV:
+        cv::cvtColor(frame, image, cv::COLOR_BGR2HSV);
+        break;
+    default:
+        break;
+    }
+    derived.valid[kind] = true;
+    derived.computed[kind]++;
+    return image;
+}
+
+ImagePyramid& derivedPyramid(DerivedImages& derived, DerivedPyramid which) {
+    ImagePyramid& pyramid = derived.pyramids[which];
+    if (!derived.pyramidValid[which]) {
+        beginImagePyramid(pyramid, which == PYRAMID_GREY ? derivedImage(derived, DERIVED_GREY) : *derived.frame);
+        derived.pyramidValid[which] = true;
+    }
+    return pyramid;
+}
+
+void prepareDerivedImages(DerivedImages& derived, unsigned kinds) {
+    for (int i = 0; i < DERIVED_KINDS; i++) {
+        if (kinds & DERIVED_BIT(i)) {
+            derivedImage(derived, (DerivedKind)i);
+        }
+    }
+}
+
+void shareDerivedImages(const DerivedImages& shared, DerivedImages& view) {
+    view.frame = shared.frame;
+    view.stats = NULL;
+    for (int i = 0; i < DERIVED_KINDS; i++) {
+        if (shared.valid[i]) {
+            view.images[i] = shared.images[i];
+        }
+        else if (view.images[i].data == shared.images[i].data) {
+            // Still the buffer of an earlier shared frame, computing into it would race with shared
+            view.images[i].release();
+        }
+        view.valid[i] = shared.valid[i];
+    }
+    for (int i = 0; i < DERIVED_PYRAMIDS; i++) {
+        view.pyramidValid[i] = false;
+    }
+}
+
+void printDerivedImageStats(const DerivedImages& derived) {
+    printf("Derived images (computed/reused):");
+    for (int i = 0; i < DERIVED_KINDS; i++) {
+        if (derived.computed[i] > 0) {
+            printf(" %s %lld/%lld", derivedNames[i], derived.computed[i], derived.reused[i]);
+        }
+    }
+    printf("\n");
+    for (int i = 0; i < DERIVED_PYRAMIDS; i++) {
+        if (derived.pyramids[i].computed > 0) {
+            printImagePyramidStats(derived.pyramids[i], pyramidNames[i]);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+// File: derivedImages.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 20, 2024
+// Per-frame cache of the images several effects derive from the same frame: grey, the half
+// size equalized grey used by face detection, the colour Sobel gradients and HSV, and the image
+// pyramids of the frame and of its grey. Each is computed on first request and at most once per
+// frame; the buffers are reused frame to frame.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include "frameStats.h"
+#include "imagePyramid.h"
+
+enum DerivedKind {
+    DERIVED_GREY,               // CV_8UC1
+    DERIVED_HALF_EQUALIZED,     // CV_8UC1, level 1 of the grey pyramid, histogram equalized (from the frame statistics if available)
+    DERIVED_SOBEL_X,            // CV_16SC3, sobelX3x3 of the frame
+    DERIVED_SOBEL_Y,            // CV_16SC3, sobelY3x3 of the frame
+    DERIVED_HSV,                // CV_8UC3
+    DERIVED_KINDS
+};
+
+enum DerivedPyramid {
+    PYRAMID_BGR,                // levels of the frame
+    PYRAMID_GREY,               // levels of DERIVED_GREY
+    DERIVED_PYRAMIDS
+};
+
+// Bit of a kind in the masks of prepareDerivedImages
+#define DERIVED_BIT(kind) (1u << (kind))
+
+struct DerivedImages {
+    cv::Mat* frame;             // frame of the current pass, owned by the caller
+    FrameStatsEngine* stats;    // statistics being computed for the frame, or NULL
+    cv::Mat equalizeLut;
+    cv::Mat images[DERIVED_KINDS];
+    bool valid[DERIVED_KINDS];
+    long long computed[DERIVED_KINDS];
+    long long reused[DERIVED_KINDS];
+    ImagePyramid pyramids[DERIVED_PYRAMIDS];
+    bool pyramidValid[DERIVED_PYRAMIDS];
+};
+
+void initDerivedImages(DerivedImages& derived);
+
+// Start a new frame: everything derived so far is stale. frame must stay alive and unchanged
+// until the next call.
+void beginDerivedFrame(DerivedImages& derived, cv::Mat& frame);
+
+// The statistics engine is sampling the current frame: equalization then uses its luma histogram
+// instead of building one from the half size image
+void useFrameStats(DerivedImages& derived, FrameStatsEngine* stats);
+
+// The derived image of the current frame, computed now if no stage asked for it yet
+const cv::Mat& derivedImage(DerivedImages& derived, DerivedKind kind);
+
+// A pyramid of the current frame, its levels are built as they are asked for
+ImagePyramid& derivedPyramid(DerivedImages& derived, DerivedPyramid which);
+
+// Compute the kinds in the DERIVED_BIT mask now, e.g. before several threads read them
+void prepareDerivedImages(DerivedImages& derived, unsigned kinds);
+
+// Let view use the images shared has for its current frame without computing them again. The
+// images are shared, not copied, so shared must not compute anything while view is in use; kinds
+// shared doesn't have are computed by view into buffers of its own. The pyramids aren't shared.
+void shareDerivedImages(const DerivedImages& shared, DerivedImages& view);
+
+void printDerivedImageStats(const DerivedImages& derived);
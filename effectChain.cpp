@@ -0,0 +1,318 @@
+// File: effectChain.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 12, 2024
+// Table of the named effects wrapping the filter.h functions
+
+#include "effectChain.h"
+#include "colorLut.h"
+#include "filter.h"
+
+typedef int (*EffectFunction)(cv::Mat& src, cv::Mat& dst, EffectContext& ctx);
+
+// Effects reading derived images take them from ctx.current, which holds the derived images of src
+
+static int greyEffect(cv::Mat&, cv::Mat& dst, EffectContext& ctx) {
+    cv::cvtColor(derivedImage(*ctx.current, DERIVED_GREY), dst, cv::COLOR_GRAY2BGR);
+    return 0;
+}
+
+static int altGreyEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    return altGreyScale(src, dst);
+}
+
+static int sepiaEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    return sepiaTone(src, dst);
+}
+
+static int vignetteEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    Vignette(src, dst);
+    return 0;
+}
+
+// Sepia and vignette fused into one pass
+static int oldPhotoEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    const cv::Mat& gains = vignetteMap(ctx.vignette, src.size(), 0.8, 0.7);
+    return applyPixelPipeline(src, dst, pixelPipeline::sepia() | pixelPipeline::vignette(gains));
+}
+
+static int blurEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    return blur5x5_B(src, dst);
+}
+
+static int gaussEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    return fastGaussianBlur(src, dst, 4.0f);
+}
+
+static int sobelXEffect(cv::Mat&, cv::Mat& dst, EffectContext& ctx) {
+    cv::convertScaleAbs(derivedImage(*ctx.current, DERIVED_SOBEL_X), dst);
+    return 0;
+}
+
+static int sobelYEffect(cv::Mat&, cv::Mat& dst, EffectContext& ctx) {
+    cv::convertScaleAbs(derivedImage(*ctx.current, DERIVED_SOBEL_Y), dst);
+    return 0;
+}
+
+static int magnitudeEffect(cv::Mat&, cv::Mat& dst, EffectContext& ctx) {
+    cv::Mat sx = derivedImage(*ctx.current, DERIVED_SOBEL_X);
+    cv::Mat sy = derivedImage(*ctx.current, DERIVED_SOBEL_Y);
+    gradientMagnitudeEuclidean(sx, sy, ctx.scratch);
+    ctx.scratch.convertTo(dst, CV_8U);
+    return 0;
+}
+
+static int quantizeEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    blurQuantize(src, dst, 10);
+    return 0;
+}
+
+static int cartoonEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    return cartoon(src, dst);
+}
+
+// Built-in looks through the colour LUT path
+static int lutSepiaEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    return applyColorLut(src, dst, *colorLutPreset("sepia"));
+}
+
+static int lutAltGreyEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    return applyColorLut(src, dst, *colorLutPreset("altgrey"));
+}
+
+static int lutStrongColorEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    return applyColorLut(src, dst, *colorLutPreset("strongcolor"));
+}
+
+static int embossEffect(cv::Mat&, cv::Mat& dst, EffectContext& ctx) {
+    embossingFromGradients(derivedImage(*ctx.current, DERIVED_SOBEL_X), derivedImage(*ctx.current, DERIVED_SOBEL_Y), ctx.scratch);
+    cv::convertScaleAbs(ctx.scratch, dst);
+    return 0;
+}
+
+static int strongColorEffect(cv::Mat& src, cv::Mat& dst, EffectContext&) {
+    return pickStrongColor(src, dst);
+}
+
+static int facesEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    detectFacesCached(*ctx.current, ctx.faces, ctx.detectionCache);
+    src.copyTo(dst);
+    return drawBoxes(dst, ctx.faces);
+}
+
+static int heartsEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    detectFacesCached(*ctx.current, ctx.faces, ctx.detectionCache);
+    src.copyTo(dst);
+    return drawHearts(dst, ctx.faces, 0, 1.0f, ctx.hearts);
+}
+
+static int privacy(cv::Mat& src, cv::Mat& dst, EffectContext& ctx, PrivacyStyle style) {
+    detectFacesCached(*ctx.current, ctx.faces, ctx.detectionCache);
+    updatePrivacyRegions(ctx.privacy, ctx.faces, true);
+    src.copyTo(dst);
+    applyPrivacyMask(dst, ctx.privacy, style);
+    return 0;
+}
+
+static int privacyEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    return privacy(src, dst, ctx, PRIVACY_PIXELATE);
+}
+
+static int privacyBlurEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    return privacy(src, dst, ctx, PRIVACY_BLUR);
+}
+
+// stabilize, with the small copy taken from the pyramid of the input
+static int stabilizeEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    cv::Mat small;
+    double scale;
+    stabilizerInput(derivedPyramid(*ctx.current, PYRAMID_BGR), small, scale);
+    updateStabilizer(ctx.stabilizer, small, scale, src.size());
+    return warpStabilized(ctx.stabilizer, src, dst);
+}
+
+// Frame history and accumulator of the running chain position, set up on its first frame. A
+// chain like "motionblur+denoise" would otherwise have both effects restart the one accumulator.
+static TemporalState& temporalState(EffectContext& ctx) {
+    while (ctx.temporal.size() <= ctx.position) {
+        ctx.temporal.emplace_back();
+        initTemporalState(ctx.temporal.back());
+    }
+    return ctx.temporal[ctx.position];
+}
+
+static int motionBlurEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    return motionBlur(src, dst, temporalState(ctx));
+}
+
+static int ghostEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    return ghostTrails(src, dst, temporalState(ctx));
+}
+
+static int motionEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    return motionHighlight(src, dst, temporalState(ctx));
+}
+
+static int denoiseEffect(cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    return temporalDenoise(src, dst, temporalState(ctx));
+}
+
+// haloRows is how far an output row may depend on the input rows above and below it, so a band
+// of rows with that many rows of context on each side gives exactly the rows of the whole image.
+// It is -1 for effects that depend on the whole frame (the vignette centre, face detection, the
+// recursive vertical pass of blur5x5_B) or on earlier frames. gauss is three box passes of
+// radius 3 or 4, cartoon a 5x5 blur followed by a 3x3 Sobel. sobelX3x3 and sobelY3x3 leave their
+// first and last rows zero, in the horizontal pass too, so the Sobel effects need two rows: the
+// edge rows of a band are wrong, and so is the row next to them. derivedKinds are the derived
+// images of its input the effect reads, as DERIVED_BIT mask.
+struct EffectEntry {
+    const char* name;
+    EffectFunction function;
+    int haloRows;
+    unsigned derivedKinds;
+};
+
+static const EffectEntry effectTable[] = {
+    { "grey", greyEffect, 0, DERIVED_BIT(DERIVED_GREY) },
+    { "altgrey", altGreyEffect, 0, 0 },
+    { "sepia", sepiaEffect, 0, 0 },
+    { "lut-sepia", lutSepiaEffect, 0, 0 },
+    { "lut-altgrey", lutAltGreyEffect, 0, 0 },
+    { "lut-strongcolor", lutStrongColorEffect, 0, 0 },
+    { "vignette", vignetteEffect, -1, 0 },
+    { "oldphoto", oldPhotoEffect, -1, 0 },
+    { "blur", blurEffect, -1, 0 },
+    { "gauss", gaussEffect, 10, 0 },
+    { "sobelx", sobelXEffect, 2, DERIVED_BIT(DERIVED_SOBEL_X) },
+    { "sobely", sobelYEffect, 2, DERIVED_BIT(DERIVED_SOBEL_Y) },
+    { "magnitude", magnitudeEffect, 2, DERIVED_BIT(DERIVED_SOBEL_X) | DERIVED_BIT(DERIVED_SOBEL_Y) },
+    { "quantize", quantizeEffect, 2, 0 },
+    { "cartoon", cartoonEffect, 3, 0 },
+    { "emboss", embossEffect, 2, DERIVED_BIT(DERIVED_SOBEL_X) | DERIVED_BIT(DERIVED_SOBEL_Y) },
+    { "strongcolor", strongColorEffect, 0, 0 },
+    { "faces", facesEffect, -1, DERIVED_BIT(DERIVED_GREY) | DERIVED_BIT(DERIVED_HALF_EQUALIZED) },
+    { "hearts", heartsEffect, -1, DERIVED_BIT(DERIVED_GREY) | DERIVED_BIT(DERIVED_HALF_EQUALIZED) },
+    { "privacy", privacyEffect, -1, DERIVED_BIT(DERIVED_GREY) | DERIVED_BIT(DERIVED_HALF_EQUALIZED) },
+    { "privacy-blur", privacyBlurEffect, -1, DERIVED_BIT(DERIVED_GREY) | DERIVED_BIT(DERIVED_HALF_EQUALIZED) },
+    { "stabilize", stabilizeEffect, -1, 0 },
+    { "motionblur", motionBlurEffect, -1, 0 },
+    { "ghost", ghostEffect, -1, 0 },
+    { "motion", motionEffect, -1, 0 },
+    { "denoise", denoiseEffect, -1, 0 },
+};
+
+static const EffectEntry* findEntry(const std::string& name) {
+    for (const EffectEntry& entry : effectTable) {
+        if (name == entry.name) {
+            return &entry;
+        }
+    }
+    return NULL;
+}
+
+static EffectFunction findEffect(const std::string& name) {
+    const EffectEntry* entry = findEntry(name);
+    return entry != NULL ? entry->function : NULL;
+}
+
+// Run an effect on src, whose derived images are in ctx.current
+static int runEffect(const std::string& name, cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    EffectFunction function = findEffect(name);
+    if (function == NULL || src.empty()) {
+        return -1;
+    }
+    return function(src, dst, ctx);
+}
+
+int applyEffect(const std::string& name, cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    beginDerivedFrame(ctx.source, src);
+    ctx.current = &ctx.source;
+    ctx.position = 0;
+    return runEffect(name, src, dst, ctx);
+}
+
+// Run the chain on src, whose derived images are in ctx.source
+static int runChain(const std::vector<std::string>& chain, cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    if (chain.empty()) {
+        src.copyTo(dst);
+        return 0;
+    }
+
+    // Ping-pong between the two context buffers, the last effect writes straight into dst.
+    // The derived images of src are kept apart from those of the intermediate results, so a
+    // host can look at them after the chain ran.
+    cv::Mat* input = &src;
+    for (size_t i = 0; i < chain.size(); i++) {
+        cv::Mat* output = i + 1 == chain.size() ? &dst : &ctx.buffers[i % 2];
+        if (i == 0) {
+            ctx.current = &ctx.source;
+        }
+        else {
+            beginDerivedFrame(ctx.stage, *input);
+            ctx.current = &ctx.stage;
+        }
+        ctx.position = i;
+        if (runEffect(chain[i], *input, *output, ctx) != 0) {
+            return -1;
+        }
+        input = output;
+    }
+    return 0;
+}
+
+int applyEffectChain(const std::vector<std::string>& chain, cv::Mat& src, cv::Mat& dst, EffectContext& ctx) {
+    beginDerivedFrame(ctx.source, src);
+    return runChain(chain, src, dst, ctx);
+}
+
+int applyEffectChainShared(const std::vector<std::string>& chain, cv::Mat& src, cv::Mat& dst, EffectContext& ctx, const DerivedImages& shared) {
+    if (shared.frame != &src) {
+        return -1;
+    }
+    shareDerivedImages(shared, ctx.source);
+    return runChain(chain, src, dst, ctx);
+}
+
+unsigned effectChainDerivedKinds(const std::vector<std::string>& chain) {
+    const EffectEntry* first = chain.empty() ? NULL : findEntry(chain[0]);
+    return first != NULL ? first->derivedKinds : 0;
+}
+
+bool parseEffectChain(const std::string& spec, std::vector<std::string>& chain) {
+    chain.clear();
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t plus = spec.find('+', start);
+        std::string name = spec.substr(start, plus == std::string::npos ? std::string::npos : plus - start);
+        if (!name.empty()) {
+            if (findEffect(name) == NULL) {
+                return false;
+            }
+            chain.push_back(name);
+        }
+        if (plus == std::string::npos) {
+            break;
+        }
+        start = plus + 1;
+    }
+    return true;
+}
+
+int effectChainHaloRows(const std::vector<std::string>& chain) {
+    int halo = 0;
+    for (const std::string& name : chain) {
+        const EffectEntry* found = findEntry(name);
+        if (found == NULL || found->haloRows < 0) {
+            return -1;
+        }
+        halo += found->haloRows;
+    }
+    return halo;
+}
+
+std::vector<std::string> effectNames() {
+    std::vector<std::string> names;
+    for (const EffectEntry& entry : effectTable) {
+        names.push_back(entry.name);
+    }
+    return names;
+}
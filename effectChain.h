@@ -0,0 +1,68 @@
+// File: effectChain.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 12, 2024
+// Named effects that can be chained, e.g. "sepia+vignette", for hosts driving several pipelines
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "derivedImages.h"
+#include "faceDetect.h"
+#include "overlaySprites.h"
+#include "pixelPipeline.h"
+#include "privacyMask.h"
+#include "stabilizer.h"
+#include "temporalFilters.h"
+
+// Per-pipeline state carried between frames by the stateful effects
+struct EffectContext {
+    std::vector<cv::Rect> faces;
+    DetectionCache detectionCache;
+    HeartOverlay hearts;
+    PrivacyState privacy;
+    StabilizerState stabilizer;
+    VignetteMap vignette;
+    std::vector<TemporalState> temporal;    // one per chain position, so temporal effects keep apart
+    size_t position;            // chain position of the running effect
+    DerivedImages source;       // derived images of the chain input
+    DerivedImages stage;        // derived images of an intermediate result
+    DerivedImages* current;     // one of the two, for the input of the running effect
+    cv::Mat scratch;
+    cv::Mat buffers[2];
+
+    EffectContext() {
+        initDetectionCache(detectionCache);
+        initPrivacyState(privacy);
+        initStabilizer(stabilizer);
+        initDerivedImages(source);
+        initDerivedImages(stage);
+        current = &source;
+        position = 0;
+    }
+};
+
+// Apply one named effect. Every effect takes and produces an 8-bit BGR image, so any
+// effects can follow each other. Returns -1 for an unknown name.
+int applyEffect(const std::string& name, cv::Mat& src, cv::Mat& dst, EffectContext& ctx);
+
+// Apply the effects in order, src is left untouched. An empty chain copies src.
+int applyEffectChain(const std::vector<std::string>& chain, cv::Mat& src, cv::Mat& dst, EffectContext& ctx);
+
+// The same with the derived images of src taken from shared, which several pipelines may read at
+// once, e.g. the tiles of a comparison grid. shared must be for src (its frame is &src) and hold
+// at least the kinds of effectChainDerivedKinds, or the chain computes the others itself.
+int applyEffectChainShared(const std::vector<std::string>& chain, cv::Mat& src, cv::Mat& dst, EffectContext& ctx, const DerivedImages& shared);
+
+// Derived images of its input the first effect of the chain reads, as DERIVED_BIT mask
+unsigned effectChainDerivedKinds(const std::vector<std::string>& chain);
+
+// Split "sepia+vignette" into its effect names, returns false if a name is unknown
+bool parseEffectChain(const std::string& spec, std::vector<std::string>& chain);
+
+// Rows of context above and below a band the chain needs to give exactly the rows of the whole
+// image, or -1 if an effect of the chain can't run on bands of rows
+int effectChainHaloRows(const std::vector<std::string>& chain);
+
+// Names of all the effects, for usage messages
+std::vector<std::string> effectNames();
@@ -0,0 +1,160 @@
+// File: effectGrid.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 26, 2024
+// Tile workers and layout of the comparison grid, see effectGrid.h
+
+#include <algorithm>
+#include <cmath>
+#include "effectGrid.h"
+
+EffectGrid::EffectGrid() : target(NULL), generation(0), pending(0), stopping(false), renderMs(0.0) {
+    initDerivedImages(shared);
+}
+
+EffectGrid::~EffectGrid() {
+    stopWorkers();
+}
+
+void EffectGrid::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    stopping = false;
+}
+
+bool EffectGrid::configure(const std::string& spec) {
+    std::vector<std::unique_ptr<Tile>> next;
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t comma = spec.find(',', start);
+        std::string chainSpec = spec.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (!chainSpec.empty()) {
+            std::unique_ptr<Tile> tile(new Tile());
+            if (!parseEffectChain(chainSpec, tile->chain)) {
+                return false;
+            }
+            tile->label = chainSpec;
+            tile->ms = 0.0;
+            tile->result = 0;
+            next.push_back(std::move(tile));
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        start = comma + 1;
+    }
+
+    // The workers index the tiles, so they are replaced together
+    stopWorkers();
+    tiles = std::move(next);
+    for (size_t i = 0; i < tiles.size(); i++) {
+        workers.push_back(std::thread(&EffectGrid::workerLoop, this, i, generation));
+    }
+    return true;
+}
+
+int EffectGrid::render(const cv::Mat& frame, cv::Mat& grid, ImagePyramid* pyramid) {
+    if (frame.empty() || frame.type() != CV_8UC3 || tiles.empty()) {
+        return -1;
+    }
+    int64 start = cv::getTickCount();
+
+    // As square as the tiles allow, each tile keeping the aspect of the frame. The tiles are
+    // rounded up so they cover the whole frame, the last column and row are cut to fit.
+    int count = (int)tiles.size();
+    int columns = (int)std::ceil(std::sqrt((double)count));
+    int rows = (count + columns - 1) / columns;
+    cv::Size tileSize((frame.cols + columns - 1) / columns, (frame.rows + rows - 1) / rows);
+    grid.create(frame.size(), CV_8UC3);
+    grid.setTo(cv::Scalar::all(0));
+
+    // The single downscale and derived images every tile starts from. A 2x2 grid of an even sized
+    // frame takes pyramid level 1 as it is.
+    const cv::Mat* source = pyramid != NULL ? &pyramidLevel(*pyramid, pyramidLevelFor(*pyramid, tileSize)) : &frame;
+    if (source->size() != tileSize) {
+        cv::resize(*source, reduced, tileSize, 0, 0, cv::INTER_AREA);
+        source = &reduced;
+    }
+    small = *source;
+    beginDerivedFrame(shared, small);
+    unsigned kinds = 0;
+    for (const std::unique_ptr<Tile>& tile : tiles) {
+        kinds |= effectChainDerivedKinds(tile->chain);
+    }
+    prepareDerivedImages(shared, kinds);
+
+    for (int i = 0; i < count; i++) {
+        cv::Rect cell((i % columns) * tileSize.width, (i / columns) * tileSize.height, tileSize.width, tileSize.height);
+        tiles[i]->cell = cell & cv::Rect(0, 0, frame.cols, frame.rows);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        target = &grid;
+        pending = count;
+        generation++;
+        wake.notify_all();
+        done.wait(lock, [this] { return pending == 0; });
+        target = NULL;
+    }
+
+    renderMs = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+    for (const std::unique_ptr<Tile>& tile : tiles) {
+        if (tile->result != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+double EffectGrid::slowestTileMs() const {
+    double slowest = 0.0;
+    for (const std::unique_ptr<Tile>& tile : tiles) {
+        slowest = std::max(slowest, tile->ms);
+    }
+    return slowest;
+}
+
+void EffectGrid::workerLoop(size_t index, long long seen) {
+    Tile& tile = *tiles[index];
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&] { return generation != seen || stopping; });
+        if (stopping) {
+            return;
+        }
+        seen = generation;
+        cv::Mat* grid = target;
+        lock.unlock();
+
+        // The cells don't overlap, so the tiles write the grid without locking
+        int64 start = cv::getTickCount();
+        tile.result = applyEffectChainShared(tile.chain, small, tile.output, tile.ctx, shared);
+        if (tile.result == 0 && !tile.cell.empty()) {
+            cv::Mat cell = (*grid)(tile.cell);
+            if (tile.output.cols >= cell.cols && tile.output.rows >= cell.rows) {
+                tile.output(cv::Rect(0, 0, cell.cols, cell.rows)).copyTo(cell);
+            }
+            else {
+                cv::resize(tile.output, cell, cell.size());
+            }
+            cv::putText(cell, tile.label, cv::Point(6, 18), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 0, 0), 3);
+            cv::putText(cell, tile.label, cv::Point(6, 18), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1);
+        }
+        tile.ms = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+        lock.lock();
+        if (--pending == 0) {
+            done.notify_all();
+        }
+    }
+}
+
+void printEffectGridStats(const EffectGrid& grid) {
+    printf("Comparison grid: %d tiles, %.2f ms per frame, slowest tile %.2f ms\n", grid.tileCount(), grid.lastRenderMs(), grid.slowestTileMs());
+}
@@ -0,0 +1,68 @@
+// File: effectGrid.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 26, 2024
+// Comparison grid: several effect chains side by side on the same frame, e.g. to pick a look.
+// The frame is downscaled to the tile size once and its derived images are computed once for all
+// tiles, then every tile runs its chain on a worker thread of its own, at tile resolution, so
+// the grid costs about as much as one effect on the full frame.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "effectChain.h"
+
+class EffectGrid {
+public:
+    EffectGrid();
+    ~EffectGrid();
+
+    // One tile per chain of spec, chains separated by commas, e.g. "sepia,emboss,cartoon+vignette".
+    // Returns false and keeps the current tiles if a name is unknown.
+    bool configure(const std::string& spec);
+
+    // Render the tiles of frame into grid, which gets the size of frame and is covered by the
+    // tiles up to the unused cells. With the pyramid of frame the tiles are reduced from its
+    // smallest level covering them instead of from frame.
+    int render(const cv::Mat& frame, cv::Mat& grid, ImagePyramid* pyramid = NULL);
+
+    int tileCount() const { return (int)tiles.size(); }
+
+    // Time of the last render and of its slowest tile, in ms
+    double lastRenderMs() const { return renderMs; }
+    double slowestTileMs() const;
+
+private:
+    struct Tile {
+        std::vector<std::string> chain;
+        std::string label;
+        EffectContext ctx;
+        cv::Mat output;
+        cv::Rect cell;          // where the tile goes in the grid, its top left part where the grid ends
+        double ms;
+        int result;
+    };
+
+    void stopWorkers();
+    void workerLoop(size_t index, long long seen);
+
+    std::vector<std::unique_ptr<Tile>> tiles;
+    std::vector<std::thread> workers;
+    cv::Mat reduced;            // the frame or a pyramid level resized to the tile size
+    cv::Mat small;              // the frame at tile size, shared by the tiles: reduced or a pyramid level
+    DerivedImages shared;       // its derived images, computed before the tiles start
+    cv::Mat* target;            // grid of the render in progress
+    long long generation;       // render the workers are asked for
+    int pending;                // tiles of this render still running
+    bool stopping;
+    double renderMs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+};
+
+void printEffectGridStats(const EffectGrid& grid);
@@ -5,46 +5,158 @@
 
 #include <cmath>
 #include <cstdio>
+#include <condition_variable>
 #include <cstdlib>
+#include <mutex>
+#include <string>
 #include <opencv2/opencv.hpp>
 #include "faceDetect.h"
+#include "overlaySprites.h"
+
+
+#ifdef VFX_EMBEDDED_FACE_CASCADE
+// the cascade compiled into the library by the build, see CMakeLists.txt
+extern const unsigned char faceCascadeData[];
+extern const size_t faceCascadeSize;
+#endif
+
+// Text of the cascade, read once and shared by every classifier instance. The VFX_FACE_CASCADE
+// environment variable names a file to use instead of the built-in cascade.
+static bool readCascadeText( std::string &text ) {
+  const char *path = getenv( "VFX_FACE_CASCADE" );
+#ifdef VFX_EMBEDDED_FACE_CASCADE
+  if( path == NULL || path[0] == '\0' ) {
+    text.assign( reinterpret_cast<const char *>( faceCascadeData ), faceCascadeSize );
+    return true;
+  }
+#endif
+  if( path == NULL || path[0] == '\0' ) {
+    path = FACE_CASCADE_FILE;
+  }
+  FILE *fp = fopen( path, "rb" );
+  if( fp == NULL ) {
+    return false;
+  }
+  fseek( fp, 0, SEEK_END );
+  long size = ftell( fp );
+  fseek( fp, 0, SEEK_SET );
+  text.resize( size > 0 ? size : 0 );
+  size_t got = size > 0 ? fread( &text[0], 1, size, fp ) : 0;
+  fclose( fp );
+  return got > 0 && got == text.size();
+}
+
+// cv::CascadeClassifier keeps per-call state, so concurrent detections each need their own
+// instance. Instances are pooled: the pool grows to the number of threads detecting at the
+// same time, not to the number of streams, and all of them are built from the same cascade text.
+// A thread finding the pool empty while another one is parsing waits for that instance rather
+// than parsing one more, so a detection right after startup picks up the warm-up's classifier.
+static std::mutex cascadePoolMutex;
+static std::condition_variable cascadePoolChanged;
+static std::vector<cv::CascadeClassifier *> idleCascades;
+static int cascadesBeingParsed = 0;
+
+// NULL if the cascade can't be loaded
+static cv::CascadeClassifier *acquireCascade() {
+  static std::string cascadeText;
+  {
+    std::unique_lock<std::mutex> lock( cascadePoolMutex );
+    cascadePoolChanged.wait( lock, [] { return !idleCascades.empty() || cascadesBeingParsed == 0; } );
+    if( !idleCascades.empty() ) {
+      cv::CascadeClassifier *cascade = idleCascades.back();
+      idleCascades.pop_back();
+      return cascade;
+    }
+    if( cascadeText.empty() && !readCascadeText( cascadeText ) ) {
+      cascadeText.clear();
+      return NULL;
+    }
+    cascadesBeingParsed++;
+  }
+
+  // parse the shared text into a new instance outside the lock
+  cv::CascadeClassifier *cascade = new cv::CascadeClassifier();
+  cv::FileStorage fs( cascadeText, cv::FileStorage::READ | cv::FileStorage::MEMORY );
+  if( !fs.isOpened() || !cascade->read( fs.getFirstTopLevelNode() ) ) {
+    delete cascade;
+    cascade = NULL;
+  }
+  {
+    std::lock_guard<std::mutex> lock( cascadePoolMutex );
+    cascadesBeingParsed--;
+  }
+  cascadePoolChanged.notify_all();
+  return cascade;
+}
+
+static void releaseCascade( cv::CascadeClassifier *cascade ) {
+  {
+    std::lock_guard<std::mutex> lock( cascadePoolMutex );
+    idleCascades.push_back( cascade );
+  }
+  cascadePoolChanged.notify_one();
+}
 
+/*
+  Parse the cascade and run it once, so the first real detection finds a ready classifier in the
+  pool. Meant for a background thread at startup. Returns -1 if the cascade can't be loaded.
+ */
+int warmUpFaceDetection() {
+  cv::CascadeClassifier *cascade = acquireCascade();
+  if( cascade == NULL ) {
+    return -1;
+  }
+
+  // the first detectMultiScale sets up the feature evaluator and its buffers
+  std::vector<cv::Rect> faces;
+  cascade->detectMultiScale( cv::Mat::zeros( 120, 160, CV_8UC1 ), faces );
+  releaseCascade( cascade );
+  return 0;
+}
 
 /*
   Arguments:
   cv::Mat grey  - a greyscale source image in which to detect faces
   std::vector<cv::Rect> &faces - a standard vector of cv::Rect rectangles indicating where faces were found
      if the length of the vector is zero, no faces were found
+
+  Safe to call from several threads at once.
  */
 int detectFaces( cv::Mat &grey, std::vector<cv::Rect> &faces ) {
-  // a static variable to hold a half-size image
-  static cv::Mat half;
-  
-  // a static variable to hold the classifier
-  static cv::CascadeClassifier face_cascade("C:/Users/visar/source/repos/VideoDisplay/VideoDisplay/haarcascade_frontalface_alt2.xml");
-
-  // the path to the haar cascade file
-  static cv::String face_cascade_file(FACE_CASCADE_FILE);
-
-  if( face_cascade.empty() ) {
-    if( !face_cascade.load( face_cascade_file ) ) {
-      printf("Unable to load face cascade file\n");
-      printf("Terminating\n");
-      exit(-1);
-    }
-  }
+  // a per-thread variable to hold a half-size image
+  static thread_local cv::Mat half;
 
-  // clear the vector of faces
-  faces.clear();
-  
-  // cut the image size in half to reduce processing time
-  cv::resize( grey, half, cv::Size(grey.cols/2, grey.rows/2) );
+  // cut the image size in half to reduce processing time, the same way as the pyramid level
+  // of the derived images
+  halveImage( grey, half );
 
   // equalize the image
   cv::equalizeHist( half, half );
 
+  return detectFacesEqualized( half, faces );
+}
+
+/*
+  The cascade part of detectFaces, for callers that already have the half size, equalized grey
+  image (e.g. from the derived image cache). The faces are in full size coordinates.
+
+  Safe to call from several threads at once.
+ */
+int detectFacesEqualized( const cv::Mat &halfEqualized, std::vector<cv::Rect> &faces ) {
+  // a classifier from the pool
+  cv::CascadeClassifier *face_cascade = acquireCascade();
+  if( face_cascade == NULL ) {
+    printf("Unable to load face cascade file\n");
+    printf("Terminating\n");
+    exit(-1);
+  }
+
+  // clear the vector of faces
+  faces.clear();
+
   // apply the Haar cascade detector
-  face_cascade.detectMultiScale( half, faces );
+  face_cascade->detectMultiScale( halfEqualized, faces );
+  releaseCascade( face_cascade );
 
   // adjust the rectangle sizes back to the full size image
   for(int i=0;i<faces.size();i++) {
@@ -57,6 +169,115 @@ int detectFaces( cv::Mat &grey, std::vector<cv::Rect> &faces ) {
   return(0);
 }
 
+// Size of the whole-frame fingerprint and of the patch kept around each face
+static const cv::Size thumbnailSize(64, 48);
+static const cv::Size faceThumbSize(16, 16);
+
+void initDetectionCache( DetectionCache &cache, double frameThreshold, double faceThreshold, int maxHits ) {
+  cache.thumbnail.release();
+  cache.faceThumbs.clear();
+  cache.faces.clear();
+  cache.frameThreshold = frameThreshold;
+  cache.faceThreshold = faceThreshold;
+  cache.maxHits = maxHits;
+  cache.hitsInARow = 0;
+  cache.hits = 0;
+  cache.misses = 0;
+}
+
+// Downscaled patch around a face, padded by a quarter of its size so head motion shows up
+static void faceThumb( const cv::Mat &grey, const cv::Rect &face, cv::Mat &thumb ) {
+  cv::Rect padded( face.x - face.width / 4, face.y - face.height / 4, face.width * 3 / 2, face.height * 3 / 2 );
+  padded &= cv::Rect( 0, 0, grey.cols, grey.rows );
+  if( padded.area() == 0 ) {
+    thumb = cv::Mat::zeros( faceThumbSize, CV_8UC1 );
+    return;
+  }
+  cv::resize( grey( padded ), thumb, faceThumbSize, 0, 0, cv::INTER_AREA );
+}
+
+// Mean absolute difference per pixel between two thumbnails of the same size
+static double meanAbsDiff( const cv::Mat &a, const cv::Mat &b ) {
+  return cv::norm( a, b, cv::NORM_L1 ) / (double)a.total();
+}
+
+/*
+  Same as detectFaces, but skips the cascade when the frame is close to the one of the last detection.
+
+  The whole frame is compared through a small equalized thumbnail, so global brightness changes don't
+  count as motion, and the area around each cached face is compared at a stricter threshold.
+
+  Arguments:
+  cv::Mat grey  - a greyscale source image in which to detect faces
+  DerivedImages *derived - derived images of the same frame, a miss then takes the equalized half size image from it
+  std::vector<cv::Rect> &faces - the faces found, or the cached ones on a hit
+  DetectionCache &cache - state and hit/miss counters, set up with initDetectionCache
+ */
+static int cachedDetection( const cv::Mat &grey, DerivedImages *derived, std::vector<cv::Rect> &faces, DetectionCache &cache ) {
+  // with the derived images the fingerprint starts from the smallest pyramid level covering it,
+  // the level up to the one of a miss is then built only once
+  cv::Mat thumbnail, source = grey;
+  if( derived != NULL ) {
+    ImagePyramid &pyramid = derivedPyramid( *derived, PYRAMID_GREY );
+    source = pyramidLevel( pyramid, pyramidLevelFor( pyramid, thumbnailSize ) );
+  }
+  cv::resize( source, thumbnail, thumbnailSize, 0, 0, cv::INTER_AREA );
+  cv::equalizeHist( thumbnail, thumbnail );
+
+  bool hit = !cache.thumbnail.empty() && cache.hitsInARow < cache.maxHits && cache.frameSize == grey.size() &&
+    meanAbsDiff( thumbnail, cache.thumbnail ) < cache.frameThreshold;
+
+  // The face patches must also be still, small head movements barely change the whole frame
+  cv::Mat thumb;
+  for( size_t i = 0; hit && i < cache.faces.size(); i++ ) {
+    faceThumb( grey, cache.faces[i], thumb );
+    hit = meanAbsDiff( thumb, cache.faceThumbs[i] ) < cache.faceThreshold;
+  }
+
+  if( hit ) {
+    cache.hits++;
+    cache.hitsInARow++;
+    faces = cache.faces;
+    return(0);
+  }
+
+  cache.misses++;
+  cache.hitsInARow = 0;
+  if( derived != NULL ) {
+    detectFacesEqualized( derivedImage( *derived, DERIVED_HALF_EQUALIZED ), faces );
+  }
+  else {
+    cv::Mat full = grey;
+    detectFaces( full, faces );
+  }
+
+  // Remember this frame as the reference for the next ones
+  cache.thumbnail = thumbnail;
+  cache.faces = faces;
+  cache.frameSize = grey.size();
+  cache.faceThumbs.resize( faces.size() );
+  for( size_t i = 0; i < faces.size(); i++ ) {
+    faceThumb( grey, faces[i], cache.faceThumbs[i] );
+  }
+
+  return(0);
+}
+
+int detectFacesCached( cv::Mat &grey, std::vector<cv::Rect> &faces, DetectionCache &cache ) {
+  return cachedDetection( grey, NULL, faces, cache );
+}
+
+// Same, taking the grey and half size equalized images from the derived image cache of the frame
+int detectFacesCached( DerivedImages &derived, std::vector<cv::Rect> &faces, DetectionCache &cache ) {
+  return cachedDetection( derivedImage( derived, DERIVED_GREY ), &derived, faces, cache );
+}
+
+void printDetectionCacheStats( const DetectionCache &cache ) {
+  long long total = cache.hits + cache.misses;
+  printf("Detection cache: %lld hits, %lld misses (%.1f%% of detections skipped)\n",
+    cache.hits, cache.misses, total > 0 ? 100.0 * cache.hits / total : 0.0);
+}
+
 /* Draws rectangles into frame given a vector of rectangles
    
    Arguments:
@@ -124,45 +345,47 @@ void drawHeart(cv::Mat& img, const cv::Point& center, int size) {
 }
 
 
-/*Function to draw a heart shape at a specific position in an image.
+/*Function to draw animated hearts and sparkles above the faces in an image.
+  The hearts come from a cache of pre-rasterized sprites and follow each face smoothly over time.
 
 Arguments:
-cv::Mat& img - image in which to draw the heart
-const cv::Point & center - position of the heart
-int size - size of the heart
+cv::Mat& frame - image in which to draw the hearts
+std::vector<cv::Rect>& faces - standard vector of cv::Rect rectangles
+int minWidth - ignore rectangles with a width smaller than this argument
+float scale - scale the rectangle values by this factor (in case frame is different than the source image)
+HeartOverlay& overlay - animation state of the stream the frame belongs to
 */
-int drawHearts(cv::Mat& frame, std::vector<cv::Rect>& faces, int minWidth, float scale) {
- // Random seed for heart positions
-     std::srand(static_cast<unsigned int>(std::time(0)));
-
-     for (size_t i = 0; i < faces.size(); i++) {
-         if (faces[i].width > minWidth) {
-             cv::Rect face(faces[i]);
-             face.x *= scale;
-             face.y *= scale;
-             face.width *= scale;
-             face.height *= scale;
-
-             // Draw the rectangle around the face
-             cv::Scalar wcolor(170, 120, 110);
-             cv::rectangle(frame, face, wcolor, 3);
-
-             // Draw hearts above the face
-             int numHearts = 5;
-             for (int j = 0; j < numHearts; j++) {
-                 int heartSize = std::rand() % 30 + 20; // Random size between 20 and 50
-
-                 // Randomly generate heart position outside the face rectangle
-                 int heartX = face.x + std::rand() % (face.width - heartSize);
-                 int heartY = face.y - heartSize - std::rand() % (2 * heartSize);
-
-                 // Draw the heart
-                 drawHeart(frame, cv::Point(heartX, heartY), heartSize);
-             }
-         }
-     }
+int drawHearts(cv::Mat& frame, std::vector<cv::Rect>& faces, int minWidth, float scale, HeartOverlay& overlay) {
+    // Time since the last frame drives the animation, clamped so a stall doesn't make the hearts jump
+    int64 now = cv::getTickCount();
+    double dt = overlay.lastTick == 0 ? 0.0 : (now - overlay.lastTick) / cv::getTickFrequency();
+    dt = std::min(std::max(dt, 0.0), 0.1);
+    overlay.lastTick = now;
+
+    std::vector<cv::Rect> scaled;
+    for (size_t i = 0; i < faces.size(); i++) {
+        if (faces[i].width > minWidth) {
+            cv::Rect face(faces[i]);
+            face.x *= scale;
+            face.y *= scale;
+            face.width *= scale;
+            face.height *= scale;
+
+            // Draw the rectangle around the face
+            cv::Scalar wcolor(170, 120, 110);
+            cv::rectangle(frame, face, wcolor, 3);
+            scaled.push_back(face);
+        }
+    }
 
-     return 0;
- }
+    updateHeartOverlay(overlay, scaled, dt);
+    renderHeartOverlay(overlay, frame);
 
+    return 0;
+}
 
+// Same as above with the animation state of the single stream of the program
+int drawHearts(cv::Mat& frame, std::vector<cv::Rect>& faces, int minWidth, float scale) {
+    static HeartOverlay overlay;
+    return drawHearts(frame, faces, minWidth, scale, overlay);
+}
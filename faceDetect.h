@@ -8,11 +8,36 @@
 #ifndef FACEDETECT_H
 #define FACEDETECT_H
 
-// put the path to the haar cascade file here
-#define FACE_CASCADE_FILE "C:/Users/visar/source/repos/VideoDisplay/VideoDisplay/haarcascade_frontalface_alt2.xml*"
+#include "derivedImages.h"
+
+// put the path to the haar cascade file here (the CMake build can set it with VFX_FACE_CASCADE_FILE,
+// and normally compiles the cascade into the library so this file is only a fallback)
+#ifndef FACE_CASCADE_FILE
+#define FACE_CASCADE_FILE "C:/Users/visar/source/repos/VideoDisplay/VideoDisplay/haarcascade_frontalface_alt2.xml"
+#endif
+
+// Reuses the last detections while the frame stays nearly the same
+struct DetectionCache {
+  cv::Mat thumbnail;                  // downscaled, equalized grey frame of the last detection
+  std::vector<cv::Mat> faceThumbs;    // downscaled grey patch around each cached face
+  std::vector<cv::Rect> faces;        // faces found by the last detection
+  cv::Size frameSize;                 // size of the grey frame they were found in
+  double frameThreshold;              // mean absolute difference per thumbnail pixel allowed for a hit
+  double faceThreshold;               // same for the patches around the faces
+  int maxHits;                        // detections are refreshed after this many hits in a row
+  int hitsInARow;
+  long long hits;
+  long long misses;
+};
 
 // prototypes
 int detectFaces( cv::Mat &grey, std::vector<cv::Rect> &faces );
+int warmUpFaceDetection();
+int detectFacesEqualized( const cv::Mat &halfEqualized, std::vector<cv::Rect> &faces );
+void initDetectionCache( DetectionCache &cache, double frameThreshold = 3.0, double faceThreshold = 6.0, int maxHits = 30 );
+int detectFacesCached( cv::Mat &grey, std::vector<cv::Rect> &faces, DetectionCache &cache );
+int detectFacesCached( DerivedImages &derived, std::vector<cv::Rect> &faces, DetectionCache &cache );
+void printDetectionCacheStats( const DetectionCache &cache );
 int drawBoxes( cv::Mat &frame, std::vector<cv::Rect> &faces, int minWidth = 50, float scale = 1.0  );
 int drawBubbles(cv::Mat& frame, std::vector<cv::Rect>& faces, int minWidth = 100, float scale = 1.0);
 
@@ -4,6 +4,8 @@
 // All visual effects filter functions 
 
 #include "filter.h"
+#include "filterKernels.h"
+#include "pixelPipeline.h"
 
 // Apply an alternative grayscale transformation to the source image
 int altGreyScale(cv::Mat& src, cv::Mat& dst){
@@ -13,14 +15,13 @@ int altGreyScale(cv::Mat& src, cv::Mat& dst){
 
     dst.create(src.size(), src.type());
 
-    // Custom greyscale transformation
-    for (int y = 0; y < src.rows; ++y) {
-        for (int x = 0; x < src.cols; ++x) {
-            cv::Vec3b pixel = src.at<cv::Vec3b>(y, x);
-            uchar grey_value = 255 - pixel[2]; // Custom transformation
-            dst.at<cv::Vec3b>(y, x) = cv::Vec3b(grey_value, grey_value, grey_value);
+    // Custom greyscale transformation (255 - red), one row at a time with the dispatched kernel
+    const FilterKernels& kernels = filterKernels();
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            kernels.altGreyRow(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols);
         }
-    }
+    });
     return 0; 
 }
 
@@ -32,29 +33,13 @@ int sepiaTone(cv::Mat& src, cv::Mat& dst) {
 
     dst.create(src.size(), src.type());
 
-    const double sepiaMatrix[3][3] = {
-        {0.272, 0.534, 0.131},
-        {0.349, 0.686, 0.168},
-        {0.393, 0.769, 0.189}
-    };
-
-    for (int y = 0; y < src.rows; ++y) {
-        for (int x = 0; x < src.cols; ++x) {
-            cv::Vec3b pixel = src.at<cv::Vec3b>(y, x);
-
-            // Apply sepia tone filter
-            double sepiaR = sepiaMatrix[0][0] * pixel[2] + sepiaMatrix[0][1] * pixel[1] + sepiaMatrix[0][2] * pixel[0];
-            double sepiaG = sepiaMatrix[1][0] * pixel[2] + sepiaMatrix[1][1] * pixel[1] + sepiaMatrix[1][2] * pixel[0];
-            double sepiaB = sepiaMatrix[2][0] * pixel[2] + sepiaMatrix[2][1] * pixel[1] + sepiaMatrix[2][2] * pixel[0];
-
-            // Clip values to the valid range [0, 255]
-            sepiaR = std::min(255.0, std::max(0.0, sepiaR));
-            sepiaG = std::min(255.0, std::max(0.0, sepiaG));
-            sepiaB = std::min(255.0, std::max(0.0, sepiaB));
-
-            dst.at<cv::Vec3b>(y, x) = cv::Vec3b(sepiaR, sepiaG, sepiaB);
+    // Sepia matrix applied to each row by the dispatched kernel, see filterKernelsImpl.cpp
+    const FilterKernels& kernels = filterKernels();
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            kernels.sepiaRow(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols);
         }
-    }
+    });
 
     return 0; // Success
 }
@@ -65,27 +50,10 @@ void Vignette(cv::Mat& src, cv::Mat& dst, double vignetteStrength, double vignet
         return; // Invalid source image
     }
 
-    dst.create(src.size(), src.type());
-
-    cv::Size imgSize = src.size();
-    cv::Point center(imgSize.width / 2, imgSize.height / 2);
-
-    for (int y = 0; y < src.rows; ++y) {
-        for (int x = 0; x < src.cols; ++x) {
-            cv::Vec3b pixel = src.at<cv::Vec3b>(y, x);
-
-            // Calculate vignette effect
-            double dist = cv::norm(center - cv::Point(x, y)) / cv::norm(center);
-            double vignette = 1.0 - vignetteStrength * (1.0 - std::exp(-0.5 * std::pow(dist / vignetteRadius, 2)));
-
-            // Apply vignette
-            pixel[0] *= vignette;
-            pixel[1] *= vignette;
-            pixel[2] *= vignette;
-
-            dst.at<cv::Vec3b>(y, x) = pixel;
-        }
-    }
+    // The gains depend only on the position, so they are computed once per size and parameters
+    // and the frame is a single multiply pass, see pixelPipeline.h
+    static thread_local VignetteMap gains;
+    applyPixelPipeline(src, dst, pixelPipeline::vignette(vignetteMap(gains, src.size(), vignetteStrength, vignetteRadius)));
 }
 // Apply a 5x5 blur filter to the source image (version A)
 int blur5x5_A(cv::Mat& src, cv::Mat& dst) {
@@ -244,9 +212,12 @@ int blur5x5_2(cv::Mat& src, cv::Mat& dst) {
 
 // Apply a 3x3 Sobel X filter to the source image
 int sobelX3x3(cv::Mat& src, cv::Mat& dst) {
-    //allocate dst image
-    dst = cv::Mat::zeros(src.size(), CV_16SC3); //signed short data type 
-    cv::Mat temp_h = cv::Mat::zeros(src.size(), CV_16SC3); //signed short data type 
+    //allocate dst image, reusing its buffer when the size is unchanged
+    dst.create(src.size(), CV_16SC3); //signed short data type 
+    dst.setTo(cv::Scalar::all(0));
+    static thread_local cv::Mat temp_h; //per-thread scratch kept between calls
+    temp_h.create(src.size(), CV_16SC3); //signed short data type 
+    temp_h.setTo(cv::Scalar::all(0));
     //loop over src and apply a 3x3 filter
     for (int i = 1; i < src.rows - 1; i++) {
 
@@ -290,9 +261,12 @@ int sobelX3x3(cv::Mat& src, cv::Mat& dst) {
 
 // Apply a 3x3 Sobel Y filter to the source image
 int sobelY3x3(cv::Mat& src, cv::Mat& dst) {
-    //allocate dst image
-    dst = cv::Mat::zeros(src.size(), CV_16SC3); //signed short data type 
-    cv::Mat temp_h = cv::Mat::zeros(src.size(), CV_16SC3); //signed short data type 
+    //allocate dst image, reusing its buffer when the size is unchanged
+    dst.create(src.size(), CV_16SC3); //signed short data type 
+    dst.setTo(cv::Scalar::all(0));
+    static thread_local cv::Mat temp_h; //per-thread scratch kept between calls
+    temp_h.create(src.size(), CV_16SC3); //signed short data type 
+    temp_h.setTo(cv::Scalar::all(0));
     //loop over src and apply a 3x3 filter
     for (int i = 1; i < src.rows - 1; i++) {
         //src pointer
@@ -337,38 +311,144 @@ int gradientMagnitudeEuclidean(cv::Mat& sx, cv::Mat& sy, cv::Mat& dst) {
     // The destination matrix is of type CV_32FC3 (32-bit floating-point with 3 channels)
     dst.create(sx.size(), CV_32FC3);
 
-    // Loop over each row in the images
-    for (int i = 0; i < sx.rows; i++) {
-        // Get pointers to the current row in Sobel X, Sobel Y, and the destination matrices
-        cv::Vec3s* xptr = sx.ptr<cv::Vec3s>(i);
-        cv::Vec3s* yptr = sy.ptr<cv::Vec3s>(i);
-        cv::Vec3f* dptr = dst.ptr<cv::Vec3f>(i);
-
-        // Loop over each column in the images
-        for (int j = 0; j < sx.cols; j++) {
-            // Loop over each channel (R, G, B) in the images
-            for (int k = 0; k < sx.channels(); k++) {
-                // Calculate the Euclidean distance (magnitude) for each channel
-                float magnitude = sqrt(static_cast<float>(xptr[j][k]) * static_cast<float>(xptr[j][k]) +
-                    static_cast<float>(yptr[j][k]) * static_cast<float>(yptr[j][k]));
-
-                // Normalize the magnitude to the range [0, 255]
-                magnitude = std::min(std::max(magnitude, 0.0f), 255.0f);
-
-                // Store the normalized magnitude in the destination matrix
-                dptr[j][k] = magnitude;
+    // Euclidean magnitude of each channel, clamped to [0, 255], one row at a time
+    const FilterKernels& kernels = filterKernels();
+    const int count = sx.cols * sx.channels();
+    cv::parallel_for_(cv::Range(0, sx.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            kernels.magnitudeRow(sx.ptr<short>(i), sy.ptr<short>(i), dst.ptr<float>(i), count);
+        }
+    });
+
+    return 0;
+}
+
+
+// Horizontal running-sum pass of the box blur, rows are clamped at the left and right edges
+static void boxBlurRows(const cv::Mat& src, cv::Mat& dst, int radius) {
+    const int cols = src.cols;
+    const int cn = src.channels();
+    const float inv = 1.0f / (2 * radius + 1);
+
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            const uchar* sptr = src.ptr<uchar>(y);
+            uchar* dptr = dst.ptr<uchar>(y);
+
+            for (int c = 0; c < cn; ++c) {
+                // Prime the window around x = 0
+                int sum = (radius + 1) * sptr[c];
+                for (int k = 1; k <= radius; ++k) {
+                    sum += sptr[std::min(k, cols - 1) * cn + c];
+                }
+
+                // Slide the window: one add and one subtract per pixel, whatever the radius
+                for (int x = 0; x < cols; ++x) {
+                    dptr[x * cn + c] = static_cast<uchar>(sum * inv + 0.5f);
+                    int xAdd = std::min(x + radius + 1, cols - 1);
+                    int xSub = std::max(x - radius, 0);
+                    sum += sptr[xAdd * cn + c] - sptr[xSub * cn + c];
+                }
+            }
+        }
+    });
+}
+
+// Vertical running-sum pass of the box blur. Each stripe of rows primes its own column sums,
+// so stripes are kept large relative to the radius to keep the priming cost amortized.
+static void boxBlurCols(const cv::Mat& src, cv::Mat& dst, int radius) {
+    const int rows = src.rows;
+    const int width = src.cols * src.channels();
+    const float inv = 1.0f / (2 * radius + 1);
+    const FilterKernels& kernels = filterKernels();
+    const int minStripeRows = std::max(4 * radius, 32);
+    const double nstripes = std::max(1, std::min(rows / minStripeRows, cv::getNumThreads() * 4));
+
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+        std::vector<int> sums(width, 0);
+
+        // Prime the column sums around the first row of this stripe
+        for (int k = -radius; k <= radius; ++k) {
+            const uchar* sptr = src.ptr<uchar>(std::min(std::max(range.start + k, 0), rows - 1));
+            for (int i = 0; i < width; ++i) {
+                sums[i] += sptr[i];
             }
         }
+
+        for (int y = range.start; y < range.end; ++y) {
+            const uchar* addPtr = src.ptr<uchar>(std::min(y + radius + 1, rows - 1));
+            const uchar* subPtr = src.ptr<uchar>(std::max(y - radius, 0));
+            kernels.boxColumnStep(sums.data(), addPtr, subPtr, dst.ptr<uchar>(y), width, inv);
+        }
+    }, nstripes);
+}
+
+// Apply a (2 * radius + 1) square box blur to an 8-bit image of any channel count.
+// The cost per pixel is constant in the radius, and dst may be the same image as src.
+int boxBlur(cv::Mat& src, cv::Mat& dst, int radius) {
+    if (src.empty() || src.depth() != CV_8U || radius < 0) {
+        return -1; // Invalid source image or radius
     }
 
-    return 0;
+    if (radius == 0) {
+        if (dst.data != src.data) {
+            src.copyTo(dst);
+        }
+        return 0;
+    }
+
+    cv::Mat rowsBlurred(src.size(), src.type());
+    boxBlurRows(src, rowsBlurred, radius);
+
+    dst.create(src.size(), src.type());
+    boxBlurCols(rowsBlurred, dst, radius);
+
+    return 0; // Success
 }
 
+// Approximate a Gaussian blur of the given sigma by repeated box blurs.
+// The box widths are chosen so the summed variance of the passes matches sigma^2.
+int fastGaussianBlur(cv::Mat& src, cv::Mat& dst, float sigma, int passes) {
+    if (src.empty() || sigma < 0.0f || passes < 1) {
+        return -1; // Invalid arguments
+    }
+
+    // Ideal width of a single box, then the nearest odd widths below and above it
+    double idealWidth = std::sqrt(12.0 * sigma * sigma / passes + 1.0);
+    int lowWidth = static_cast<int>(std::floor(idealWidth));
+    if (lowWidth % 2 == 0) {
+        lowWidth--;
+    }
+    int highWidth = lowWidth + 2;
+
+    // Number of passes that use the lower width
+    double idealLow = (12.0 * sigma * sigma - passes * lowWidth * lowWidth - 4.0 * passes * lowWidth - 3.0 * passes) /
+        (-4.0 * lowWidth - 4.0);
+    int lowPasses = static_cast<int>(std::round(idealLow));
+
+    cv::Mat* current = &src;
+    for (int i = 0; i < passes; ++i) {
+        int width = i < lowPasses ? lowWidth : highWidth;
+        if (boxBlur(*current, dst, (width - 1) / 2) != 0) {
+            return -1;
+        }
+        current = &dst;
+    }
+
+    return 0; // Success
+}
 
-void blurQuantize(cv::Mat& src, cv::Mat& dst, int levels) {
-    // Apply a 5x5 blur using separable filters
+// Blur and quantize the image into the given number of levels per channel.
+// A blurSigma of 0 keeps the original 5x5 Gaussian, larger values use the fast box approximation.
+void blurQuantize(cv::Mat& src, cv::Mat& dst, int levels, float blurSigma) {
+    // Blur with a Gaussian of blurSigma, or OpenCV's 5x5 Gaussian when it is 0
     cv::Mat blurred;
-    cv::GaussianBlur(src, blurred, cv::Size(5, 5), 0);
+    if (blurSigma > 0.0f) {
+        fastGaussianBlur(src, blurred, blurSigma);
+    }
+    else {
+        cv::GaussianBlur(src, blurred, cv::Size(5, 5), 0);
+    }
 
     // Quantize the image
     dst = blurred.clone();
@@ -388,6 +468,128 @@ void blurQuantize(cv::Mat& src, cv::Mat& dst, int levels) {
     }
 }
 
+// Tile size of the cartoon effect. With the halo, the intermediates of one 64 x 128 tile take
+// about 90 KB, so they stay in L2 while the tile moves through all the steps.
+static const int cartoonTileRows = 64;
+static const int cartoonTileCols = 128;
+
+// Per-thread intermediates of the cartoon effect, grown once and reused by every tile
+struct CartoonScratch {
+    std::vector<uint16_t> rowsBlurred;  // horizontal blur pass, 16 x the pixel values
+    std::vector<uint8_t> blurred;       // both blur passes
+    std::vector<uint8_t> luma;          // grey version of blurred for the edge test
+};
+
+// Cartoon look: blur, quantize, find the edges of the blurred image and draw them in black.
+// The steps run tile by tile, each tile keeping its intermediates in a small per-thread buffer,
+// and the tiles run in parallel, so the frame is read and written only once.
+//
+// The blur is the 5x5 binomial [1 4 6 4 1], the colours are quantized like blurQuantize and a
+// pixel is an edge when |Sobel X| + |Sobel Y| of the blurred grey exceeds edgeThreshold. Borders
+// are replicated, so the result doesn't depend on the tiling or the number of threads.
+int cartoon(cv::Mat& src, cv::Mat& dst, int levels, int edgeThreshold) {
+    if (src.empty() || src.type() != CV_8UC3 || levels < 1) {
+        return -1; // Invalid source image or levels
+    }
+
+    dst.create(src.size(), src.type());
+
+    // The quantization of blurQuantize as a table
+    uchar quantized[256];
+    float bucketSize = 255.0f / levels;
+    for (int v = 0; v < 256; v++) {
+        quantized[v] = static_cast<uchar>(floor(v / bucketSize + 0.5) * bucketSize);
+    }
+
+    const int rows = src.rows;
+    const int cols = src.cols;
+    const int tilesAcross = (cols + cartoonTileCols - 1) / cartoonTileCols;
+    const int tilesDown = (rows + cartoonTileRows - 1) / cartoonTileRows;
+    const int binomial[5] = { 1, 4, 6, 4, 1 };
+
+    cv::parallel_for_(cv::Range(0, tilesAcross * tilesDown), [&](const cv::Range& range) {
+        static thread_local CartoonScratch scratch;
+
+        for (int tile = range.start; tile < range.end; tile++) {
+            const int y0 = (tile / tilesAcross) * cartoonTileRows;
+            const int x0 = (tile % tilesAcross) * cartoonTileCols;
+            const int y1 = std::min(y0 + cartoonTileRows, rows);
+            const int x1 = std::min(x0 + cartoonTileCols, cols);
+
+            // The Sobel filters need the blurred image one pixel around the tile, inside the frame
+            const int by0 = std::max(y0 - 1, 0), by1 = std::min(y1 + 1, rows);
+            const int bx0 = std::max(x0 - 1, 0), bx1 = std::min(x1 + 1, cols);
+            const int bw = bx1 - bx0, bh = by1 - by0;
+
+            // Horizontal blur pass over the source rows of the vertical pass, two more on each side
+            scratch.rowsBlurred.resize((size_t)(bh + 4) * bw * 3);
+            for (int r = 0; r < bh + 4; r++) {
+                const uchar* sptr = src.ptr<uchar>(std::min(std::max(by0 + r - 2, 0), rows - 1));
+                uint16_t* hptr = &scratch.rowsBlurred[(size_t)r * bw * 3];
+
+                // Columns two pixels away from the frame edges need no clamping
+                const int inner0 = std::min(std::max(bx0, 2), bx1), inner1 = std::max(std::min(bx1, cols - 2), inner0);
+                for (int i = inner0 * 3; i < inner1 * 3; i++) {
+                    hptr[i - bx0 * 3] = static_cast<uint16_t>(sptr[i - 6] + 4 * sptr[i - 3] + 6 * sptr[i] + 4 * sptr[i + 3] + sptr[i + 6]);
+                }
+                auto clampedColumn = [&](int x) {
+                    for (int c = 0; c < 3; c++) {
+                        int sum = 0;
+                        for (int k = -2; k <= 2; k++) {
+                            sum += binomial[k + 2] * sptr[std::min(std::max(x + k, 0), cols - 1) * 3 + c];
+                        }
+                        hptr[(x - bx0) * 3 + c] = static_cast<uint16_t>(sum);
+                    }
+                };
+                for (int x = bx0; x < inner0; x++) {
+                    clampedColumn(x);
+                }
+                for (int x = inner1; x < bx1; x++) {
+                    clampedColumn(x);
+                }
+            }
+
+            // Vertical blur pass, rounded back to 8 bits, and the grey of each blurred pixel
+            scratch.blurred.resize((size_t)bh * bw * 3);
+            scratch.luma.resize((size_t)bh * bw);
+            for (int r = 0; r < bh; r++) {
+                uint8_t* bptr = &scratch.blurred[(size_t)r * bw * 3];
+                for (int i = 0; i < bw * 3; i++) {
+                    int sum = 0;
+                    for (int k = 0; k < 5; k++) {
+                        sum += binomial[k] * scratch.rowsBlurred[(size_t)(r + k) * bw * 3 + i];
+                    }
+                    bptr[i] = static_cast<uint8_t>((sum + 128) >> 8);
+                }
+                uint8_t* lptr = &scratch.luma[(size_t)r * bw];
+                for (int x = 0; x < bw; x++) {
+                    lptr[x] = static_cast<uint8_t>((29 * bptr[x * 3] + 150 * bptr[x * 3 + 1] + 77 * bptr[x * 3 + 2] + 128) >> 8);
+                }
+            }
+
+            // Quantize the tile and black out the edges
+            for (int y = y0; y < y1; y++) {
+                const uint8_t* up = &scratch.luma[(size_t)(std::max(y - 1, 0) - by0) * bw];
+                const uint8_t* mid = &scratch.luma[(size_t)(y - by0) * bw];
+                const uint8_t* down = &scratch.luma[(size_t)(std::min(y + 1, rows - 1) - by0) * bw];
+                const uint8_t* bptr = &scratch.blurred[(size_t)(y - by0) * bw * 3];
+                uchar* dptr = dst.ptr<uchar>(y);
+                for (int x = x0; x < x1; x++) {
+                    int l = std::max(x - 1, 0) - bx0, m = x - bx0, r = std::min(x + 1, cols - 1) - bx0;
+                    int gx = (up[r] + 2 * mid[r] + down[r]) - (up[l] + 2 * mid[l] + down[l]);
+                    int gy = (down[l] + 2 * down[m] + down[r]) - (up[l] + 2 * up[m] + up[r]);
+                    bool edge = std::abs(gx) + std::abs(gy) > edgeThreshold;
+                    for (int c = 0; c < 3; c++) {
+                        dptr[x * 3 + c] = edge ? 0 : quantized[bptr[m * 3 + c]];
+                    }
+                }
+            }
+        }
+    });
+
+    return 0; // Success
+}
+
 int embossingEffect(cv::Mat& src, cv::Mat& dst) {
     // Create temporary matrices for Sobel X and Sobel Y results
     cv::Mat sobelX, sobelY;
@@ -398,11 +600,16 @@ int embossingEffect(cv::Mat& src, cv::Mat& dst) {
     // Apply SobelY filter
     sobelY3x3(src, sobelY);
 
+    return embossingFromGradients(sobelX, sobelY, dst);
+}
+
+// Embossing from Sobel results computed elsewhere, e.g. shared through the derived image cache
+int embossingFromGradients(const cv::Mat& sobelX, const cv::Mat& sobelY, cv::Mat& dst) {
     // Combine SobelX and SobelY results for embossing effect
-    dst = cv::Mat::zeros(src.size(), CV_16SC3); // Initialize destination matrix
+    dst.create(sobelX.size(), CV_16SC3); // Initialize destination matrix
 
-    for (int i = 0; i < src.rows; i++) {
-        for (int j = 0; j < src.cols; j++) {
+    for (int i = 0; i < sobelX.rows; i++) {
+        for (int j = 0; j < sobelX.cols; j++) {
             for (int c = 0; c < 3; c++) {
                 // Combine SobelX and SobelY results
                 int embossValue = std::abs(sobelX.at<cv::Vec3s>(i, j)[c]) + std::abs(sobelY.at<cv::Vec3s>(i, j)[c]);
@@ -426,26 +633,13 @@ int pickStrongColor(cv::Mat& src, cv::Mat& dst, uchar threshold) {
 
     dst.create(src.size(), src.type());
 
-    // Iterate over each pixel in the image
-    for (int y = 0; y < src.rows; ++y) {
-        for (int x = 0; x < src.cols; ++x) {
-            cv::Vec3b pixel = src.at<cv::Vec3b>(y, x);
-
-            // Calculate the intensity (brightness) of the pixel
-            uchar intensity = static_cast<uchar>((pixel[0] + pixel[1] + pixel[2]) / 3);
-
-            // Check if intensity is greater than the threshold
-            if (intensity > threshold) {
-                // Keep the original color for strong pixels
-                dst.at<cv::Vec3b>(y, x) = pixel;
-            }
-            else {
-                // Convert everything else to greyscale
-                uchar grey_value = intensity;
-                dst.at<cv::Vec3b>(y, x) = cv::Vec3b(grey_value, grey_value, grey_value);
-            }
+    // Keep the colour of pixels brighter than the threshold, turn the rest grey
+    const FilterKernels& kernels = filterKernels();
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            kernels.strongColorRow(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols, threshold);
         }
-    }
+    });
 
     return 0; // Success
 }
\ No newline at end of file
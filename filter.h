@@ -18,9 +18,14 @@ int sobelY3x3(cv::Mat& src, cv::Mat& dst);
 
 int gradientMagnitudeEuclidean(cv::Mat& sx, cv::Mat& sy, cv::Mat& dst);
 
-void blurQuantize(cv::Mat& src, cv::Mat& dst, int levels);
+int boxBlur(cv::Mat& src, cv::Mat& dst, int radius);
+int fastGaussianBlur(cv::Mat& src, cv::Mat& dst, float sigma, int passes = 3);
+
+void blurQuantize(cv::Mat& src, cv::Mat& dst, int levels, float blurSigma = 0.0f);
+int cartoon(cv::Mat& src, cv::Mat& dst, int levels = 10, int edgeThreshold = 96);
 
 int embossingEffect(cv::Mat& src, cv::Mat& dst);
+int embossingFromGradients(const cv::Mat& sobelX, const cv::Mat& sobelY, cv::Mat& dst);
 
 int drawHearts(cv::Mat& frame, std::vector<cv::Rect>& faces, int minWidth, float scale);
 
@@ -0,0 +1,87 @@
+// File: filterKernels.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 14, 2024
+// Runtime selection of the filter kernel variant matching the CPU
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include "filterKernels.h"
+
+// Tables defined by the per-ISA builds of filterKernelsImpl.cpp. The build defines
+// VFX_HAVE_KERNELS_<ISA> for every variant it compiled, baseline is always there.
+const FilterKernels* filterKernelsTable_baseline();
+#ifdef VFX_HAVE_KERNELS_SSE42
+const FilterKernels* filterKernelsTable_sse42();
+#endif
+#ifdef VFX_HAVE_KERNELS_AVX2
+const FilterKernels* filterKernelsTable_avx2();
+#endif
+#ifdef VFX_HAVE_KERNELS_AVX512
+const FilterKernels* filterKernelsTable_avx512();
+#endif
+
+std::vector<const FilterKernels*> availableFilterKernels() {
+    std::vector<const FilterKernels*> variants;
+    variants.push_back(filterKernelsTable_baseline());
+#ifdef VFX_HAVE_KERNELS_SSE42
+    if (cv::checkHardwareSupport(CV_CPU_SSE4_2)) {
+        variants.push_back(filterKernelsTable_sse42());
+    }
+#endif
+#ifdef VFX_HAVE_KERNELS_AVX2
+    if (cv::checkHardwareSupport(CV_CPU_AVX2)) {
+        variants.push_back(filterKernelsTable_avx2());
+    }
+#endif
+#ifdef VFX_HAVE_KERNELS_AVX512
+    if (cv::checkHardwareSupport(CV_CPU_AVX_512F) && cv::checkHardwareSupport(CV_CPU_AVX_512BW) &&
+        cv::checkHardwareSupport(CV_CPU_AVX_512VL)) {
+        variants.push_back(filterKernelsTable_avx512());
+    }
+#endif
+    return variants;
+}
+
+static const FilterKernels* findVariant(const char* isa) {
+    for (const FilterKernels* variant : availableFilterKernels()) {
+        if (strcmp(variant->isa, isa) == 0) {
+            return variant;
+        }
+    }
+    return NULL;
+}
+
+// Best variant, unless VFX_KERNEL_ISA names another available one
+static const FilterKernels* defaultVariant() {
+    const char* forced = getenv("VFX_KERNEL_ISA");
+    if (forced != NULL) {
+        const FilterKernels* variant = findVariant(forced);
+        if (variant != NULL) {
+            return variant;
+        }
+        fprintf(stderr, "Kernel variant %s is not available, using the best one\n", forced);
+    }
+    return availableFilterKernels().back();
+}
+
+static std::atomic<const FilterKernels*> selectedKernels(NULL);
+
+const FilterKernels& filterKernels() {
+    const FilterKernels* kernels = selectedKernels.load(std::memory_order_acquire);
+    if (kernels == NULL) {
+        kernels = defaultVariant();
+        selectedKernels.store(kernels, std::memory_order_release);
+    }
+    return *kernels;
+}
+
+bool selectFilterKernels(const char* isa) {
+    const FilterKernels* variant = findVariant(isa);
+    if (variant == NULL) {
+        return false;
+    }
+    selectedKernels.store(variant, std::memory_order_release);
+    return true;
+}
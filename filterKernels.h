@@ -0,0 +1,82 @@
+// File: filterKernels.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 14, 2024
+// Row kernels of the hot filters, compiled once per instruction set and picked at runtime.
+//
+// filterKernelsImpl.cpp is compiled several times by the build, each time with a different
+// VFX_KERNEL_ISA and matching compiler flags. filterKernels() returns the table of the best
+// variant the CPU supports, so one binary runs well on every machine of the fleet.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+struct FilterKernels {
+    const char* isa;
+
+    // sepiaTone on one row of BGR pixels
+    void (*sepiaRow)(const uint8_t* src, uint8_t* dst, int width);
+
+    // altGreyScale on one row of BGR pixels
+    void (*altGreyRow)(const uint8_t* src, uint8_t* dst, int width);
+
+    // pickStrongColor on one row of BGR pixels
+    void (*strongColorRow)(const uint8_t* src, uint8_t* dst, int width, uint8_t threshold);
+
+    // One output row of the vertical box blur pass: writes the averages of the running column
+    // sums, then slides them by adding the entering row and removing the leaving one
+    void (*boxColumnStep)(int32_t* sums, const uint8_t* addRow, const uint8_t* subRow, uint8_t* dst, int count, float inv);
+
+    // gradientMagnitudeEuclidean on count interleaved values
+    void (*magnitudeRow)(const int16_t* sx, const int16_t* sy, float* dst, int count);
+
+    // Temporal filters, see temporalFilters.h. Accumulators hold 8.8 fixed point values and
+    // weights are out of 256.
+
+    // acc = src * weight
+    void (*fixedScaleRow)(uint16_t* acc, const uint8_t* src, int count, int weight);
+
+    // acc += src * weight
+    void (*fixedAddScaledRow)(uint16_t* acc, const uint8_t* src, int count, int weight);
+
+    // dst = acc rounded back to 8 bits
+    void (*fixedToRow)(const uint16_t* acc, uint8_t* dst, int count);
+
+    // Exponential moving average: acc moves by alpha / 256 of the way to src, dst gets the result
+    void (*emaRow)(uint16_t* acc, const uint8_t* src, uint8_t* dst, int count, int alpha);
+
+    // Like emaRow, but values further than threshold from the average jump straight to src
+    void (*denoiseRow)(uint16_t* acc, const uint8_t* src, uint8_t* dst, int count, int alpha, int threshold);
+
+    // Motion highlight on one row of BGR pixels: pixels where some channel changed by more than
+    // threshold since prev are tinted red, the others are shown as dimmed grey
+    void (*motionRow)(const uint8_t* cur, const uint8_t* prev, uint8_t* dst, int width, int threshold);
+
+    // Background model, see backgroundModel.h. mean and dev are 8.8 fixed point. A value is
+    // foreground (mask 255) when it is further than 3 * dev + minThreshold from the mean; the
+    // model then learns at foregroundAlpha / 256 instead of alpha / 256.
+    void (*backgroundRow)(uint16_t* mean, uint16_t* dev, const uint8_t* luma, uint8_t* mask, int count,
+        int alpha, int foregroundAlpha, int minThreshold);
+
+    // dst = fg * alpha / 255 + bg * (255 - alpha) / 255 on one row of BGR pixels, one alpha per pixel
+    void (*blendMaskRow)(const uint8_t* fg, const uint8_t* bg, const uint8_t* alpha, uint8_t* dst, int width);
+
+    // Colour LUT, see colorLut.h: tetrahedral interpolation in the bricked lattice for one row of
+    // BGR pixels. offsets and fractions are the [3][256] per-axis tables of the ColorLut.
+    void (*lut3dRow)(const uint8_t* src, uint8_t* dst, int width, const uint16_t* bricks,
+        const int32_t* offsets, const uint16_t* fractions);
+
+    // One row of a 2x box downsample, see imagePyramid.h: each of the count output pixels is the
+    // rounded mean of the 2x2 block below it in row0 and row1. channels is 1 or 3.
+    void (*halveRow)(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int count, int channels);
+};
+
+// Kernels of the best instruction set supported by this CPU. The choice can be forced with
+// the VFX_KERNEL_ISA environment variable (baseline, sse42, avx2 or avx512).
+const FilterKernels& filterKernels();
+
+// Every variant compiled into this binary that the CPU can run, baseline first
+std::vector<const FilterKernels*> availableFilterKernels();
+
+// Force a variant by name, returns false if it isn't available. Used by tests and benchmarks.
+bool selectFilterKernels(const char* isa);
@@ -0,0 +1,291 @@
+// File: filterKernelsImpl.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 14, 2024
+// Row kernels of the hot filters. The loops are plain C++ written so the compiler vectorizes
+// them for whatever instruction set this file is compiled for; the build compiles it once per
+// VFX_KERNEL_ISA. They must give exactly the same results as the reference loops in filter.cpp.
+//
+// Everything here lives in an ISA-specific namespace and avoids inline functions from other
+// headers (std::min, std::sqrt and friends): an out-of-line copy of such a function compiled with AVX
+// flags could otherwise be picked by the linker for code running on older CPUs.
+
+#include <math.h>
+#include "filterKernels.h"
+
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#ifndef VFX_KERNEL_ISA
+#define VFX_KERNEL_ISA baseline
+#endif
+
+#define VFX_CONCAT_(a, b) a##b
+#define VFX_CONCAT(a, b) VFX_CONCAT_(a, b)
+#define VFX_STRINGIFY_(a) #a
+#define VFX_STRINGIFY(a) VFX_STRINGIFY_(a)
+
+namespace VFX_CONCAT(filterKernels_, VFX_KERNEL_ISA) {
+
+static inline double clamp255(double v) {
+    return v < 0.0 ? 0.0 : (v > 255.0 ? 255.0 : v);
+}
+
+static inline float clamp255f(float v) {
+    return v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+}
+
+static void sepiaRow(const uint8_t* src, uint8_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        double b = src[3 * x], g = src[3 * x + 1], r = src[3 * x + 2];
+        double sepiaR = 0.272 * r + 0.534 * g + 0.131 * b;
+        double sepiaG = 0.349 * r + 0.686 * g + 0.168 * b;
+        double sepiaB = 0.393 * r + 0.769 * g + 0.189 * b;
+
+        // Same channel order as sepiaTone: the red result goes into the first channel
+        dst[3 * x] = static_cast<uint8_t>(clamp255(sepiaR));
+        dst[3 * x + 1] = static_cast<uint8_t>(clamp255(sepiaG));
+        dst[3 * x + 2] = static_cast<uint8_t>(clamp255(sepiaB));
+    }
+}
+
+static void altGreyRow(const uint8_t* src, uint8_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        uint8_t grey = static_cast<uint8_t>(255 - src[3 * x + 2]);
+        dst[3 * x] = grey;
+        dst[3 * x + 1] = grey;
+        dst[3 * x + 2] = grey;
+    }
+}
+
+static void strongColorRow(const uint8_t* src, uint8_t* dst, int width, uint8_t threshold) {
+    for (int x = 0; x < width; ++x) {
+        uint8_t b = src[3 * x], g = src[3 * x + 1], r = src[3 * x + 2];
+        uint8_t intensity = static_cast<uint8_t>((b + g + r) / 3);
+        bool strong = intensity > threshold;
+        dst[3 * x] = strong ? b : intensity;
+        dst[3 * x + 1] = strong ? g : intensity;
+        dst[3 * x + 2] = strong ? r : intensity;
+    }
+}
+
+static void boxColumnStep(int32_t* sums, const uint8_t* addRow, const uint8_t* subRow, uint8_t* dst, int count, float inv) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = static_cast<uint8_t>(sums[i] * inv + 0.5f);
+        sums[i] += addRow[i] - subRow[i];
+    }
+}
+
+static void magnitudeRow(const int16_t* sx, const int16_t* sy, float* dst, int count) {
+    for (int i = 0; i < count; ++i) {
+        float x = sx[i], y = sy[i];
+        dst[i] = clamp255f(sqrtf(x * x + y * y));
+    }
+}
+
+static void fixedScaleRow(uint16_t* acc, const uint8_t* src, int count, int weight) {
+    for (int i = 0; i < count; ++i) {
+        acc[i] = static_cast<uint16_t>(src[i] * weight);
+    }
+}
+
+static void fixedAddScaledRow(uint16_t* acc, const uint8_t* src, int count, int weight) {
+    for (int i = 0; i < count; ++i) {
+        acc[i] = static_cast<uint16_t>(acc[i] + src[i] * weight);
+    }
+}
+
+static void fixedToRow(const uint16_t* acc, uint8_t* dst, int count) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = static_cast<uint8_t>((acc[i] + 128) >> 8);
+    }
+}
+
+static void emaRow(uint16_t* acc, const uint8_t* src, uint8_t* dst, int count, int alpha) {
+    for (int i = 0; i < count; ++i) {
+        int32_t a = acc[i];
+        a += (((src[i] << 8) - a) * alpha + 128) >> 8;
+        acc[i] = static_cast<uint16_t>(a);
+        dst[i] = static_cast<uint8_t>((a + 128) >> 8);
+    }
+}
+
+static void denoiseRow(uint16_t* acc, const uint8_t* src, uint8_t* dst, int count, int alpha, int threshold) {
+    for (int i = 0; i < count; ++i) {
+        int32_t a = acc[i];
+        int32_t target = src[i] << 8;
+        int32_t diff = target - a;
+        int32_t distance = diff < 0 ? -diff : diff;
+        a = distance > (threshold << 8) ? target : a + ((diff * alpha + 128) >> 8);
+        acc[i] = static_cast<uint16_t>(a);
+        dst[i] = static_cast<uint8_t>((a + 128) >> 8);
+    }
+}
+
+static void motionRow(const uint8_t* cur, const uint8_t* prev, uint8_t* dst, int width, int threshold) {
+    for (int x = 0; x < width; ++x) {
+        int b = cur[3 * x], g = cur[3 * x + 1], r = cur[3 * x + 2];
+        int db = b - prev[3 * x], dg = g - prev[3 * x + 1], dr = r - prev[3 * x + 2];
+        db = db < 0 ? -db : db;
+        dg = dg < 0 ? -dg : dg;
+        dr = dr < 0 ? -dr : dr;
+        int change = db > dg ? db : dg;
+        change = change > dr ? change : dr;
+        bool moving = change > threshold;
+        int dim = (b + g + r) / 6;
+        dst[3 * x] = static_cast<uint8_t>(moving ? b >> 1 : dim);
+        dst[3 * x + 1] = static_cast<uint8_t>(moving ? g >> 1 : dim);
+        dst[3 * x + 2] = static_cast<uint8_t>(moving ? (r >> 1) + 128 : dim);
+    }
+}
+
+static void backgroundRow(uint16_t* mean, uint16_t* dev, const uint8_t* luma, uint8_t* mask, int count,
+    int alpha, int foregroundAlpha, int minThreshold) {
+    for (int i = 0; i < count; ++i) {
+        int32_t m = mean[i], d = dev[i];
+        int32_t diff = (luma[i] << 8) - m;
+        int32_t distance = diff < 0 ? -diff : diff;
+        bool foreground = distance > 3 * d + (minThreshold << 8);
+        int32_t rate = foreground ? foregroundAlpha : alpha;
+        mean[i] = static_cast<uint16_t>(m + ((diff * rate + 128) >> 8));
+        dev[i] = static_cast<uint16_t>(d + (((distance - d) * rate + 128) >> 8));
+        mask[i] = foreground ? 255 : 0;
+    }
+}
+
+static void blendMaskRow(const uint8_t* fg, const uint8_t* bg, const uint8_t* alpha, uint8_t* dst, int width) {
+    for (int x = 0; x < width; ++x) {
+        int a = alpha[x];
+        for (int c = 0; c < 3; ++c) {
+            // Exact rounded division by 255
+            int v = fg[3 * x + c] * a + bg[3 * x + c] * (255 - a) + 128;
+            dst[3 * x + c] = static_cast<uint8_t>((v + (v >> 8)) >> 8);
+        }
+    }
+}
+
+// Point strides inside a brick of the colour LUT, 5 points per axis
+enum { LUT_STEP_B = 1, LUT_STEP_G = 5, LUT_STEP_R = 25 };
+
+// Tetrahedral interpolation in the colour LUT for one row. Each pixel blends 4 corners of its
+// cell: the first one, one step along the axis with the largest fraction, a further step along
+// the second largest, and the opposite corner.
+static void lut3dRow(const uint8_t* src, uint8_t* dst, int width, const uint16_t* bricks,
+    const int32_t* offsets, const uint16_t* fractions) {
+    for (int x = 0; x < width; ++x) {
+        int b = src[3 * x], g = src[3 * x + 1], r = src[3 * x + 2];
+        const uint16_t* c0 = bricks + 4 * (offsets[b] + offsets[256 + g] + offsets[512 + r]);
+        int fb = fractions[b], fg = fractions[256 + g], fr = fractions[512 + r];
+
+        int hi = fr > fg ? fr : fg;
+        hi = hi > fb ? hi : fb;
+        int lo = fr < fg ? fr : fg;
+        lo = lo < fb ? lo : fb;
+        int mid = fr + fg + fb - hi - lo;
+        int hiStep = fr >= fg && fr >= fb ? LUT_STEP_R : (fg >= fb ? LUT_STEP_G : LUT_STEP_B);
+        int loStep = fr < fg && fr < fb ? LUT_STEP_R : (fg < fb ? LUT_STEP_G : LUT_STEP_B);
+        const uint16_t* c1 = c0 + 4 * hiStep;
+        const uint16_t* c2 = c0 + 4 * (LUT_STEP_R + LUT_STEP_G + LUT_STEP_B - loStep);
+        const uint16_t* c3 = c0 + 4 * (LUT_STEP_R + LUT_STEP_G + LUT_STEP_B);
+        int w0 = 256 - hi, w1 = hi - mid, w2 = mid - lo, w3 = lo;
+
+#if defined(__SSE4_1__)
+        // The compilers don't vectorize across the corner lookups, but a point is one 8 byte load
+        // and pmaddwd blends two corners of all channels at once. Points are 8.7 fixed point so
+        // they fit its signed 16-bit lanes.
+        __m128i near = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(c0)),
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(c1)));
+        __m128i far = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(c2)),
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(c3)));
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(near, _mm_set1_epi32(w0 | (w1 << 16))),
+            _mm_madd_epi16(far, _mm_set1_epi32(w2 | (w3 << 16))));
+        sum = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(16384)), 15);
+        sum = _mm_packus_epi16(_mm_packus_epi32(sum, sum), sum);
+        uint32_t bgr = static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+        dst[3 * x] = static_cast<uint8_t>(bgr);
+        dst[3 * x + 1] = static_cast<uint8_t>(bgr >> 8);
+        dst[3 * x + 2] = static_cast<uint8_t>(bgr >> 16);
+#else
+        // Weights out of 256 on 8.7 values, so the sum is the result << 15
+        for (int c = 0; c < 3; ++c) {
+            int32_t v = w0 * c0[c] + w1 * c1[c] + w2 * c2[c] + w3 * c3[c];
+            dst[3 * x + c] = static_cast<uint8_t>((v + 16384) >> 15);
+        }
+#endif
+    }
+}
+
+static void halveRow(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int count, int channels) {
+    int x = 0;
+    if (channels == 1) {
+#if defined(__SSE4_1__)
+        // pmaddubsw adds the horizontal pairs of 16 pixels at once, the compilers don't find it
+        const __m128i ones = _mm_set1_epi8(1);
+        const __m128i two = _mm_set1_epi16(2);
+        for (; x + 8 <= count; x += 8) {
+            __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x));
+            __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x));
+            __m128i sum = _mm_add_epi16(_mm_maddubs_epi16(top, ones), _mm_maddubs_epi16(bottom, ones));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sum, sum));
+        }
+#endif
+        for (; x < count; ++x) {
+            dst[x] = static_cast<uint8_t>((row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2);
+        }
+        return;
+    }
+#if defined(__SSE4_1__)
+    // BGR: pshufb interleaves the channels of pixel pairs so pmaddubsw can add them. Four output
+    // pixels a step; the loads and the store run a few bytes ahead, hence the margin of two pixels.
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i pairs = _mm_setr_epi8(0, 3, 1, 4, 2, 5, 6, 9, 7, 10, 8, 11, -1, -1, -1, -1);
+    const __m128i compact = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1);
+    for (; x + 6 <= count; x += 4) {
+        const uint8_t* a = row0 + 6 * x;
+        const uint8_t* b = row1 + 6 * x;
+        __m128i left = _mm_add_epi16(
+            _mm_maddubs_epi16(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)), pairs), ones),
+            _mm_maddubs_epi16(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)), pairs), ones));
+        __m128i right = _mm_add_epi16(
+            _mm_maddubs_epi16(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 12)), pairs), ones),
+            _mm_maddubs_epi16(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 12)), pairs), ones));
+        left = _mm_srli_epi16(_mm_add_epi16(left, two), 2);
+        right = _mm_srli_epi16(_mm_add_epi16(right, two), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * x), _mm_shuffle_epi8(_mm_packus_epi16(left, right), compact));
+    }
+#endif
+    for (; x < count; ++x) {
+        const uint8_t* a = row0 + 6 * x;
+        const uint8_t* b = row1 + 6 * x;
+        dst[3 * x] = static_cast<uint8_t>((a[0] + a[3] + b[0] + b[3] + 2) >> 2);
+        dst[3 * x + 1] = static_cast<uint8_t>((a[1] + a[4] + b[1] + b[4] + 2) >> 2);
+        dst[3 * x + 2] = static_cast<uint8_t>((a[2] + a[5] + b[2] + b[5] + 2) >> 2);
+    }
+}
+
+static const FilterKernels table = {
+    VFX_STRINGIFY(VFX_KERNEL_ISA),
+    sepiaRow,
+    altGreyRow,
+    strongColorRow,
+    boxColumnStep,
+    magnitudeRow,
+    fixedScaleRow,
+    fixedAddScaledRow,
+    fixedToRow,
+    emaRow,
+    denoiseRow,
+    motionRow,
+    backgroundRow,
+    blendMaskRow,
+    lut3dRow,
+    halveRow,
+};
+
+}  // namespace
+
+const FilterKernels* VFX_CONCAT(filterKernelsTable_, VFX_KERNEL_ISA)() {
+    return &VFX_CONCAT(filterKernels_, VFX_KERNEL_ISA)::table;
+}
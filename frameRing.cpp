@@ -0,0 +1,334 @@
+// File: frameRing.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 21, 2024
+// Writer and reader of the shared memory frame ring described in frameRing.h
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "frameRing.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char frameRingMagic[8] = { 'V', 'F', 'X', 'R', 'I', 'N', 'G', '1' };
+
+// The header lives in memory shared between processes, which only works for address-free atomics
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free,
+    "the frame ring needs lock-free 64-bit atomics");
+
+// steady_clock is CLOCK_MONOTONIC on Linux, the same clock in every process
+int64_t frameRingClockNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Round a byte count up to the next multiple of the slot alignment
+static uint64_t alignUp(uint64_t bytes) {
+    return (bytes + FRAME_RING_ALIGNMENT - 1) / FRAME_RING_ALIGNMENT * FRAME_RING_ALIGNMENT;
+}
+
+// POSIX shared memory names start with a single slash
+static std::string shmPath(const std::string& name) {
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+FrameRingWriter::FrameRingWriter() : header(NULL), mappedBytes(0), pending(0), framesRejected(0) {
+}
+
+FrameRingWriter::~FrameRingWriter() {
+    close();
+}
+
+cv::Mat FrameRingWriter::beginFrame(cv::Size size, int type) {
+    if (header == NULL || size.width <= 0 || size.height <= 0) {
+        return cv::Mat();
+    }
+    size_t step = (size_t)size.width * CV_ELEM_SIZE(type);
+    if (step * size.height > header->slotBytes) {
+        framesRejected++;
+        return cv::Mat();
+    }
+
+    // Clear the sequence before touching the pixels, so readers of the old frame notice
+    pending = header->published.load(std::memory_order_relaxed) + 1;
+    FrameRingSlot& slot = header->slots[(pending - 1) % header->slotCount];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.width.store(size.width, std::memory_order_relaxed);
+    slot.height.store(size.height, std::memory_order_relaxed);
+    slot.type.store(type, std::memory_order_relaxed);
+    slot.step.store(step, std::memory_order_relaxed);
+    uchar* data = reinterpret_cast<uchar*>(header) + header->dataOffset + (pending - 1) % header->slotCount * header->slotStride;
+    return cv::Mat(size, type, data, step);
+}
+
+uint64_t FrameRingWriter::commitFrame(uint64_t frameIndex, int64_t captureNs) {
+    if (header == NULL || pending == 0) {
+        return 0;
+    }
+    FrameRingSlot& slot = header->slots[(pending - 1) % header->slotCount];
+    slot.frameIndex.store(frameIndex, std::memory_order_relaxed);
+    slot.captureNs.store(captureNs, std::memory_order_relaxed);
+    slot.publishNs.store(frameRingClockNs(), std::memory_order_relaxed);
+    slot.sequence.store(pending, std::memory_order_release);
+    header->published.store(pending, std::memory_order_release);
+
+    uint64_t sequence = pending;
+    pending = 0;
+    return sequence;
+}
+
+bool FrameRingWriter::publish(const cv::Mat& frame, uint64_t frameIndex, int64_t captureNs) {
+    cv::Mat slot = beginFrame(frame.size(), frame.type());
+    if (slot.empty()) {
+        return false;
+    }
+    frame.copyTo(slot);
+    commitFrame(frameIndex, captureNs);
+    return true;
+}
+
+FrameRingReader::FrameRingReader() : header(NULL), mappedBytes(0), lastSequence(0), framesDropped(0) {
+}
+
+FrameRingReader::~FrameRingReader() {
+    close();
+}
+
+bool FrameRingReader::writerClosed() const {
+    return header == NULL || header->state.load(std::memory_order_acquire) == FRAME_RING_CLOSED;
+}
+
+// Copy the metadata of frame sequence and check it wasn't replaced meanwhile, seqlock style.
+// Metadata that doesn't describe an image inside the slot, from a corrupt or foreign ring, is
+// refused as well.
+bool FrameRingReader::read(uint64_t sequence, FrameRingView& view) {
+    const FrameRingSlot& slot = header->slots[(sequence - 1) % header->slotCount];
+    if (slot.sequence.load(std::memory_order_acquire) != sequence) {
+        return false;
+    }
+    int64_t width = slot.width.load(std::memory_order_relaxed);
+    int64_t height = slot.height.load(std::memory_order_relaxed);
+    int64_t type = slot.type.load(std::memory_order_relaxed);
+    uint64_t step = slot.step.load(std::memory_order_relaxed);
+    view.frameIndex = slot.frameIndex.load(std::memory_order_relaxed);
+    view.captureNs = slot.captureNs.load(std::memory_order_relaxed);
+    view.publishNs = slot.publishNs.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+        return false;
+    }
+    if (width <= 0 || height <= 0 || width > INT_MAX || height > INT_MAX || type < 0 || type != CV_MAT_TYPE(type) ||
+        step < (uint64_t)width * CV_ELEM_SIZE(type) || step > header->slotBytes / (uint64_t)height) {
+        return false;
+    }
+
+    // The mapping is read only, cv::Mat just has no const views
+    uchar* data = const_cast<uchar*>(reinterpret_cast<const uchar*>(header)) + header->dataOffset + (sequence - 1) % header->slotCount * header->slotStride;
+    view.image = cv::Mat((int)height, (int)width, (int)type, data, (size_t)step);
+    view.sequence = sequence;
+    return true;
+}
+
+bool FrameRingReader::next(FrameRingView& view) {
+    if (header == NULL) {
+        return false;
+    }
+    for (;;) {
+        uint64_t newest = header->published.load(std::memory_order_acquire);
+        if (newest <= lastSequence) {
+            return false;
+        }
+
+        // The slot after the newest may be being rewritten right now, the one after that is the oldest safe
+        uint64_t wanted = lastSequence + 1;
+        uint64_t oldest = newest + 2 > header->slotCount ? newest + 2 - header->slotCount : 1;
+        if (wanted < oldest) {
+            wanted = oldest;
+        }
+        if (read(wanted, view)) {
+            framesDropped += wanted - lastSequence - 1;
+            lastSequence = wanted;
+            return true;
+        }
+
+        // A slot still holding the frame was refused and is skipped, otherwise the writer
+        // lapped this reader between the two loads: look again from the new newest frame
+        if (slotHolds(wanted)) {
+            framesDropped += wanted - lastSequence;
+            lastSequence = wanted;
+        }
+    }
+}
+
+bool FrameRingReader::latest(FrameRingView& view) {
+    if (header == NULL) {
+        return false;
+    }
+    for (;;) {
+        uint64_t newest = header->published.load(std::memory_order_acquire);
+        if (newest <= lastSequence) {
+            return false;
+        }
+        if (read(newest, view)) {
+            framesDropped += newest - lastSequence - 1;
+            lastSequence = newest;
+            return true;
+        }
+        if (slotHolds(newest)) {
+            framesDropped += newest - lastSequence;
+            lastSequence = newest;
+        }
+    }
+}
+
+bool FrameRingReader::waitNext(FrameRingView& view, int timeoutMs) {
+    int64_t deadline = frameRingClockNs() + (int64_t)timeoutMs * 1000000;
+    while (!next(view)) {
+        if (writerClosed() || frameRingClockNs() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+bool FrameRingReader::stillValid(const FrameRingView& view) const {
+    if (header == NULL || view.sequence == 0) {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slotHolds(view.sequence);
+}
+
+bool FrameRingReader::slotHolds(uint64_t sequence) const {
+    return header->slots[(sequence - 1) % header->slotCount].sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+#ifdef _WIN32
+
+bool FrameRingWriter::create(const std::string& name, int slotCount, size_t slotBytes) {
+    printf("Shared memory frame rings are not supported on this platform (%s)\n", name.c_str());
+    return false;
+}
+
+void FrameRingWriter::close() {
+}
+
+bool FrameRingReader::open(const std::string& name) {
+    return false;
+}
+
+void FrameRingReader::close() {
+}
+
+#else
+
+bool FrameRingWriter::create(const std::string& name, int slotCount, size_t slotBytes) {
+    close();
+    std::string path = shmPath(name);
+    if (path.size() < 2 || slotCount < 2 || slotCount > FRAME_RING_MAX_SLOTS || slotBytes == 0) {
+        return false;
+    }
+
+    // A ring left by a writer that crashed is replaced. Its readers keep the old mapping and
+    // simply see no new frames.
+    shm_unlink(path.c_str());
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    uint64_t dataOffset = alignUp(sizeof(FrameRingHeader));
+    uint64_t slotStride = alignUp(slotBytes);
+    size_t bytes = (size_t)(dataOffset + slotStride * slotCount);
+    void* mapped = MAP_FAILED;
+    if (ftruncate(fd, (off_t)bytes) == 0) {
+        mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        shm_unlink(path.c_str());
+        return false;
+    }
+
+    // The new object is zero filled, which is also the initial value of every atomic in it
+    header = static_cast<FrameRingHeader*>(mapped);
+    mappedBytes = bytes;
+    shmName = path;
+    memcpy(header->magic, frameRingMagic, sizeof(frameRingMagic));
+    header->headerSize = sizeof(FrameRingHeader);
+    header->slotCount = slotCount;
+    header->slotBytes = slotBytes;
+    header->slotStride = slotStride;
+    header->dataOffset = dataOffset;
+    header->state.store(FRAME_RING_LIVE, std::memory_order_release);
+    pending = 0;
+    framesRejected = 0;
+    return true;
+}
+
+void FrameRingWriter::close() {
+    if (header == NULL) {
+        return;
+    }
+    header->state.store(FRAME_RING_CLOSED, std::memory_order_release);
+    munmap(header, mappedBytes);
+    shm_unlink(shmName.c_str());
+    header = NULL;
+    mappedBytes = 0;
+    shmName.clear();
+    pending = 0;
+}
+
+bool FrameRingReader::open(const std::string& name) {
+    close();
+    int fd = shm_open(shmPath(name).c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void* mapped = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(FrameRingHeader)) {
+        mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    header = static_cast<const FrameRingHeader*>(mapped);
+    mappedBytes = (size_t)st.st_size;
+
+    // A writer still initializing counts as no ring, the caller can retry
+    if (header->state.load(std::memory_order_acquire) == FRAME_RING_INITIALIZING ||
+        memcmp(header->magic, frameRingMagic, sizeof(frameRingMagic)) != 0 || header->headerSize != sizeof(FrameRingHeader) ||
+        header->slotCount < 2 || header->slotCount > FRAME_RING_MAX_SLOTS || header->slotStride < header->slotBytes ||
+        header->dataOffset + header->slotStride * header->slotCount > mappedBytes) {
+        close();
+        return false;
+    }
+
+    // Start with the newest frame
+    uint64_t newest = header->published.load(std::memory_order_acquire);
+    lastSequence = newest > 0 ? newest - 1 : 0;
+    framesDropped = 0;
+    return true;
+}
+
+void FrameRingReader::close() {
+    if (header != NULL) {
+        munmap(const_cast<FrameRingHeader*>(header), mappedBytes);
+    }
+    header = NULL;
+    mappedBytes = 0;
+    lastSequence = 0;
+    framesDropped = 0;
+}
+
+#endif
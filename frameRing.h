@@ -0,0 +1,145 @@
+// File: frameRing.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 21, 2024
+// Shared memory ring of processed frames, so encoders and analytics on the same machine can take
+// the output of vidDisplay without copies or screen capture.
+//
+// Layout: one POSIX shared memory object holding the header page, then the slots, each starting
+// on a page boundary. Frame n (counting from 1) goes to slot (n - 1) % slotCount. Every slot
+// carries its own size, type, row step and timestamps, so the frames may change size or type as
+// long as they fit the slot capacity.
+//
+// The writer never waits for readers. A reader that falls behind skips to the oldest frame still
+// in the ring, and a view it holds stays intact until the writer comes round to its slot again,
+// slotCount - 1 frames later; stillValid() tells afterwards whether that happened.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define FRAME_RING_ALIGNMENT 4096
+#define FRAME_RING_MAX_SLOTS 64
+#define FRAME_RING_DEFAULT_SLOTS 4
+
+// Metadata of one slot. sequence is 0 while the writer fills the slot, then the number of the
+// frame it holds; the other fields are only meaningful while it matches.
+struct FrameRingSlot {
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> frameIndex;     // index the producer gave the frame, e.g. the capture count
+    std::atomic<int64_t> captureNs;       // frameRingClockNs() when the frame was captured
+    std::atomic<int64_t> publishNs;       // frameRingClockNs() when the frame was published
+    std::atomic<int64_t> width;
+    std::atomic<int64_t> height;
+    std::atomic<int64_t> type;            // OpenCV type, e.g. CV_8UC3
+    std::atomic<uint64_t> step;           // bytes per row
+};
+
+// The writer fills the header and only then sets state, readers check it before anything else
+enum FrameRingState {
+    FRAME_RING_INITIALIZING = 0,
+    FRAME_RING_LIVE = 1,
+    FRAME_RING_CLOSED = 2       // the writer is gone, no more frames will come
+};
+
+struct FrameRingHeader {
+    char magic[8];              // "VFXRING1"
+    uint32_t headerSize;        // sizeof(FrameRingHeader)
+    uint32_t slotCount;
+    uint64_t slotBytes;         // capacity of a slot
+    uint64_t slotStride;        // distance between slots, a multiple of FRAME_RING_ALIGNMENT
+    uint64_t dataOffset;        // offset of the first slot
+    std::atomic<uint64_t> state;
+    std::atomic<uint64_t> published;      // number of the newest complete frame, 0 before the first
+    FrameRingSlot slots[FRAME_RING_MAX_SLOTS];
+};
+
+// Clock of the timestamps: monotonic and shared by all processes of the machine
+int64_t frameRingClockNs();
+
+// Publishes frames into a ring created under a shared memory name ("/vfx" or "vfx")
+class FrameRingWriter {
+public:
+    FrameRingWriter();
+    ~FrameRingWriter();
+
+    // Create the ring with slots of slotBytes each, replacing one left behind by a writer that
+    // crashed. Returns false if the shared memory can't be created.
+    bool create(const std::string& name, int slotCount, size_t slotBytes);
+
+    // Mark the ring closed for the readers and remove its name. Readers keep their mapping.
+    void close();
+
+    // View of the next slot shaped as size and type, to render the frame straight into it. Empty
+    // if the frame doesn't fit. Readers can't see the slot until commitFrame.
+    cv::Mat beginFrame(cv::Size size, int type);
+
+    // Publish the frame begun last, returns its sequence number (0 if none was begun)
+    uint64_t commitFrame(uint64_t frameIndex, int64_t captureNs);
+
+    // Copy a frame into the next slot and publish it. Returns false if it doesn't fit.
+    bool publish(const cv::Mat& frame, uint64_t frameIndex, int64_t captureNs);
+
+    bool isOpen() const { return header != NULL; }
+    const std::string& name() const { return shmName; }
+    uint64_t published() const { return header != NULL ? header->published.load(std::memory_order_relaxed) : 0; }
+    uint64_t rejected() const { return framesRejected; }
+
+private:
+    FrameRingHeader* header;
+    size_t mappedBytes;
+    std::string shmName;
+    uint64_t pending;           // sequence of the frame begun and not committed yet
+    uint64_t framesRejected;    // frames too large for a slot
+};
+
+// Zero-copy view of a published frame
+struct FrameRingView {
+    cv::Mat image;              // points into the shared memory, read only
+    uint64_t sequence;
+    uint64_t frameIndex;
+    int64_t captureNs;
+    int64_t publishNs;
+};
+
+// Maps a ring read only and hands out views of its frames. Each reader keeps its own position,
+// so any number of them can follow the same ring at their own pace.
+class FrameRingReader {
+public:
+    FrameRingReader();
+    ~FrameRingReader();
+
+    // Returns false if the ring doesn't exist or isn't a ring written by FrameRingWriter
+    bool open(const std::string& name);
+    void close();
+
+    // The frame after the one returned last, skipping ahead if the writer lapped this reader.
+    // Returns false if there is no newer frame.
+    bool next(FrameRingView& view);
+
+    // The newest frame, returns false if it's the one returned last or there is none yet
+    bool latest(FrameRingView& view);
+
+    // next(), polling until a frame arrives, the writer closes or timeoutMs passes
+    bool waitNext(FrameRingView& view, int timeoutMs);
+
+    // True while the slot of view still holds its frame. Check it after using the pixels: if it
+    // fails, the writer was overwriting them meanwhile and the result must be thrown away.
+    bool stillValid(const FrameRingView& view) const;
+
+    bool isOpen() const { return header != NULL; }
+    bool writerClosed() const;
+
+    // Frames published while this reader was open but never returned to it
+    uint64_t dropped() const { return framesDropped; }
+
+private:
+    bool read(uint64_t sequence, FrameRingView& view);
+    bool slotHolds(uint64_t sequence) const;     // the slot of frame sequence still has it
+
+    const FrameRingHeader* header;
+    size_t mappedBytes;
+    uint64_t lastSequence;
+    uint64_t framesDropped;
+};
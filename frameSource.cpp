@@ -0,0 +1,306 @@
+// File: frameSource.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 5, 2024
+// Webcam, video file, image sequence, in-memory loop and synthetic frame sources
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "frameSource.h"
+#include "rawFrameFile.h"
+
+// Frames preloaded by a loop source, to keep its memory use bounded
+static const int maxLoopFrames = 600;
+
+// Frame source backed by cv::VideoCapture, used for webcams and video files
+class CaptureSource : public FrameSource {
+public:
+    CaptureSource(cv::VideoCapture* capture, const std::string& name, bool live) : cap(capture), name(name), live(live) {}
+    ~CaptureSource() { delete cap; }
+
+    bool read(cv::Mat& frame) override {
+        *cap >> frame;
+        return !frame.empty();
+    }
+    cv::Size frameSize() const override {
+        return cv::Size((int)cap->get(cv::CAP_PROP_FRAME_WIDTH), (int)cap->get(cv::CAP_PROP_FRAME_HEIGHT));
+    }
+    double fps() const override { return cap->get(cv::CAP_PROP_FPS); }
+    std::string describe() const override { return name; }
+    bool isLive() const override { return live; }
+
+private:
+    cv::VideoCapture* cap;
+    std::string name;
+    bool live;
+};
+
+// Frame source reading a sorted list of image files
+class ImageSequenceSource : public FrameSource {
+public:
+    ImageSequenceSource(const std::vector<cv::String>& files, const std::string& pattern)
+        : files(files), pattern(pattern), next(0) {
+        cv::Mat first = cv::imread(files[0]);
+        size = first.size();
+    }
+
+    bool read(cv::Mat& frame) override {
+        if (next >= files.size()) {
+            return false;
+        }
+        frame = cv::imread(files[next++]);
+        return !frame.empty();
+    }
+    cv::Size frameSize() const override { return size; }
+    double fps() const override { return 30.0; }
+    std::string describe() const override { return "images:" + pattern + " (" + std::to_string(files.size()) + " files)"; }
+
+private:
+    std::vector<cv::String> files;
+    std::string pattern;
+    size_t next;
+    cv::Size size;
+};
+
+// Frame source replaying frames held in memory, forever
+class MemoryLoopSource : public FrameSource {
+public:
+    MemoryLoopSource(std::vector<cv::Mat>& loopFrames, double rate, const std::string& name)
+        : rate(rate), name(name), next(0) {
+        frames.swap(loopFrames);
+    }
+
+    bool read(cv::Mat& frame) override {
+        // Copy so that effects drawing into the frame don't alter the loop
+        frames[next].copyTo(frame);
+        next = (next + 1) % frames.size();
+        return true;
+    }
+    cv::Size frameSize() const override { return frames[0].size(); }
+    double fps() const override { return rate; }
+    std::string describe() const override { return "loop:" + name + " (" + std::to_string(frames.size()) + " frames)"; }
+
+private:
+    std::vector<cv::Mat> frames;
+    double rate;
+    std::string name;
+    size_t next;
+};
+
+// Frame source generating a scrolling colour pattern with a moving box.
+// The pattern is rendered once at twice the width and each frame copies a shifted window of it,
+// so generation stays far cheaper than any of the effects.
+class SyntheticSource : public FrameSource {
+public:
+    SyntheticSource(cv::Size size, double rate) : size(size), rate(rate), frameCount(0) {
+        pattern.create(size.height, size.width * 2, CV_8UC3);
+        for (int y = 0; y < pattern.rows; ++y) {
+            cv::Vec3b* pptr = pattern.ptr<cv::Vec3b>(y);
+            for (int x = 0; x < pattern.cols; ++x) {
+                int phase = (x * 8 * 255 / pattern.cols) % 510;
+                uchar ramp = static_cast<uchar>(phase < 255 ? phase : 510 - phase);
+                pptr[x] = cv::Vec3b(ramp, static_cast<uchar>(y * 255 / std::max(1, size.height - 1)), static_cast<uchar>(255 - ramp));
+            }
+        }
+    }
+
+    bool read(cv::Mat& frame) override {
+        int offset = static_cast<int>((frameCount * 4) % size.width);
+        pattern(cv::Rect(offset, 0, size.width, size.height)).copyTo(frame);
+
+        // A bright box bouncing around gives the temporal and detection stages something to follow
+        double t = frameCount / std::max(rate, 1.0);
+        int boxSize = std::max(8, size.height / 5);
+        int bx = static_cast<int>((0.5 + 0.4 * std::sin(t * 1.3)) * (size.width - boxSize));
+        int by = static_cast<int>((0.5 + 0.4 * std::cos(t * 0.9)) * (size.height - boxSize));
+        cv::rectangle(frame, cv::Rect(bx, by, boxSize, boxSize), cv::Scalar(255, 255, 255), cv::FILLED);
+
+        frameCount++;
+        return true;
+    }
+    cv::Size frameSize() const override { return size; }
+    double fps() const override { return rate; }
+    std::string describe() const override {
+        return "synthetic:" + std::to_string(size.width) + "x" + std::to_string(size.height);
+    }
+
+private:
+    cv::Size size;
+    double rate;
+    long long frameCount;
+    cv::Mat pattern;
+};
+
+// Frame source handing out zero-copy views of a memory-mapped raw frame file
+class RawFileSource : public FrameSource {
+public:
+    RawFileSource(const std::string& path) : path(path), next(0) {}
+
+    bool open() { return reader.open(path); }
+
+    bool read(cv::Mat& frame) override {
+        if (next >= reader.frameCount()) {
+            return false;
+        }
+        frame = reader.frame(next++);
+        return true;
+    }
+    cv::Size frameSize() const override { return reader.frameSize(); }
+    double fps() const override { return reader.fps(); }
+    std::string describe() const override { return "raw:" + path + " (" + std::to_string(reader.frameCount()) + " frames)"; }
+
+private:
+    std::string path;
+    RawFrameReader reader;
+    uint64_t next;
+};
+
+// Wrapper delivering the frames of another source at its nominal frame rate
+class PacedSource : public FrameSource {
+public:
+    PacedSource(FrameSource* inner) : inner(inner), started(false) {
+        double rate = inner->fps() > 0.0 ? inner->fps() : 30.0;
+        interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate));
+    }
+    ~PacedSource() { delete inner; }
+
+    bool read(cv::Mat& frame) override {
+        auto now = std::chrono::steady_clock::now();
+        if (!started) {
+            deadline = now;
+            started = true;
+        }
+        else if (deadline > now) {
+            std::this_thread::sleep_until(deadline);
+        }
+        else if (now - deadline > interval * 4) {
+            // Fell far behind, don't try to catch up with a burst of frames
+            deadline = now;
+        }
+        deadline += interval;
+        return inner->read(frame);
+    }
+    cv::Size frameSize() const override { return inner->frameSize(); }
+    double fps() const override { return inner->fps(); }
+    std::string describe() const override { return inner->describe() + " (paced)"; }
+    bool isLive() const override { return true; }
+
+private:
+    FrameSource* inner;
+    bool started;
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+// Split "kind:rest" into its two parts, returns an empty kind when there is no known prefix
+static std::string splitSpec(const std::string& spec, std::string& rest) {
+    static const char* kinds[] = { "cam", "file", "images", "loop", "synthetic", "raw" };
+    size_t colon = spec.find(':');
+    if (colon != std::string::npos) {
+        std::string kind = spec.substr(0, colon);
+        for (const char* known : kinds) {
+            if (kind == known) {
+                rest = spec.substr(colon + 1);
+                return kind;
+            }
+        }
+    }
+    rest = spec;
+    return "";
+}
+
+FrameSource* openFrameSource(const std::string& spec, bool paced) {
+    std::string rest;
+    std::string kind = splitSpec(spec, rest);
+
+    // A bare number is a webcam index, anything else without a prefix is a video file
+    if (kind.empty()) {
+        bool numeric = !rest.empty() && std::all_of(rest.begin(), rest.end(), ::isdigit);
+        kind = numeric ? "cam" : "file";
+    }
+
+    FrameSource* source = NULL;
+    if (kind == "cam") {
+        // The index has to be a whole non-negative number, "cam:abc" is refused
+        long index = 0;
+        if (!rest.empty()) {
+            char* end = NULL;
+            errno = 0;
+            index = strtol(rest.c_str(), &end, 10);
+            if (end == rest.c_str() || *end != '\0' || errno == ERANGE || index < 0 || index > INT_MAX) {
+                printf("Invalid camera index in %s\n", spec.c_str());
+                return NULL;
+            }
+        }
+        cv::VideoCapture* cap = new cv::VideoCapture((int)index);
+        if (!cap->isOpened()) {
+            delete cap;
+            return NULL;
+        }
+        // A camera paces itself
+        return new CaptureSource(cap, "cam:" + rest, true);
+    }
+    else if (kind == "file") {
+        cv::VideoCapture* cap = new cv::VideoCapture(rest);
+        if (!cap->isOpened()) {
+            delete cap;
+            return NULL;
+        }
+        source = new CaptureSource(cap, "file:" + rest, false);
+    }
+    else if (kind == "images") {
+        std::vector<cv::String> files;
+        cv::glob(rest, files, false);
+        if (files.empty()) {
+            return NULL;
+        }
+        std::sort(files.begin(), files.end());
+        source = new ImageSequenceSource(files, rest);
+    }
+    else if (kind == "loop") {
+        FrameSource* inner = openFrameSource(rest, false);
+        if (inner == NULL) {
+            return NULL;
+        }
+        std::vector<cv::Mat> frames;
+        cv::Mat frame;
+        while ((int)frames.size() < maxLoopFrames && inner->read(frame)) {
+            frames.push_back(frame.clone());
+        }
+        double rate = inner->fps() > 0.0 ? inner->fps() : 30.0;
+        delete inner;
+        if (frames.empty()) {
+            return NULL;
+        }
+        source = new MemoryLoopSource(frames, rate, rest);
+    }
+    else if (kind == "raw") {
+        RawFileSource* raw = new RawFileSource(rest);
+        if (!raw->open()) {
+            delete raw;
+            return NULL;
+        }
+        source = raw;
+    }
+    else if (kind == "synthetic") {
+        int width = 1280, height = 720;
+        double rate = 30.0;
+        if (!rest.empty() && sscanf(rest.c_str(), "%dx%d@%lf", &width, &height, &rate) < 2) {
+            return NULL;
+        }
+        if (width <= 0 || height <= 0) {
+            return NULL;
+        }
+        source = new SyntheticSource(cv::Size(width, height), rate);
+    }
+
+    if (source != NULL && paced) {
+        source = new PacedSource(source);
+    }
+    return source;
+}
@@ -0,0 +1,39 @@
+// File: frameSource.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 5, 2024
+// Pluggable frame sources so the effect programs can run from a webcam, a file or a generator
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Interface shared by every frame source
+class FrameSource {
+public:
+    virtual ~FrameSource() {}
+
+    // Read the next frame, returns false at the end of the stream
+    virtual bool read(cv::Mat& frame) = 0;
+
+    // Size of the frames and nominal frame rate (0 when unknown)
+    virtual cv::Size frameSize() const = 0;
+    virtual double fps() const = 0;
+
+    // Short human readable description for logs
+    virtual std::string describe() const = 0;
+
+    // True when frames arrive in real time, so a slow reader misses frames rather than delaying them
+    virtual bool isLive() const { return false; }
+};
+
+// Open a frame source from a specification string:
+//   cam:N or N                  webcam N
+//   file:path or path           video file
+//   images:pattern              image sequence matched by cv::glob, e.g. images:frames/*.png
+//   loop:spec                   frames of another source preloaded into memory and looped forever
+//   synthetic:WxH@fps           moving test pattern, e.g. synthetic:1280x720@30
+//   raw:path                    memory-mapped raw frame file, see rawFrameFile.h
+// When paced is true, file and generated sources are delivered at their nominal frame rate,
+// otherwise they are delivered as fast as the caller reads them. Returns NULL on failure.
+FrameSource* openFrameSource(const std::string& spec, bool paced = true);
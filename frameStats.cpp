@@ -0,0 +1,290 @@
+// File: frameStats.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 22, 2024
+// Sampling of the frame statistics and the automatic tone controls built on them
+
+#include <algorithm>
+#include <cstring>
+#include "frameStats.h"
+#include "perfCounters.h"
+
+static void clearFrameStats(FrameStats& stats) {
+    memset(stats.histogram, 0, sizeof(stats.histogram));
+    memset(stats.tileHistogram, 0, sizeof(stats.tileHistogram));
+    for (int c = 0; c < 4; c++) {
+        stats.mean[c] = 0.0;
+    }
+    stats.samples = 0;
+    stats.frameSize = cv::Size();
+}
+
+void computeFrameStats(const cv::Mat& frame, FrameStats& stats, int step, int phaseX, int phaseY) {
+    clearFrameStats(stats);
+    stats.frameSize = frame.size();
+    if (frame.empty() || frame.type() != CV_8UC3 || step < 1) {
+        return;
+    }
+
+    // Tile column of each sampled x
+    std::vector<int> tileOf(frame.cols);
+    for (int x = 0; x < frame.cols; x++) {
+        tileOf[x] = x * STATS_TILES / frame.cols;
+    }
+
+    for (int y = phaseY % step; y < frame.rows; y += step) {
+        const uchar* row = frame.ptr<uchar>(y);
+        int (*tiles)[256] = stats.tileHistogram[y * STATS_TILES / frame.rows];
+        for (int x = phaseX % step; x < frame.cols; x += step) {
+            int b = row[3 * x], g = row[3 * x + 1], r = row[3 * x + 2];
+            // Same fixed point weights and rounding as cv::cvtColor
+            int luma = (b * 1868 + g * 9617 + r * 4899 + 8192) >> 14;
+            stats.histogram[0][b]++;
+            stats.histogram[1][g]++;
+            stats.histogram[2][r]++;
+            stats.histogram[STATS_LUMA][luma]++;
+            tiles[tileOf[x]][luma]++;
+            stats.samples++;
+        }
+    }
+
+    for (int c = 0; c < 4; c++) {
+        double sum = 0.0;
+        for (int v = 0; v < 256; v++) {
+            sum += (double)v * stats.histogram[c][v];
+        }
+        stats.mean[c] = stats.samples > 0 ? sum / stats.samples : 0.0;
+    }
+}
+
+int statsPercentile(const FrameStats& stats, int channel, double fraction) {
+    double needed = std::max(fraction * stats.samples, 1.0);
+    int count = 0;
+    for (int v = 0; v < 256; v++) {
+        count += stats.histogram[channel][v];
+        if (count >= needed) {
+            return v;
+        }
+    }
+    return 255;
+}
+
+// Equalization table of one histogram, built like cv::equalizeHist
+static void equalizeHistogram(const int* histogram, uchar* lut) {
+    int first = 0;
+    while (first < 255 && histogram[first] == 0) {
+        first++;
+    }
+    int total = 0;
+    for (int v = 0; v < 256; v++) {
+        total += histogram[v];
+    }
+    if (total == histogram[first]) {
+        // A single value: cv::equalizeHist maps it to itself
+        for (int v = 0; v < 256; v++) {
+            lut[v] = static_cast<uchar>(v);
+        }
+        return;
+    }
+
+    float scale = 255.0f / (total - histogram[first]);
+    int sum = 0;
+    for (int v = 0; v < first; v++) {
+        lut[v] = 0;
+    }
+    lut[first] = 0;
+    for (int v = first + 1; v < 256; v++) {
+        sum += histogram[v];
+        lut[v] = cv::saturate_cast<uchar>(sum * scale);
+    }
+}
+
+void equalizationLut(const FrameStats& stats, cv::Mat& lut) {
+    lut.create(1, 256, CV_8UC1);
+    equalizeHistogram(stats.histogram[STATS_LUMA], lut.ptr<uchar>(0));
+}
+
+FrameStatsEngine::FrameStatsEngine(int step) : step(std::max(step, 1)), phase(0), current(0), running(false), stopping(false) {
+    clearFrameStats(buffers[0]);
+    clearFrameStats(buffers[1]);
+    worker = std::thread(&FrameStatsEngine::workerLoop, this);
+}
+
+FrameStatsEngine::~FrameStatsEngine() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return !running; });
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void FrameStatsEngine::begin(const cv::Mat& next) {
+    if (!frame.empty()) {
+        wait();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        frame = next;
+        running = true;
+    }
+    wake.notify_one();
+}
+
+const FrameStats& FrameStatsEngine::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return !running; });
+    frame.release();
+    return buffers[current];
+}
+
+const FrameStats& FrameStatsEngine::latest() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return buffers[current];
+}
+
+void FrameStatsEngine::workerLoop() {
+    excludeThreadFromProfiling();
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return running || stopping; });
+        if (stopping) {
+            return;
+        }
+
+        // The grid moves by one pixel per frame, row by row through the step x step block
+        cv::Mat sampled = frame;
+        FrameStats& next = buffers[1 - current];
+        int phaseX = phase % step, phaseY = phase / step;
+        phase = (phase + 1) % (step * step);
+        lock.unlock();
+        computeFrameStats(sampled, next, step, phaseX, phaseY);
+        lock.lock();
+
+        current = 1 - current;
+        running = false;
+        done.notify_all();
+    }
+}
+
+void initAutoLevels(AutoLevels& levels) {
+    levels.brightness = 0.0f;
+    levels.contrast = 1.0f;
+    levels.primed = false;
+}
+
+void updateAutoLevels(AutoLevels& levels, const FrameStats& stats, float rate) {
+    if (stats.samples == 0) {
+        return;
+    }
+
+    // Stretch the 1st to 99th percentile over most of the range, but never flatten the
+    // picture or amplify noise of a nearly uniform scene more than 3 times
+    int low = statsPercentile(stats, STATS_LUMA, 0.01);
+    int high = statsPercentile(stats, STATS_LUMA, 0.99);
+    float contrast = std::min(std::max(220.0f / std::max(high - low, 1), 1.0f), 3.0f);
+
+    // Centre halfway between the middle of that range and the mean, a bright sky shouldn't
+    // turn the faces dark
+    float centre = 0.5f * (0.5f * (low + high) + static_cast<float>(stats.mean[STATS_LUMA]));
+    float brightness = 128.0f - centre * contrast;
+
+    if (!levels.primed) {
+        levels.brightness = brightness;
+        levels.contrast = contrast;
+        levels.primed = true;
+        return;
+    }
+    levels.brightness += rate * (brightness - levels.brightness);
+    levels.contrast += rate * (contrast - levels.contrast);
+}
+
+void toneLut(float brightness, float contrast, cv::Mat& lut) {
+    lut.create(1, 256, CV_8UC1);
+    uchar* table = lut.ptr<uchar>(0);
+    for (int v = 0; v < 256; v++) {
+        table[v] = cv::saturate_cast<uchar>(v * contrast + brightness);
+    }
+}
+
+int localEqualize(const cv::Mat& src, cv::Mat& dst, const FrameStats& stats, float clipLimit) {
+    if (src.empty() || src.type() != CV_8UC3 || stats.samples == 0 || stats.frameSize != src.size()) {
+        return -1; // Invalid source image or statistics of another frame size
+    }
+
+    // Clipped, equalized table of every tile. The excess over the clip limit is spread over all
+    // bins, which limits how much noise a flat tile can be amplified.
+    static thread_local std::vector<uchar> luts;
+    luts.resize(STATS_TILES * STATS_TILES * 256);
+    for (int t = 0; t < STATS_TILES * STATS_TILES; t++) {
+        const int* histogram = stats.tileHistogram[t / STATS_TILES][t % STATS_TILES];
+        int total = 0;
+        for (int v = 0; v < 256; v++) {
+            total += histogram[v];
+        }
+        uchar* lut = &luts[t * 256];
+        if (total == 0) {
+            for (int v = 0; v < 256; v++) {
+                lut[v] = static_cast<uchar>(v);
+            }
+            continue;
+        }
+        int limit = std::max(static_cast<int>(clipLimit * total / 256), 1);
+        int excess = 0;
+        for (int v = 0; v < 256; v++) {
+            excess += std::max(histogram[v] - limit, 0);
+        }
+        int spread = excess / 256, remainder = excess % 256;
+        float scale = 255.0f / total;
+        int sum = 0;
+        for (int v = 0; v < 256; v++) {
+            // The remainder goes evenly over the range too, one count per 256 / remainder bins
+            sum += std::min(histogram[v], limit) + spread + ((v + 1) * remainder / 256 - v * remainder / 256);
+            lut[v] = cv::saturate_cast<uchar>(sum * scale);
+        }
+    }
+
+    dst.create(src.size(), src.type());
+    const int rows = src.rows, cols = src.cols;
+
+    // Tile centres are at (i + 0.5) * size / STATS_TILES, weights are out of 256
+    std::vector<int> leftTile(cols), rightWeight(cols);
+    for (int x = 0; x < cols; x++) {
+        float position = (x + 0.5f) * STATS_TILES / cols - 0.5f;
+        int tile = static_cast<int>(std::floor(position));
+        rightWeight[x] = static_cast<int>((position - tile) * 256.0f + 0.5f);
+        leftTile[x] = tile;
+    }
+
+    // luts is thread_local, so the workers below would see their own empty copy: they get the
+    // tables of this thread through a pointer
+    const uchar* tables = luts.data();
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            float position = (y + 0.5f) * STATS_TILES / rows - 0.5f;
+            int tileY = static_cast<int>(std::floor(position));
+            int wy = static_cast<int>((position - tileY) * 256.0f + 0.5f);
+            const uchar* upper = &tables[std::min(std::max(tileY, 0), STATS_TILES - 1) * STATS_TILES * 256];
+            const uchar* lower = &tables[std::min(std::max(tileY + 1, 0), STATS_TILES - 1) * STATS_TILES * 256];
+
+            const uchar* sptr = src.ptr<uchar>(y);
+            uchar* dptr = dst.ptr<uchar>(y);
+            for (int x = 0; x < cols; x++) {
+                int b = sptr[3 * x], g = sptr[3 * x + 1], r = sptr[3 * x + 2];
+                int luma = (b * 1868 + g * 9617 + r * 4899 + 8192) >> 14;
+                int left = std::min(std::max(leftTile[x], 0), STATS_TILES - 1) * 256 + luma;
+                int right = std::min(std::max(leftTile[x] + 1, 0), STATS_TILES - 1) * 256 + luma;
+                int wx = rightWeight[x];
+                int top = upper[left] * (256 - wx) + upper[right] * wx;
+                int bottom = lower[left] * (256 - wx) + lower[right] * wx;
+                int equalized = (top * (256 - wy) + bottom * wy + 32768) >> 16;
+                int delta = equalized - luma;
+                dptr[3 * x] = cv::saturate_cast<uchar>(b + delta);
+                dptr[3 * x + 1] = cv::saturate_cast<uchar>(g + delta);
+                dptr[3 * x + 2] = cv::saturate_cast<uchar>(r + delta);
+            }
+        }
+    });
+
+    return 0; // Success
+}
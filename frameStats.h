@@ -0,0 +1,94 @@
+// File: frameStats.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 22, 2024
+// Frame statistics: per-channel and luma histograms, means and percentiles, plus luma histograms
+// of a grid of tiles, all from a subsampled grid of pixels. The grid shifts by one pixel every
+// frame, so over step^2 frames every pixel gets sampled. FrameStatsEngine runs the sampling on
+// a worker thread while the effect of the frame runs.
+//
+// The statistics drive the automatic brightness and contrast, the tile-based (CLAHE-style) local
+// equalization, and the histogram equalization of face detection.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define STATS_TILES 8           // tiles per axis of the local histograms
+#define STATS_LUMA 3            // histogram index of the luma, after B, G and R
+
+struct FrameStats {
+    int histogram[4][256];                              // B, G, R and luma of the sampled pixels
+    int tileHistogram[STATS_TILES][STATS_TILES][256];   // luma per tile, [row][column]
+    double mean[4];
+    int samples;                                        // 0 until something was measured
+    cv::Size frameSize;
+};
+
+// Sample every step-th pixel of every step-th row of a BGR frame, starting at (phaseX, phaseY).
+// Luma is rounded like cv::cvtColor.
+void computeFrameStats(const cv::Mat& frame, FrameStats& stats, int step = 4, int phaseX = 0, int phaseY = 0);
+
+// Smallest value with at least fraction of the samples at or below it
+int statsPercentile(const FrameStats& stats, int channel, double fraction);
+
+// The table cv::equalizeHist builds from a histogram, here from the sampled luma
+void equalizationLut(const FrameStats& stats, cv::Mat& lut);
+
+// Computes the statistics of a frame on a worker thread
+class FrameStatsEngine {
+public:
+    explicit FrameStatsEngine(int step = 4);
+    ~FrameStatsEngine();
+
+    // Start sampling frame, whose pixels must stay unchanged until wait() returns
+    void begin(const cv::Mat& frame);
+
+    // Statistics of the frame given to begin, waiting for them if needed
+    const FrameStats& wait();
+
+    // Statistics of the last finished frame, samples is 0 if there is none. The frames are
+    // sampled into two alternating buffers, so the result stays valid until the second begin()
+    // after it was returned.
+    const FrameStats& latest();
+
+    // True between begin() and wait()
+    bool pending() const { return !frame.empty(); }
+
+private:
+    void workerLoop();
+
+    int step;
+    int phase;
+    FrameStats buffers[2];
+    int current;            // buffer of the last finished frame
+    cv::Mat frame;          // header of the frame being sampled, sharing its pixels
+    bool running;           // the worker is sampling frame
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::thread worker;
+};
+
+// Automatic brightness and contrast: the luma between the 1st and 99th percentiles is stretched
+// and the frame is centred around mid grey. The values follow the statistics smoothly, so a
+// change of scene doesn't make the picture jump.
+struct AutoLevels {
+    float brightness;
+    float contrast;
+    bool primed;            // false until the first statistics arrived
+};
+
+void initAutoLevels(AutoLevels& levels);
+void updateAutoLevels(AutoLevels& levels, const FrameStats& stats, float rate = 0.1f);
+
+// 256 entry table of v * contrast + brightness, saturated, for cv::LUT
+void toneLut(float brightness, float contrast, cv::Mat& lut);
+
+// Local equalization from the tile histograms: each tile's histogram is clipped at clipLimit
+// times the average bin count and equalized, and every pixel's luma goes through the tables of
+// the four nearest tiles, blended bilinearly. The luma change is added to all channels.
+// stats must come from a frame of the same size.
+int localEqualize(const cv::Mat& src, cv::Mat& dst, const FrameStats& stats, float clipLimit = 3.0f);
@@ -3,19 +3,43 @@
 // Date: January 26, 2024
 // Purpose: This program captures video from a webcam, applies a green screen effect,
 //          and allows the user to toggle the green screen on/off using the 'g' key.
+//          'b' replaces the background without a green screen using a learned background
+//          model, 'r' learns the background again.
 
 #include <opencv2/opencv.hpp>
+#include "frameSource.h"
+#include "backgroundModel.h"
+#include "filter.h"
+#include "derivedImages.h"
 
 
 // Summary: Entry point of the program.
 //          Captures video from the default webcam, applies a green screen effect,
 //          and allows the user to toggle the green screen on/off using the 'g' key.
-int main() {
+// Usage:   greenScreen [source] [--unpaced] [--background image], source as in frameSource.h (default: cam:0)
+//          Without --background the learned background mode shows a blurred copy of the scene.
+int main(int argc, char* argv[]) {
+    // Parse the command line
+    std::string sourceSpec = "cam:0";
+    std::string backgroundPath;
+    bool paced = true;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--unpaced") {
+            paced = false;
+        }
+        else if (std::string(argv[i]) == "--background" && i + 1 < argc) {
+            backgroundPath = argv[++i];
+        }
+        else {
+            sourceSpec = argv[i];
+        }
+    }
+
     // Initialize video capture
-    cv::VideoCapture cap(0); // 0 for default webcam
+    FrameSource* cap = openFrameSource(sourceSpec, paced);
 
     // Check if the video capture is successful
-    if (!cap.isOpened()) {
+    if (cap == NULL) {
         std::cerr << "Error opening video stream or file" << std::endl;
         return -1;
     }
@@ -27,25 +51,56 @@ int main() {
     // Flag to indicate whether green screen is active
     bool greenScreenActive = false;
 
+    // Background replacement without a green screen
+    bool backgroundModelActive = false;
+    BackgroundModel backgroundModel;
+    initBackgroundModel(backgroundModel);
+    cv::Mat replacementImage, replacement, smallBlurred, mask, replaced;
+    DerivedImages derived;
+    initDerivedImages(derived);
+    if (!backgroundPath.empty()) {
+        replacementImage = cv::imread(backgroundPath);
+        if (replacementImage.empty()) {
+            std::cerr << "Unable to read background image " << backgroundPath << std::endl;
+        }
+    }
+
     // Main loop
     while (true) {
         // Capture frame from video stream
         cv::Mat frame;
-        cap.read(frame);
 
         // Check if the frame is empty 
-        if (frame.empty()) {
+        if (!cap->read(frame)) {
             std::cerr << "End of video stream" << std::endl;
             break;
         }
+        beginDerivedFrame(derived, frame);
+
+        if (backgroundModelActive) {
+            if (segmentForeground(backgroundModel, frame, mask)) {
+                // The replacement is the background image, or the scene blurred at the model's scale
+                if (!replacementImage.empty()) {
+                    if (replacement.size() != frame.size()) {
+                        cv::resize(replacementImage, replacement, frame.size(), 0, 0, cv::INTER_AREA);
+                    }
+                }
+                else {
+                    fastGaussianBlur(backgroundModel.small, smallBlurred, 6.0f);
+                    cv::resize(smallBlurred, replacement, frame.size(), 0, 0, cv::INTER_LINEAR);
+                }
+                replaceBackground(frame, replacement, mask, replaced);
+                cv::imshow("Green Screen", replaced);
+            }
+            else {
+                cv::imshow("Green Screen", frame);
+            }
+        }
+        else if (greenScreenActive) {
+            // HSV version of the frame, its buffer is kept from frame to frame
+            const cv::Mat& hsv_frame = derivedImage(derived, DERIVED_HSV);
 
-        // Convert frame to HSV color space
-        cv::Mat hsv_frame;
-        cv::cvtColor(frame, hsv_frame, cv::COLOR_BGR2HSV);
-
-        // Create a mask using the green screen range if green screen is active
-        cv::Mat mask;
-        if (greenScreenActive) {
+            // Create a mask using the green screen range
             cv::inRange(hsv_frame, lower_green, upper_green, mask);
 
             // Invert the mask
@@ -71,6 +126,21 @@ int main() {
             greenScreenActive = !greenScreenActive;
         }
 
+        // Toggle the learned background on 'b', learning starts over each time it is enabled
+        else if (key == 'b') {
+            backgroundModelActive = !backgroundModelActive;
+            if (backgroundModelActive) {
+                resetBackgroundModel(backgroundModel);
+                printf("Learning the background, please step out of the picture\n");
+            }
+        }
+
+        // Learn the background again on 'r'
+        else if (key == 'r') {
+            resetBackgroundModel(backgroundModel);
+            printf("Learning the background, please step out of the picture\n");
+        }
+
         // Exit the loop when the 'q' key is pressed
         if (key == 'q') {
             break;
@@ -78,7 +148,7 @@ int main() {
     }
 
     // Release resources
-    cap.release();
+    delete cap;
     cv::destroyAllWindows();
 
     return 0;
@@ -0,0 +1,121 @@
+// File: imagePyramid.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 27, 2024
+// Lazily built box pyramid, see imagePyramid.h
+
+#include <algorithm>
+#include <cmath>
+#include "imagePyramid.h"
+#include "filter.h"
+#include "filterKernels.h"
+
+void initImagePyramid(ImagePyramid& pyramid) {
+    for (int i = 0; i < PYRAMID_MAX_LEVELS; i++) {
+        pyramid.levels[i].release();
+    }
+    pyramid.blurred.release();
+    pyramid.built = 0;
+    pyramid.computed = 0;
+    pyramid.reused = 0;
+}
+
+void beginImagePyramid(ImagePyramid& pyramid, const cv::Mat& base) {
+    pyramid.levels[0] = base;
+    pyramid.built = base.empty() ? 0 : 1;
+}
+
+int pyramidLevelCount(cv::Size base) {
+    int count = 1;
+    while (count < PYRAMID_MAX_LEVELS && (base.width >> count) > 0 && (base.height >> count) > 0) {
+        count++;
+    }
+    return count;
+}
+
+cv::Size pyramidLevelSize(cv::Size base, int level) {
+    return cv::Size(base.width >> level, base.height >> level);
+}
+
+int halveImage(const cv::Mat& src, cv::Mat& dst) {
+    if (src.empty() || (src.type() != CV_8UC1 && src.type() != CV_8UC3) || src.cols < 2 || src.rows < 2 || src.data == dst.data) {
+        return -1;
+    }
+    dst.create(src.rows / 2, src.cols / 2, src.type());
+
+    const FilterKernels& kernels = filterKernels();
+    const int channels = src.channels();
+    cv::parallel_for_(cv::Range(0, dst.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; y++) {
+            kernels.halveRow(src.ptr<uchar>(2 * y), src.ptr<uchar>(2 * y + 1), dst.ptr<uchar>(y), dst.cols, channels);
+        }
+    });
+    return 0;
+}
+
+const cv::Mat& pyramidLevel(ImagePyramid& pyramid, int level) {
+    level = std::max(0, std::min(level, pyramidLevelCount(pyramid.levels[0].size()) - 1));
+    if (level < pyramid.built) {
+        pyramid.reused++;
+        return pyramid.levels[level];
+    }
+
+    // Each level from the one above, into the buffer it had for the last base
+    while (pyramid.built <= level) {
+        halveImage(pyramid.levels[pyramid.built - 1], pyramid.levels[pyramid.built]);
+        pyramid.built++;
+        pyramid.computed++;
+    }
+    return pyramid.levels[level];
+}
+
+int pyramidLevelFor(const ImagePyramid& pyramid, cv::Size size) {
+    cv::Size base = pyramid.levels[0].size();
+    int level = 0;
+    while (level + 1 < pyramidLevelCount(base)) {
+        cv::Size next = pyramidLevelSize(base, level + 1);
+        if (next.width < size.width || next.height < size.height) {
+            break;
+        }
+        level++;
+    }
+    return level;
+}
+
+int pyramidGaussianBlur(ImagePyramid& pyramid, cv::Mat& dst, float sigma, int passes) {
+    if (pyramid.built == 0 || sigma < 0.0f) {
+        return -1;
+    }
+    cv::Size base = pyramid.levels[0].size();
+    int level = 0;
+    while (level + 1 < pyramidLevelCount(base) && sigma / (float)(2 << level) >= PYRAMID_BLUR_MIN_SIGMA) {
+        level++;
+    }
+    if (level == 0) {
+        return fastGaussianBlur(pyramid.levels[0], dst, sigma, passes);
+    }
+
+    // The box halvings and the linear upscale blur by about a quarter of a level pixel squared
+    // already, the level blur only adds the rest
+    float scale = (float)(1 << level);
+    float levelSigma = std::sqrt(std::max(sigma * sigma / (scale * scale) - 0.25f, 0.0f));
+    cv::Mat small = pyramidLevel(pyramid, level);
+    if (fastGaussianBlur(small, pyramid.blurred, levelSigma, passes) != 0) {
+        return -1;
+    }
+
+    // A level covers the base up to the rows and columns the halvings dropped. It is scaled to that
+    // extent, so its pixels stay centred on the ones they came from, and the dropped edge repeats
+    // the last ones.
+    cv::Size extent(small.cols << level, small.rows << level);
+    if (extent == base) {
+        cv::resize(pyramid.blurred, dst, base, 0, 0, cv::INTER_LINEAR);
+        return 0;
+    }
+    cv::resize(pyramid.blurred, pyramid.upscaled, extent, 0, 0, cv::INTER_LINEAR);
+    cv::copyMakeBorder(pyramid.upscaled, dst, 0, base.height - extent.height, 0, base.width - extent.width, cv::BORDER_REPLICATE);
+    return 0;
+}
+
+void printImagePyramidStats(const ImagePyramid& pyramid, const char* name) {
+    printf("%s pyramid: %lld levels built, %lld reused\n", name, pyramid.computed, pyramid.reused);
+}
@@ -0,0 +1,58 @@
+// File: imagePyramid.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 27, 2024
+// Image pyramid for the stages that want a smaller copy of the frame: face detection,
+// stabilization, the thumbnails of the comparison grid and large blurs. Level n is the base image
+// halved n times with a 2x2 box filter (the halveRow kernel). For even sizes a level is exactly
+// what cv::resize gives at half size with INTER_LINEAR or INTER_AREA; an odd last row or column
+// is dropped. Levels are built on first request, each from the one above it, and their buffers
+// are kept from one base to the next, so same-size frames don't allocate.
+//
+// Not thread-safe: build the levels before several threads read them.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+
+#define PYRAMID_MAX_LEVELS 8
+
+// Smallest sigma, in pixels of a level, pyramidGaussianBlur blurs a level with
+#define PYRAMID_BLUR_MIN_SIGMA 4.0f
+
+struct ImagePyramid {
+    cv::Mat levels[PYRAMID_MAX_LEVELS];  // level 0 is the base image itself, not a copy
+    cv::Mat blurred;                     // level blurred by pyramidGaussianBlur
+    cv::Mat upscaled;                    // blurred scaled back up, for a base of odd size
+    int built;                           // levels valid for the current base
+    long long computed;                  // levels built, over all bases
+    long long reused;                    // requests served by a level already built
+};
+
+void initImagePyramid(ImagePyramid& pyramid);
+
+// Start on a new base image, CV_8UC1 or CV_8UC3. base must stay alive and unchanged while its
+// levels are used.
+void beginImagePyramid(ImagePyramid& pyramid, const cv::Mat& base);
+
+// Levels a base of this size has: halving stops before a side would drop below one pixel
+int pyramidLevelCount(cv::Size base);
+
+// Size of a level of a base of this size
+cv::Size pyramidLevelSize(cv::Size base, int level);
+
+// The level of the current base, built now with the levels above it if needed. level is clamped
+// to the levels the base has.
+const cv::Mat& pyramidLevel(ImagePyramid& pyramid, int level);
+
+// The smallest level at least size in both dimensions, 0 if the base itself is smaller
+int pyramidLevelFor(const ImagePyramid& pyramid, cv::Size size);
+
+// Halve src with the 2x2 box filter, src and dst must differ
+int halveImage(const cv::Mat& src, cv::Mat& dst);
+
+// Gaussian blur of the base for large sigmas: the smallest level on which the blur still spans
+// PYRAMID_BLUR_MIN_SIGMA pixels is blurred with fastGaussianBlur and scaled back up linearly to
+// the part of the base it covers; the rows and columns of an odd size it dropped repeat the edge.
+// Smaller sigmas blur the base itself, exactly like fastGaussianBlur.
+int pyramidGaussianBlur(ImagePyramid& pyramid, cv::Mat& dst, float sigma, int passes = 3);
+
+void printImagePyramidStats(const ImagePyramid& pyramid, const char* name);
@@ -1,37 +1,108 @@
 // File: imageDisplay.cpp
 // Author: Keval Visaria and Chirag Dhoka Jain
 // Date: January 21, 2024
-// Purpose: Reading and Displaying an image
+// Purpose: Reading and Displaying an image, or applying effects to very large images in bands
 
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include "effectChain.h"
+#include "stripImage.h"
 
 using namespace cv;
 
-int main() {
-    // Read the image from file
-    cv::Mat img = cv::imread("C:/Users/visar/Downloads/img.png");
+// Apply the chain to input and write output without displaying anything. PPM/PGM input written
+// to a .ppm file streams band by band; other formats are decoded and encoded whole, with only the
+// effect intermediates bounded by the bands.
+static int processToFile(const std::string& input, const std::string& output, const std::vector<std::string>& chain, int bandRows) {
+    StripStats stats;
+    int64 start = cv::getTickCount();
+    StripReader probe;
+    bool streamed = output.size() >= 4 && output.compare(output.size() - 4, 4, ".ppm") == 0 && probe.open(input);
+    probe.close();
+    if (streamed) {
+        if (processImageStrips(input, output, chain, bandRows, &stats) != 0) {
+            std::cerr << "Error: Unable to process " << input << " into " << output << std::endl;
+            return -1;
+        }
+    }
+    else {
+        cv::Mat img = cv::imread(input), result;
+        if (img.empty()) {
+            std::cerr << "Error: Image not found or cannot be read." << std::endl;
+            return -1;
+        }
+        if (processImageBands(img, result, chain, bandRows, &stats) != 0 || !cv::imwrite(output, result)) {
+            std::cerr << "Error: Unable to process " << input << " into " << output << std::endl;
+            return -1;
+        }
+    }
+    double ms = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+    printf("%s %d bands of %d rows (+%d halo rows, %.1f MB per band) in %.1f ms\n", streamed ? "Streamed" : "Processed",
+        stats.bands, stats.bandRows, stats.haloRows, stats.bandBytes / 1048576.0, ms);
+    return 0;
+}
+
+// Usage: imgDisplay [image] [--effects chain] [--out file] [--band-rows N]
+//   --effects    effects to apply, e.g. sepia+cartoon; only effects working on rows of the image
+//                without the whole frame can be used, see effectChainHaloRows
+//   --out        write the result instead of displaying it; a .ppm file from a PPM/PGM image is
+//                streamed band by band, so memory doesn't grow with the image size
+//   --band-rows  rows per band (default 256)
+int main(int argc, char* argv[]) {
+    std::string input = "C:/Users/visar/Downloads/img.png";
+    std::string output;
+    std::vector<std::string> chain;
+    int bandRows = STRIP_DEFAULT_BAND_ROWS;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--effects" && i + 1 < argc) {
+            if (!parseEffectChain(argv[++i], chain) || effectChainHaloRows(chain) < 0) {
+                std::cerr << "Error: " << argv[i] << " can't be applied to bands of an image" << std::endl;
+                return -1;
+            }
+        }
+        else if (arg == "--out" && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else if (arg == "--band-rows" && i + 1 < argc) {
+            bandRows = std::max(1, std::atoi(argv[++i]));
+        }
+        else {
+            input = arg;
+        }
+    }
+    if (!output.empty()) {
+        return processToFile(input, output, chain, bandRows);
+    }
+
+    // Read the image from file, given on the command line or the default one
+    cv::Mat img = cv::imread(input);
 
     // Check if the image is empty or cannot be read
     if (img.empty()) {
         std::cerr << "Error: Image not found or cannot be read." << std::endl;
         return -1;
     }
+    if (!chain.empty()) {
+        cv::Mat result;
+        processImageBands(img, result, chain, bandRows);
+        img = result;
+    }
 
     // Display the image
     cv::imshow("My Image", img);
-    printf("Image is being Displayed\n")
+    printf("Image is being Displayed\n");
     // Wait for a key press
     while (true) {
         int key = cv::waitKey(0) & 0xff;
 
         // Check if the key pressed is 'q' or 'Q' to exit
         if (key == 113 || key == 81) {
-            printf("\nQuitting ... ")
+            printf("\nQuitting ... ");
             cv::destroyAllWindows();
             break;
         }
     }
 
     return 0;
-}
\ No newline at end of file
+}
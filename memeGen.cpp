@@ -6,6 +6,7 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <string>
+#include "frameSource.h"
 
 using namespace cv;
 using namespace std;
@@ -36,10 +37,11 @@ void drawText(Mat& image, const string& text, Point position, Scalar textColor =
     putText(image, text, position, fontFace, fontScale, textColor, thickness);
 }
 
-int main() {
+// Usage: memeGen [source], source as in frameSource.h (default: cam:0)
+int main(int argc, char* argv[]) {
     // Open a connection to the webcam
-    VideoCapture cap(0);
-    if (!cap.isOpened()) {
+    FrameSource* cap = openFrameSource(argc > 1 ? argv[1] : "cam:0");
+    if (cap == NULL) {
         cerr << "Error: Unable to open webcam." << endl;
         return -1;
     }
@@ -50,11 +52,14 @@ int main() {
     cout << "Press 's' to capture a frame. Press 'q' to quit." << endl;
 
     // Capture an initial frame
-    cap >> frame;
+    cap->read(frame);
     imwrite("initial_image.jpg", frame);
 
     while (true) {
-        cap >> frame;
+        if (!cap->read(frame)) {
+            cerr << "End of video stream" << endl;
+            break;
+        }
 
         // Display the live stream
         imshow("Meme Generator - Live Stream", frame);
@@ -103,7 +108,7 @@ int main() {
     }
 
     // Close the webcam
-    cap.release();
+    delete cap;
     destroyAllWindows();
 
     return 0;
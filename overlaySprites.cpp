@@ -0,0 +1,265 @@
+// File: overlaySprites.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 9, 2024
+// Heart and sparkle sprites are rasterized once at a few sizes, then every frame only moves
+// particles and blends the cached sprites into the frame.
+
+#include "overlaySprites.h"
+
+// Sizes in pixels kept in the sprite cache
+static const int spriteSizes[] = { 12, 16, 24, 32, 48, 64, 96 };
+static const int spriteSizeCount = sizeof(spriteSizes) / sizeof(spriteSizes[0]);
+
+// Supersampling factor used when rasterizing the sprite coverage
+static const int supersample = 4;
+
+// Particles per face and frames a face is kept after it stops being detected
+static const int heartsPerFace = 5;
+static const int sparklesPerFace = 3;
+static const int maxMissedFrames = 8;
+
+// Rasterize a heart into a coverage mask of size x size pixels
+static void rasterizeHeart(cv::Mat& mask, int size) {
+    mask = cv::Mat::zeros(size, size, CV_8UC1);
+    int r = size / 4;
+    cv::Scalar white(255);
+
+    // Two lobes and a triangle down to the tip
+    cv::circle(mask, cv::Point(r, r + size / 8), r, white, cv::FILLED, cv::LINE_8);
+    cv::circle(mask, cv::Point(size - r, r + size / 8), r, white, cv::FILLED, cv::LINE_8);
+    cv::Point triangle[3] = {
+        cv::Point(size / 2 - 2 * r + r / 8, r + size / 8 + r / 3),
+        cv::Point(size / 2 + 2 * r - r / 8, r + size / 8 + r / 3),
+        cv::Point(size / 2, size - 1)
+    };
+    cv::fillConvexPoly(mask, triangle, 3, white, cv::LINE_8);
+}
+
+// Rasterize a four-pointed sparkle into a coverage mask of size x size pixels
+static void rasterizeSparkle(cv::Mat& mask, int size) {
+    mask = cv::Mat::zeros(size, size, CV_8UC1);
+    cv::Point center(size / 2, size / 2);
+    cv::Scalar white(255);
+    cv::ellipse(mask, center, cv::Size(size / 2 - 1, size / 12 + 1), 0, 0, 360, white, cv::FILLED, cv::LINE_8);
+    cv::ellipse(mask, center, cv::Size(size / 12 + 1, size / 2 - 1), 0, 0, 360, white, cv::FILLED, cv::LINE_8);
+    cv::circle(mask, center, size / 8 + 1, white, cv::FILLED, cv::LINE_8);
+}
+
+// Build one sprite: the shape is drawn at supersample times the size and area-averaged down,
+// which gives smooth anti-aliased edges in the alpha channel
+static Sprite buildSprite(SpriteKind kind, int size) {
+    cv::Mat big;
+    if (kind == SPRITE_HEART) {
+        rasterizeHeart(big, size * supersample);
+    }
+    else {
+        rasterizeSparkle(big, size * supersample);
+    }
+
+    Sprite sprite;
+    cv::resize(big, sprite.alpha, cv::Size(size, size), 0, 0, cv::INTER_AREA);
+
+    // Same colour as the original hearts, sparkles are a warm white
+    cv::Scalar color = kind == SPRITE_HEART ? cv::Scalar(0, 0, 255) : cv::Scalar(200, 250, 255);
+    sprite.bgr = cv::Mat(size, size, CV_8UC3, color);
+    return sprite;
+}
+
+// The cache, built on first use. Function-local statics are initialized once even with several threads.
+static const std::vector<Sprite>& spriteCache() {
+    static const std::vector<Sprite> cache = [] {
+        std::vector<Sprite> sprites;
+        for (int kind = 0; kind < SPRITE_KIND_COUNT; kind++) {
+            for (int i = 0; i < spriteSizeCount; i++) {
+                sprites.push_back(buildSprite(static_cast<SpriteKind>(kind), spriteSizes[i]));
+            }
+        }
+        return sprites;
+    }();
+    return cache;
+}
+
+const Sprite& getSprite(SpriteKind kind, int size) {
+    int best = 0;
+    for (int i = 1; i < spriteSizeCount; i++) {
+        if (std::abs(spriteSizes[i] - size) < std::abs(spriteSizes[best] - size)) {
+            best = i;
+        }
+    }
+    return spriteCache()[kind * spriteSizeCount + best];
+}
+
+void compositeSprites(cv::Mat& frame, const std::vector<SpriteInstance>& instances) {
+    if (frame.empty() || frame.type() != CV_8UC3 || instances.empty()) {
+        return;
+    }
+
+    // Only the rows some sprite touches are visited
+    int top = frame.rows, bottom = 0;
+    for (const SpriteInstance& inst : instances) {
+        top = std::min(top, std::max(inst.topLeft.y, 0));
+        bottom = std::max(bottom, std::min(inst.topLeft.y + inst.sprite->alpha.rows, frame.rows));
+    }
+    if (top >= bottom) {
+        return;
+    }
+
+    // Bands of rows run in parallel, inside a band the instances are blended in order
+    cv::parallel_for_(cv::Range(top, bottom), [&](const cv::Range& band) {
+        for (const SpriteInstance& inst : instances) {
+            const Sprite& sprite = *inst.sprite;
+            int y0 = std::max(band.start, inst.topLeft.y);
+            int y1 = std::min(band.end, inst.topLeft.y + sprite.alpha.rows);
+            int x0 = std::max(0, inst.topLeft.x);
+            int x1 = std::min(frame.cols, inst.topLeft.x + sprite.alpha.cols);
+            if (y0 >= y1 || x0 >= x1) {
+                continue;
+            }
+
+            // Opacity in 8.8 fixed point, so the blend stays in integers
+            int opacity = static_cast<int>(std::min(std::max(inst.opacity, 0.0f), 1.0f) * 256.0f);
+            for (int y = y0; y < y1; ++y) {
+                int sy = y - inst.topLeft.y;
+                const uchar* aptr = sprite.alpha.ptr<uchar>(sy);
+                const cv::Vec3b* sptr = sprite.bgr.ptr<cv::Vec3b>(sy);
+                cv::Vec3b* dptr = frame.ptr<cv::Vec3b>(y);
+                for (int x = x0; x < x1; ++x) {
+                    int sx = x - inst.topLeft.x;
+                    int a = (aptr[sx] * opacity) >> 8;
+                    if (a == 0) {
+                        continue;
+                    }
+                    for (int c = 0; c < 3; c++) {
+                        dptr[x][c] = static_cast<uchar>(dptr[x][c] + (((sptr[sx][c] - dptr[x][c]) * a + 127) / 255));
+                    }
+                }
+            }
+        }
+    }, std::max(1, cv::getNumThreads()));
+}
+
+// Start a particle over at the top of the face
+static void spawnParticle(OverlayParticle& p, SpriteKind kind, int index, int count, cv::RNG& rng) {
+    p.kind = kind;
+    // Spread the particles evenly across the face with a little jitter
+    p.x = (index + 0.5f) / count + rng.uniform(-0.3f, 0.3f) / count;
+    p.rise = rng.uniform(0.0f, 0.5f);
+    p.speed = rng.uniform(0.4f, 0.9f);
+    p.phase = rng.uniform(0.0f, static_cast<float>(2.0 * CV_PI));
+    p.size = kind == SPRITE_HEART ? rng.uniform(0.16f, 0.3f) : rng.uniform(0.1f, 0.16f);
+    p.age = 0.0f;
+    p.life = rng.uniform(2.0f, 3.5f);
+}
+
+static void spawnFace(HeartOverlay& overlay, const cv::Rect& face) {
+    TrackedFace tracked;
+    tracked.rect = cv::Rect2f(face.x, face.y, face.width, face.height);
+    tracked.missedFrames = 0;
+    tracked.particles.resize(heartsPerFace + sparklesPerFace);
+    for (int i = 0; i < heartsPerFace; i++) {
+        spawnParticle(tracked.particles[i], SPRITE_HEART, i, heartsPerFace, overlay.rng);
+        // Stagger the first cycle so the hearts don't all rise together
+        tracked.particles[i].age = overlay.rng.uniform(0.0f, tracked.particles[i].life);
+    }
+    for (int i = 0; i < sparklesPerFace; i++) {
+        spawnParticle(tracked.particles[heartsPerFace + i], SPRITE_SPARKLE, i, sparklesPerFace, overlay.rng);
+    }
+    overlay.faces.push_back(tracked);
+}
+
+void updateHeartOverlay(HeartOverlay& overlay, const std::vector<cv::Rect>& faces, double dt) {
+    std::vector<bool> matched(overlay.faces.size(), false);
+
+    // Match each detection to the nearest unmatched tracked face
+    for (const cv::Rect& face : faces) {
+        float cx = face.x + face.width * 0.5f;
+        float cy = face.y + face.height * 0.5f;
+        int best = -1;
+        float bestDist = face.width * 0.75f;
+        for (size_t i = 0; i < overlay.faces.size(); i++) {
+            if (matched[i]) {
+                continue;
+            }
+            const cv::Rect2f& r = overlay.faces[i].rect;
+            float dist = std::hypot(r.x + r.width * 0.5f - cx, r.y + r.height * 0.5f - cy);
+            if (dist < bestDist) {
+                bestDist = dist;
+                best = static_cast<int>(i);
+            }
+        }
+
+        if (best < 0) {
+            spawnFace(overlay, face);
+            matched.push_back(true);
+            continue;
+        }
+
+        // Smooth the rectangle so the hearts don't follow the detection jitter
+        TrackedFace& tracked = overlay.faces[best];
+        const float follow = 0.5f;
+        tracked.rect.x += follow * (face.x - tracked.rect.x);
+        tracked.rect.y += follow * (face.y - tracked.rect.y);
+        tracked.rect.width += follow * (face.width - tracked.rect.width);
+        tracked.rect.height += follow * (face.height - tracked.rect.height);
+        tracked.missedFrames = 0;
+        matched[best] = true;
+    }
+
+    // Forget faces that haven't been seen for a while
+    for (size_t i = overlay.faces.size(); i-- > 0;) {
+        if (!matched[i] && ++overlay.faces[i].missedFrames > maxMissedFrames) {
+            overlay.faces.erase(overlay.faces.begin() + i);
+        }
+    }
+
+    // Advance the particles
+    for (TrackedFace& tracked : overlay.faces) {
+        for (size_t i = 0; i < tracked.particles.size(); i++) {
+            OverlayParticle& p = tracked.particles[i];
+            p.age += static_cast<float>(dt);
+            p.rise += p.speed * static_cast<float>(dt);
+            p.phase += static_cast<float>(dt) * 3.0f;
+            if (p.age >= p.life) {
+                bool heart = p.kind == SPRITE_HEART;
+                int index = heart ? (int)i : (int)i - heartsPerFace;
+                spawnParticle(p, p.kind, index, heart ? heartsPerFace : sparklesPerFace, overlay.rng);
+            }
+        }
+    }
+}
+
+void renderHeartOverlay(HeartOverlay& overlay, cv::Mat& frame) {
+    overlay.batch.clear();
+
+    for (const TrackedFace& tracked : overlay.faces) {
+        const cv::Rect2f& face = tracked.rect;
+        for (const OverlayParticle& p : tracked.particles) {
+            int size = std::max(1, static_cast<int>(p.size * face.width));
+            const Sprite& sprite = getSprite(p.kind, size);
+            int spriteSize = sprite.alpha.cols;
+
+            // Hearts sway as they rise, sparkles stay put and twinkle
+            float sway = p.kind == SPRITE_HEART ? 0.25f * std::sin(p.phase) : 0.0f;
+            float cx = face.x + p.x * face.width + sway * spriteSize;
+            float cy = face.y - spriteSize * (0.5f + p.rise);
+
+            // Fade in at the start of the life and out at the end
+            float t = p.age / p.life;
+            float opacity = std::min(1.0f, std::min(t * 5.0f, (1.0f - t) * 3.0f));
+            if (p.kind == SPRITE_SPARKLE) {
+                opacity *= 0.5f + 0.5f * std::sin(p.phase * 2.0f);
+            }
+            if (opacity <= 0.0f) {
+                continue;
+            }
+
+            SpriteInstance inst;
+            inst.sprite = &sprite;
+            inst.topLeft = cv::Point(static_cast<int>(cx - spriteSize * 0.5f), static_cast<int>(cy - spriteSize * 0.5f));
+            inst.opacity = opacity;
+            overlay.batch.push_back(inst);
+        }
+    }
+
+    compositeSprites(frame, overlay.batch);
+}
@@ -0,0 +1,73 @@
+// File: overlaySprites.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 9, 2024
+// Pre-rasterized overlay sprites, per-face particle animation and batched alpha compositing
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+enum SpriteKind {
+    SPRITE_HEART = 0,
+    SPRITE_SPARKLE = 1,
+    SPRITE_KIND_COUNT
+};
+
+// An anti-aliased sprite: colour and coverage of the same size
+struct Sprite {
+    cv::Mat bgr;    // CV_8UC3
+    cv::Mat alpha;  // CV_8UC1, 255 is fully covered
+};
+
+// One sprite to composite into the frame
+struct SpriteInstance {
+    const Sprite* sprite;
+    cv::Point topLeft;
+    float opacity;  // 0 to 1, multiplied with the sprite coverage
+};
+
+// Sprite of the given kind from the cache, at the cached size closest to the requested one.
+// The cache is rasterized once on first use.
+const Sprite& getSprite(SpriteKind kind, int size);
+
+// Composite every instance into an 8-bit BGR frame in a single pass over the covered rows.
+// Instances are blended in order, sprites partly outside the frame are clipped.
+void compositeSprites(cv::Mat& frame, const std::vector<SpriteInstance>& instances);
+
+// A heart or sparkle floating above a face, in coordinates relative to the face
+struct OverlayParticle {
+    SpriteKind kind;
+    float x;       // horizontal position as a fraction of the face width
+    float rise;    // height above the top of the face, in sprite sizes
+    float speed;   // rise per second, in sprite sizes
+    float phase;   // sway and twinkle phase
+    float size;    // sprite size as a fraction of the face width
+    float age;     // seconds since the particle was spawned
+    float life;    // seconds until the particle respawns
+};
+
+// A face followed across frames together with its particles
+struct TrackedFace {
+    cv::Rect2f rect;  // smoothed face rectangle in frame coordinates
+    int missedFrames;
+    std::vector<OverlayParticle> particles;
+};
+
+// Animation state of the heart overlay, one per video stream
+struct HeartOverlay {
+    std::vector<TrackedFace> faces;
+    std::vector<SpriteInstance> batch;
+    cv::RNG rng;
+    int64 lastTick;
+
+    HeartOverlay() : rng(0x4ea47), lastTick(0) {}
+};
+
+// Match the detected faces to the tracked ones and advance the particles by dt seconds
+void updateHeartOverlay(HeartOverlay& overlay, const std::vector<cv::Rect>& faces, double dt);
+
+// Composite the particles of every tracked face into the frame
+void renderHeartOverlay(HeartOverlay& overlay, cv::Mat& frame);
+
+// drawHearts with explicit animation state, for callers that handle several streams
+int drawHearts(cv::Mat& frame, std::vector<cv::Rect>& faces, int minWidth, float scale, HeartOverlay& overlay);
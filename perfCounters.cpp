@@ -0,0 +1,359 @@
+// File: perfCounters.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 28, 2024
+// perf_event_open counter groups and the per-kernel report, see perfCounters.h
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include "perfCounters.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint64_t counterEvents[PERF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+// Why the counters can't be opened, in words a user can act on
+static std::string openError(int error) {
+    if (error == EACCES || error == EPERM) {
+        std::string reason = "not permitted";
+        FILE* file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        int paranoid;
+        if (file != NULL) {
+            if (fscanf(file, "%d", &paranoid) == 1) {
+                reason += ", kernel.perf_event_paranoid is " + std::to_string(paranoid) + " and must be 2 or lower";
+            }
+            fclose(file);
+        }
+        return reason;
+    }
+    if (error == ENOENT || error == ENODEV || error == EOPNOTSUPP) {
+        return "this CPU exposes no hardware counters, e.g. in a virtual machine";
+    }
+    if (error == ENOSYS) {
+        return "the kernel has no perf_event_open";
+    }
+    return strerror(error);
+}
+
+// When the thread started, in clock ticks since boot, 0 if it's gone. A tid can be reused by a
+// later thread, the start time tells the two apart.
+static unsigned long long threadStartTime(int tid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    char line[1024];
+    size_t bytes = fread(line, 1, sizeof(line) - 1, file);
+    fclose(file);
+    line[bytes] = '\0';
+
+    // The command name may hold spaces, the fields are counted from its closing parenthesis:
+    // state is field 3, start time field 22
+    const char* fields = strrchr(line, ')');
+    unsigned long long started = 0;
+    if (fields == NULL || sscanf(fields + 1, "%*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu", &started) != 1) {
+        return 0;
+    }
+    return started;
+}
+
+// Threads left out of the counts, as tid and start time
+static std::mutex excludedMutex;
+static std::vector<std::pair<int, unsigned long long> > excludedThreads;
+
+static bool excludedThread(int tid, unsigned long long started) {
+    std::lock_guard<std::mutex> lock(excludedMutex);
+    return std::find(excludedThreads.begin(), excludedThreads.end(), std::make_pair(tid, started)) != excludedThreads.end();
+}
+#endif
+
+void excludeThreadFromProfiling() {
+#ifdef __linux__
+    int tid = (int)syscall(SYS_gettid);
+    unsigned long long started = threadStartTime(tid);
+    std::lock_guard<std::mutex> lock(excludedMutex);
+
+    // Forget the threads that finished, their tids may come back as threads worth counting
+    std::vector<std::pair<int, unsigned long long> > kept;
+    for (const auto& thread : excludedThreads) {
+        if (threadStartTime(thread.first) == thread.second) {
+            kept.push_back(thread);
+        }
+    }
+    kept.push_back(std::make_pair(tid, started));
+    excludedThreads.swap(kept);
+#endif
+}
+
+PerfProfiler::PerfProfiler() : opened(false), available(false), currentPixels(0.0), measuring(false) {
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        supported[c] = false;
+        position[c] = -1;
+    }
+}
+
+PerfProfiler::~PerfProfiler() {
+    for (ThreadCounters& thread : threads) {
+        closeThread(thread);
+    }
+}
+
+bool PerfProfiler::open() {
+    if (opened) {
+        return available;
+    }
+    opened = true;
+#ifdef __linux__
+    // The calling thread decides which counters the CPU has, the other threads get the same set
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        supported[c] = true;
+    }
+    ThreadCounters thread;
+    int error = 0;
+    int tid = (int)syscall(SYS_gettid);
+    if (!openThread(tid, threadStartTime(tid), thread, true, error)) {
+        reason = openError(error);
+        return false;
+    }
+    threads.push_back(thread);
+    int next = 0;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        position[c] = supported[c] ? next++ : -1;
+    }
+    available = true;
+    scanThreads();
+#else
+    reason = "hardware counters need Linux perf_event_open";
+#endif
+    return available;
+}
+
+bool PerfProfiler::openThread(int tid, unsigned long long started, ThreadCounters& thread, bool probing, int& error) {
+    thread.tid = tid;
+    thread.started = started;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        thread.fds[c] = -1;
+    }
+#ifdef __linux__
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        if (!supported[c]) {
+            continue;
+        }
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = counterEvents[c];
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // The counters run from here on, each call reads them before and after
+        int fd = (int)syscall(SYS_perf_event_open, &attr, tid, -1, c == PERF_CYCLES ? -1 : thread.fds[PERF_CYCLES], PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) {
+            if (c == PERF_CYCLES || !probing) {
+                error = errno;
+                closeThread(thread);
+                return false;
+            }
+
+            // Some CPUs lack an event, the others are still worth counting
+            supported[c] = false;
+            continue;
+        }
+        thread.fds[c] = fd;
+    }
+    return true;
+#else
+    error = ENOSYS;
+    return false;
+#endif
+}
+
+void PerfProfiler::closeThread(ThreadCounters& thread) {
+    // Siblings first, the leader closes the group
+    for (int c = PERF_COUNTERS - 1; c >= 0; c--) {
+        if (thread.fds[c] >= 0) {
+#ifdef __linux__
+            close(thread.fds[c]);
+#endif
+            thread.fds[c] = -1;
+        }
+    }
+}
+
+// Open counters on the threads started since the last scan and close those of finished and
+// excluded threads. A thread is its tid and start time, so a reused tid gets counters of its own.
+void PerfProfiler::scanThreads() {
+#ifdef __linux__
+    DIR* tasks = opendir("/proc/self/task");
+    if (tasks == NULL) {
+        return;
+    }
+    std::vector<std::pair<int, unsigned long long> > running;
+    while (dirent* entry = readdir(tasks)) {
+        int tid = atoi(entry->d_name);
+        unsigned long long started = tid > 0 ? threadStartTime(tid) : 0;
+        if (started != 0 && !excludedThread(tid, started)) {
+            running.push_back(std::make_pair(tid, started));
+        }
+    }
+    closedir(tasks);
+    std::sort(running.begin(), running.end());
+
+    std::vector<ThreadCounters> kept;
+    for (ThreadCounters& thread : threads) {
+        if (std::binary_search(running.begin(), running.end(), std::make_pair(thread.tid, thread.started))) {
+            kept.push_back(thread);
+        }
+        else {
+            closeThread(thread);
+        }
+    }
+    threads.swap(kept);
+    for (const auto& entry : running) {
+        bool known = false;
+        for (const ThreadCounters& thread : threads) {
+            known = known || (thread.tid == entry.first && thread.started == entry.second);
+        }
+        ThreadCounters thread;
+        int error;
+        if (!known && openThread(entry.first, entry.second, thread, false, error)) {
+            threads.push_back(thread);
+        }
+    }
+#endif
+}
+
+bool PerfProfiler::readThread(const ThreadCounters& thread, Sample& sample) const {
+    sample.ok = false;
+#ifdef __linux__
+    // nr, time enabled, time running, then the values in group order
+    uint64_t data[3 + PERF_COUNTERS];
+    ssize_t bytes = read(thread.fds[PERF_CYCLES], data, sizeof(data));
+    if (bytes < (ssize_t)(3 * sizeof(uint64_t)) || bytes < (ssize_t)((3 + data[0]) * sizeof(uint64_t))) {
+        return false;
+    }
+    sample.enabled = data[1];
+    sample.running = data[2];
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        sample.values[c] = position[c] >= 0 && (uint64_t)position[c] < data[0] ? data[3 + position[c]] : 0;
+    }
+    sample.ok = true;
+#else
+    (void)thread;
+#endif
+    return sample.ok;
+}
+
+void PerfProfiler::begin(const std::string& kernel, double pixels) {
+    open();
+    current = kernel;
+    currentPixels = pixels;
+    measuring = true;
+    if (available) {
+        scanThreads();
+        startSamples.resize(threads.size());
+        for (size_t i = 0; i < threads.size(); i++) {
+            readThread(threads[i], startSamples[i]);
+        }
+    }
+
+    // The clock runs inside the counter reads, so the time doesn't include them
+    startTime = std::chrono::steady_clock::now();
+}
+
+void PerfProfiler::end() {
+    if (!measuring) {
+        return;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    measuring = false;
+
+    PerfKernelStats& kernel = stats[current];
+    kernel.calls++;
+    kernel.ms += ms;
+    kernel.pixels += currentPixels;
+    for (size_t i = 0; i < startSamples.size() && i < threads.size(); i++) {
+        Sample now;
+        const Sample& start = startSamples[i];
+        if (!start.ok || !readThread(threads[i], now)) {
+            continue;
+        }
+
+        // A group that shared the PMU with other events only counted part of the time
+        uint64_t enabled = now.enabled - start.enabled, running = now.running - start.running;
+        if (running == 0) {
+            continue;
+        }
+        double scale = (double)enabled / (double)running;
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            kernel.counts[c] += (double)(now.values[c] - start.values[c]) * scale;
+        }
+    }
+}
+
+void PerfProfiler::reset() {
+    stats.clear();
+    measuring = false;
+}
+
+void PerfProfiler::print() const {
+    if (available) {
+        printf("Hardware counters of %zu threads, user space (%d bytes per cache miss):\n", threads.size(), PERF_CACHE_LINE_BYTES);
+    }
+    else {
+        printf("Hardware counters unavailable (%s), timing only:\n", reason.c_str());
+    }
+    printf("%-20s %7s %9s %7s", "kernel", "calls", "ms/call", "ns/px");
+    if (available) {
+        printf(" %9s %6s %9s %11s", "cycles/px", "IPC", "miss B/px", "br-miss/kpx");
+    }
+    printf("\n");
+
+    for (const auto& entry : stats) {
+        const PerfKernelStats& kernel = entry.second;
+        double pixels = std::max(kernel.pixels, 1.0);
+        printf("%-20s %7lld %9.3f %7.2f", entry.first.c_str(), kernel.calls, kernel.ms / std::max(kernel.calls, 1LL),
+            kernel.ms * 1e6 / pixels);
+        if (available) {
+            const double* counts = kernel.counts;
+            if (supported[PERF_CYCLES]) {
+                printf(" %9.2f", counts[PERF_CYCLES] / pixels);
+            }
+            if (supported[PERF_INSTRUCTIONS] && counts[PERF_CYCLES] > 0.0) {
+                printf(" %6.2f", counts[PERF_INSTRUCTIONS] / counts[PERF_CYCLES]);
+            }
+            else {
+                printf(" %6s", "-");
+            }
+            if (supported[PERF_CACHE_MISSES]) {
+                printf(" %9.2f", counts[PERF_CACHE_MISSES] * PERF_CACHE_LINE_BYTES / pixels);
+            }
+            else {
+                printf(" %9s", "-");
+            }
+            if (supported[PERF_BRANCH_MISSES]) {
+                printf(" %11.2f", counts[PERF_BRANCH_MISSES] * 1000.0 / pixels);
+            }
+            else {
+                printf(" %11s", "-");
+            }
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,103 @@
+// File: perfCounters.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 28, 2024
+// Hardware performance counters around filter calls, to tell compute-bound kernels from cache-bound
+// ones where the time alone can't. On Linux every thread of the process gets a perf_event_open
+// group counting cycles, instructions, cache misses and branch misses in user space, so the work a
+// filter hands to the cv::parallel_for_ pool is counted with it; threads started later are picked
+// up by the next call. Threads doing other work alongside the filters, like the stats and
+// stabilizer workers, leave themselves out with excludeThreadFromProfiling. Per kernel the profiler
+// reports instructions per cycle and the bytes per pixel the cache misses moved.
+//
+// Where the counters aren't permitted (kernel.perf_event_paranoid above 2, containers, virtual
+// machines without a PMU) or outside Linux the calls are only timed, and the report says why.
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,          // the CPU's generic cache miss event, the last level cache on x86
+    PERF_BRANCH_MISSES,
+    PERF_COUNTERS
+};
+
+// Bytes one cache miss is taken to move
+#define PERF_CACHE_LINE_BYTES 64
+
+struct PerfKernelStats {
+    long long calls;
+    double ms;
+    double pixels;
+    double counts[PERF_COUNTERS];   // scaled up when the kernel multiplexed the counters
+};
+
+// Not thread-safe: begin and end are called from one thread, the one running the filters
+class PerfProfiler {
+public:
+    PerfProfiler();
+    ~PerfProfiler();
+
+    // Open the counters, done by the first begin otherwise. Returns false when they aren't
+    // available; the calls are then only timed.
+    bool open();
+
+    bool countersAvailable() const { return available; }
+    bool counterSupported(PerfCounter counter) const { return available && supported[counter]; }
+    const std::string& unavailableReason() const { return reason; }
+
+    // Count the work of all threads from begin to end as one call of kernel on pixels pixels
+    void begin(const std::string& kernel, double pixels);
+
+    // Does nothing without a begin, so a call can be closed early and again at the end
+    void end();
+
+    const std::map<std::string, PerfKernelStats>& kernels() const { return stats; }
+
+    // Forget the totals, the counters stay open
+    void reset();
+
+    // One line per kernel: time per call and per pixel, cycles per pixel, IPC, cache miss bytes
+    // per pixel and branch misses per thousand pixels
+    void print() const;
+
+private:
+    struct ThreadCounters {
+        int tid;
+        unsigned long long started; // start time of the thread, tells a reused tid apart
+        int fds[PERF_COUNTERS];     // fds[PERF_CYCLES] leads the group
+    };
+    struct Sample {
+        bool ok;
+        uint64_t enabled;
+        uint64_t running;
+        uint64_t values[PERF_COUNTERS];
+    };
+
+    bool openThread(int tid, unsigned long long started, ThreadCounters& thread, bool probing, int& error);
+    void closeThread(ThreadCounters& thread);
+    void scanThreads();
+    bool readThread(const ThreadCounters& thread, Sample& sample) const;
+
+    bool opened;
+    bool available;
+    bool supported[PERF_COUNTERS];
+    int position[PERF_COUNTERS];    // index of each counter in a group read
+    std::string reason;
+    std::vector<ThreadCounters> threads;
+    std::vector<Sample> startSamples;
+    std::map<std::string, PerfKernelStats> stats;
+    std::string current;
+    double currentPixels;
+    bool measuring;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+// Leave the calling thread out of the counts of every profiler, for threads whose work isn't the
+// filters': workers running alongside them and threads waiting for commands. Thread-safe.
+void excludeThreadFromProfiling();
@@ -0,0 +1,189 @@
+// File: pixelPipeline.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 23, 2024
+// Point filters that fuse at compile time. Each operation maps one BGR pixel to another, and
+// operations chained with | become a single type whose per-pixel code the compiler inlines into
+// one loop, so
+//
+//     applyPixelPipeline(src, dst, sepia() | vignette(map) | contrast(1.2f, -10.0f) | threshold(128));
+//
+// reads and writes the frame once instead of four times, with no intermediate frames.
+//
+// Every operation rounds its result to 8 bits like the stand-alone filter does, so a fused
+// pipeline gives exactly the frame the separate passes would. A single operation reproduces its
+// filter.h counterpart bit for bit (contrast follows convertTo and may differ by one where
+// OpenCV uses fused multiply-adds).
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <type_traits>
+
+namespace pixelPipeline {
+
+// One pixel on its way through the pipeline, every channel in 0..255
+struct Pixel {
+    int b, g, r;
+};
+
+// Base of all operations, only these combine with |
+struct PixelOp {};
+
+// Operations are bound to a row first, then applied to the pixels of that row. Row-independent
+// operations are their own row.
+
+// The sepia matrix of sepiaTone, including its order: the red result goes to the first channel
+struct SepiaOp : PixelOp {
+    const SepiaOp& row(int) const { return *this; }
+    static int clampTruncate(double v) { return static_cast<int>(v < 0.0 ? 0.0 : (v > 255.0 ? 255.0 : v)); }
+    Pixel operator()(Pixel p, int) const {
+        double b = p.b, g = p.g, r = p.r;
+        return { clampTruncate(0.272 * r + 0.534 * g + 0.131 * b),
+                 clampTruncate(0.349 * r + 0.686 * g + 0.168 * b),
+                 clampTruncate(0.393 * r + 0.769 * g + 0.189 * b) };
+    }
+};
+
+// altGreyScale: 255 - red in every channel
+struct AltGreyOp : PixelOp {
+    const AltGreyOp& row(int) const { return *this; }
+    Pixel operator()(Pixel p, int) const {
+        int grey = 255 - p.r;
+        return { grey, grey, grey };
+    }
+};
+
+// pickStrongColor: pixels not brighter than the threshold turn grey
+struct StrongColorOp : PixelOp {
+    int threshold;
+    const StrongColorOp& row(int) const { return *this; }
+    Pixel operator()(Pixel p, int) const {
+        int intensity = (p.b + p.g + p.r) / 3;
+        bool strong = intensity > threshold;
+        return { strong ? p.b : intensity, strong ? p.g : intensity, strong ? p.r : intensity };
+    }
+};
+
+// convertTo(dst, -1, gain, offset), i.e. contrast and brightness
+struct ContrastOp : PixelOp {
+    float gain, offset;
+    const ContrastOp& row(int) const { return *this; }
+    int scale(int v) const { return cv::saturate_cast<uchar>(v * gain + offset); }
+    Pixel operator()(Pixel p, int) const {
+        return { scale(p.b), scale(p.g), scale(p.r) };
+    }
+};
+
+// cv::threshold(src, dst, t, 255, THRESH_BINARY) on every channel
+struct ThresholdOp : PixelOp {
+    int t;
+    const ThresholdOp& row(int) const { return *this; }
+    Pixel operator()(Pixel p, int) const {
+        return { p.b > t ? 255 : 0, p.g > t ? 255 : 0, p.r > t ? 255 : 0 };
+    }
+};
+
+// cv::LUT with a 256 entry CV_8U table shared by the channels
+struct TableOp : PixelOp {
+    const uchar* table;
+    const TableOp& row(int) const { return *this; }
+    Pixel operator()(Pixel p, int) const {
+        return { table[p.b], table[p.g], table[p.r] };
+    }
+};
+
+// Vignette with a gain per pixel, see vignetteMap
+struct VignetteOp : PixelOp {
+    const cv::Mat* gain;
+    struct Row {
+        const double* gain;
+        Pixel operator()(Pixel p, int x) const {
+            double v = gain[x];
+            return { static_cast<int>(p.b * v), static_cast<int>(p.g * v), static_cast<int>(p.r * v) };
+        }
+    };
+    Row row(int y) const { return { gain->ptr<double>(y) }; }
+};
+
+// Two operations applied one after the other
+template <typename First, typename Second>
+struct Chain : PixelOp {
+    First first;
+    Second second;
+    struct Row {
+        decltype(std::declval<const First&>().row(0)) first;
+        decltype(std::declval<const Second&>().row(0)) second;
+        Pixel operator()(Pixel p, int x) const { return second(first(p, x), x); }
+    };
+    Row row(int y) const { return { first.row(y), second.row(y) }; }
+};
+
+template <typename First, typename Second,
+    typename = typename std::enable_if<std::is_base_of<PixelOp, First>::value && std::is_base_of<PixelOp, Second>::value>::type>
+Chain<First, Second> operator|(const First& first, const Second& second) {
+    Chain<First, Second> chain;
+    chain.first = first;
+    chain.second = second;
+    return chain;
+}
+
+inline SepiaOp sepia() { return SepiaOp(); }
+inline AltGreyOp altGrey() { return AltGreyOp(); }
+inline StrongColorOp strongColor(int threshold = 128) { StrongColorOp op; op.threshold = threshold; return op; }
+inline ContrastOp contrast(float gain, float offset = 0.0f) { ContrastOp op; op.gain = gain; op.offset = offset; return op; }
+inline ThresholdOp threshold(int t) { ThresholdOp op; op.t = t; return op; }
+inline TableOp table(const cv::Mat& lut) { TableOp op; op.table = lut.ptr<uchar>(); return op; }
+inline VignetteOp vignette(const cv::Mat& gain) { VignetteOp op; op.gain = &gain; return op; }
+
+}  // namespace pixelPipeline
+
+// Gains of the Vignette filter for one frame size, recomputed only when the size or the
+// parameters change
+struct VignetteMap {
+    cv::Mat gain;       // CV_64FC1
+    double strength;
+    double radius;
+};
+
+inline const cv::Mat& vignetteMap(VignetteMap& map, cv::Size size, double strength, double radius) {
+    if (map.gain.size() == size && map.strength == strength && map.radius == radius) {
+        return map.gain;
+    }
+    map.gain.create(size, CV_64FC1);
+    map.strength = strength;
+    map.radius = radius;
+    cv::Point center(size.width / 2, size.height / 2);
+    for (int y = 0; y < size.height; ++y) {
+        double* gain = map.gain.ptr<double>(y);
+        for (int x = 0; x < size.width; ++x) {
+            double dist = cv::norm(center - cv::Point(x, y)) / cv::norm(center);
+            gain[x] = 1.0 - strength * (1.0 - std::exp(-0.5 * std::pow(dist / radius, 2)));
+        }
+    }
+    return map.gain;
+}
+
+// Run a pipeline over a CV_8UC3 frame, one parallel pass. dst may be src. Returns -1 for an
+// empty or non-BGR source.
+template <typename Op>
+int applyPixelPipeline(const cv::Mat& src, cv::Mat& dst, const Op& op) {
+    static_assert(std::is_base_of<pixelPipeline::PixelOp, Op>::value, "applyPixelPipeline needs a pixelPipeline operation");
+    if (src.empty() || src.type() != CV_8UC3) {
+        return -1;
+    }
+    dst.create(src.size(), src.type());
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            const uchar* sptr = src.ptr<uchar>(y);
+            uchar* dptr = dst.ptr<uchar>(y);
+            auto row = op.row(y);
+            for (int x = 0; x < src.cols; ++x) {
+                pixelPipeline::Pixel p = row(pixelPipeline::Pixel{ sptr[3 * x], sptr[3 * x + 1], sptr[3 * x + 2] }, x);
+                dptr[3 * x] = static_cast<uchar>(p.b);
+                dptr[3 * x + 1] = static_cast<uchar>(p.g);
+                dptr[3 * x + 2] = static_cast<uchar>(p.r);
+            }
+        }
+    });
+    return 0;
+}
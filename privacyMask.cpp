@@ -0,0 +1,104 @@
+// File: privacyMask.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 22, 2024
+// Region tracking and masking of the face privacy mode, see privacyMask.h
+
+#include <algorithm>
+#include "privacyMask.h"
+#include "filter.h"
+
+void initPrivacyState(PrivacyState& state, int holdFrames, float padding, float growth) {
+    state.regions.clear();
+    state.holdFrames = holdFrames;
+    state.padding = padding;
+    state.growth = growth;
+}
+
+// Share of the smaller rectangle covered by the other one
+static double overlap(const cv::Rect& a, const cv::Rect& b) {
+    double smaller = std::min(a.area(), b.area());
+    return smaller > 0 ? (a & b).area() / smaller : 0.0;
+}
+
+void updatePrivacyRegions(PrivacyState& state, const std::vector<cv::Rect>& faces, bool detected) {
+    if (!detected) {
+        for (PrivacyRegion& region : state.regions) {
+            if (region.framesMissing > 0) {
+                region.framesMissing++;
+            }
+        }
+    }
+    else {
+        // Each face takes the region it overlaps most, faces left over start new regions
+        std::vector<bool> matched(state.regions.size(), false);
+        for (const cv::Rect& face : faces) {
+            int best = -1;
+            double bestOverlap = 0.3;
+            for (size_t i = 0; i < state.regions.size(); i++) {
+                double o = overlap(face, state.regions[i].face);
+                if (!matched[i] && o > bestOverlap) {
+                    best = (int)i;
+                    bestOverlap = o;
+                }
+            }
+            if (best >= 0) {
+                state.regions[best].face = face;
+                state.regions[best].framesMissing = 0;
+                matched[best] = true;
+            }
+            else {
+                state.regions.push_back({ face, 0 });
+                matched.push_back(true);
+            }
+        }
+        for (size_t i = 0; i < state.regions.size(); i++) {
+            if (!matched[i]) {
+                state.regions[i].framesMissing++;
+            }
+        }
+    }
+
+    state.regions.erase(std::remove_if(state.regions.begin(), state.regions.end(),
+        [&](const PrivacyRegion& region) { return region.framesMissing > state.holdFrames; }), state.regions.end());
+}
+
+cv::Rect privacyRect(const PrivacyState& state, const PrivacyRegion& region, cv::Size frameSize, float scale) {
+    float pad = state.padding + state.growth * region.framesMissing;
+    float x = (region.face.x - pad * region.face.width) * scale;
+    float y = (region.face.y - pad * region.face.height) * scale;
+    float w = (1.0f + 2.0f * pad) * region.face.width * scale;
+    float h = (1.0f + 2.0f * pad) * region.face.height * scale;
+
+    // Round outwards, a pixel too many is better than one too few
+    cv::Rect rect(cvFloor(x), cvFloor(y), 0, 0);
+    rect.width = cvCeil(x + w) - rect.x;
+    rect.height = cvCeil(y + h) - rect.y;
+    return rect & cv::Rect(0, 0, frameSize.width, frameSize.height);
+}
+
+int applyPrivacyMask(cv::Mat& frame, const PrivacyState& state, PrivacyStyle style, float scale) {
+    int masked = 0;
+    cv::Mat blocks;
+    for (const PrivacyRegion& region : state.regions) {
+        cv::Rect rect = privacyRect(state, region, frame.size(), scale);
+        if (rect.empty()) {
+            continue;
+        }
+
+        // Both styles write into the ROI header, so only the region is read and written
+        cv::Mat roi = frame(rect);
+        if (style == PRIVACY_BLUR) {
+            int radius = std::max(2, std::max(rect.width, rect.height) / 8);
+            boxBlur(roi, roi, radius);
+            boxBlur(roi, roi, radius);
+        }
+        else {
+            int block = std::max(4, std::max(rect.width, rect.height) / 8);
+            cv::Size mosaic((rect.width + block - 1) / block, (rect.height + block - 1) / block);
+            cv::resize(roi, blocks, mosaic, 0, 0, cv::INTER_AREA);
+            cv::resize(blocks, roi, rect.size(), 0, 0, cv::INTER_NEAREST);
+        }
+        masked++;
+    }
+    return masked;
+}
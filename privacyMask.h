@@ -0,0 +1,39 @@
+// File: privacyMask.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 22, 2024
+// Face anonymization: mosaic or blur applied only inside padded face rectangles, so the cost
+// follows the face area instead of the frame area. Regions are held for a while after their face
+// is lost, so a missed detection never shows a face for a frame or two.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+enum PrivacyStyle {
+    PRIVACY_PIXELATE,       // mosaic of about 8 blocks across the region
+    PRIVACY_BLUR            // two box blur passes with a radius of an eighth of the region
+};
+
+struct PrivacyRegion {
+    cv::Rect face;          // last detection of the face, full resolution coordinates
+    int framesMissing;      // frames since a detection last matched it
+};
+
+struct PrivacyState {
+    std::vector<PrivacyRegion> regions;
+    int holdFrames;         // regions are kept this many frames after their face was lost
+    float padding;          // fraction of the face size added on every side
+    float growth;           // extra padding per missing frame, to cover a face moving meanwhile
+};
+
+void initPrivacyState(PrivacyState& state, int holdFrames = 15, float padding = 0.25f, float growth = 0.02f);
+
+// Match the faces of this frame to the held regions. detected tells whether faces comes from a
+// detection of this frame; if not, the regions are only aged.
+void updatePrivacyRegions(PrivacyState& state, const std::vector<cv::Rect>& faces, bool detected);
+
+// Rectangle masked for a region in a frame of frameSize processed at scale times full resolution
+cv::Rect privacyRect(const PrivacyState& state, const PrivacyRegion& region, cv::Size frameSize, float scale = 1.0f);
+
+// Anonymize every region in place, returns the number of regions masked
+int applyPrivacyMask(cv::Mat& frame, const PrivacyState& state, PrivacyStyle style, float scale = 1.0f);
@@ -0,0 +1,120 @@
+// File: qualityGovernor.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 2, 2024
+// Frame-rate governor: measures processing time against a target FPS and steps the quality
+// level up or down. Separate thresholds and frame counts for each direction give hysteresis
+// so the settings don't oscillate around the budget.
+
+#include <opencv2/opencv.hpp>
+#include "qualityGovernor.h"
+
+// Drop quality once the average is this far over budget for degradeAfter frames
+static const double degradeRatio = 1.05;
+static const int degradeAfter = 10;
+
+// Raise quality only once the average is well under budget for a longer stretch
+static const double upgradeRatio = 0.70;
+static const int upgradeAfter = 60;
+
+// Frames to wait after a change so the average reflects the new settings
+static const int holdAfterChange = 30;
+
+// Smoothing factor of the frame time moving average
+static const double averageAlpha = 0.1;
+
+static const int maxLevel = 4;
+
+int governorMaxLevel() {
+    return maxLevel;
+}
+
+// Quality levels, from full quality to the cheapest settings. Every level filters on all the
+// cores, as many as OpenCV uses without the governor, so switching it on doesn't slow anything.
+QualitySettings governorSettings(int level) {
+    int cpus = std::max(1, cv::getNumberOfCPUs());
+
+    switch (std::min(std::max(level, 0), maxLevel)) {
+    case 0:  return { 1.0f,  1, cpus, 3, false };
+    case 1:  return { 1.0f,  2, cpus, 2, true };
+    case 2:  return { 0.75f, 3, cpus, 2, true };
+    case 3:  return { 0.5f,  4, cpus, 1, true };
+    default: return { 0.5f,  8, cpus, 1, true };
+    }
+}
+
+void initGovernor(QualityGovernor& gov, double targetFps) {
+    gov.enabled = false;
+    gov.targetFrameMs = 1000.0 / std::max(targetFps, 1.0);
+    gov.avgFrameMs = 0.0;
+    gov.level = 0;
+    gov.slowFrames = 0;
+    gov.fastFrames = 0;
+    gov.holdFrames = 0;
+    gov.settings = governorSettings(0);
+    gov.lastDecision = "none";
+}
+
+bool updateGovernor(QualityGovernor& gov, double frameMs) {
+    // Seed the average with the first measurement
+    if (gov.avgFrameMs <= 0.0) {
+        gov.avgFrameMs = frameMs;
+    }
+    else {
+        gov.avgFrameMs += averageAlpha * (frameMs - gov.avgFrameMs);
+    }
+
+    if (!gov.enabled) {
+        return false;
+    }
+
+    if (gov.holdFrames > 0) {
+        gov.holdFrames--;
+        return false;
+    }
+
+    // Count consecutive frames on either side of the hysteresis band
+    if (gov.avgFrameMs > gov.targetFrameMs * degradeRatio) {
+        gov.slowFrames++;
+        gov.fastFrames = 0;
+    }
+    else if (gov.avgFrameMs < gov.targetFrameMs * upgradeRatio) {
+        gov.fastFrames++;
+        gov.slowFrames = 0;
+    }
+    else {
+        gov.slowFrames = 0;
+        gov.fastFrames = 0;
+    }
+
+    int newLevel = gov.level;
+    if (gov.slowFrames >= degradeAfter && gov.level < maxLevel) {
+        newLevel = gov.level + 1;
+    }
+    else if (gov.fastFrames >= upgradeAfter && gov.level > 0) {
+        newLevel = gov.level - 1;
+    }
+
+    if (newLevel == gov.level) {
+        return false;
+    }
+
+    char decision[128];
+    snprintf(decision, sizeof(decision), "%s to level %d (avg %.1f ms, target %.1f ms)",
+        newLevel > gov.level ? "degraded" : "upgraded", newLevel, gov.avgFrameMs, gov.targetFrameMs);
+    gov.lastDecision = decision;
+
+    gov.level = newLevel;
+    gov.settings = governorSettings(newLevel);
+    gov.slowFrames = 0;
+    gov.fastFrames = 0;
+    gov.holdFrames = holdAfterChange;
+    return true;
+}
+
+void printGovernorStats(const QualityGovernor& gov, double fps) {
+    printf("FPS: %.1f  frame: %.1f ms  governor: %s  level %d  proxy %.2f  detect every %d  threads %d  blur passes %d  %s kernels\n",
+        fps, gov.avgFrameMs, gov.enabled ? "on" : "off", gov.level, gov.settings.proxyScale,
+        gov.settings.faceDetectEvery, gov.settings.filterThreads, gov.settings.blurPasses,
+        gov.settings.fastKernels ? "fast" : "reference");
+    printf("Last governor decision: %s\n", gov.lastDecision.c_str());
+}
@@ -0,0 +1,38 @@
+// File: qualityGovernor.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 2, 2024
+// Frame-rate governor that trades processing quality for speed in the live loop
+
+#pragma once
+#include <string>
+
+// The knobs the governor is allowed to turn, one set per quality level
+struct QualitySettings {
+    float proxyScale;     // processing resolution relative to the captured frame
+    int faceDetectEvery;  // run the face cascade on every Nth frame, reuse the faces in between
+    int filterThreads;    // thread count handed to cv::setNumThreads
+    int blurPasses;       // box passes used by fastGaussianBlur
+    bool fastKernels;     // swap the reference kernels for their cheaper variants
+};
+
+struct QualityGovernor {
+    bool enabled;
+    double targetFrameMs;  // processing budget per frame
+    double avgFrameMs;     // exponential moving average of the processing time
+    int level;             // 0 is full quality, higher levels are cheaper
+    int slowFrames;        // consecutive frames over budget
+    int fastFrames;        // consecutive frames comfortably under budget
+    int holdFrames;        // frames left before another decision is allowed
+    QualitySettings settings;
+    std::string lastDecision;
+};
+
+void initGovernor(QualityGovernor& gov, double targetFps);
+
+// Feed the processing time of the last frame, returns true when the quality level changed
+bool updateGovernor(QualityGovernor& gov, double frameMs);
+
+QualitySettings governorSettings(int level);
+int governorMaxLevel();
+
+void printGovernorStats(const QualityGovernor& gov, double fps);
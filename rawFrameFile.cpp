@@ -0,0 +1,227 @@
+// File: rawFrameFile.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 7, 2024
+// Writer and memory-mapped reader for the raw frame container described in rawFrameFile.h
+
+#include <cstring>
+#include "rawFrameFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char rawFrameMagic[8] = { 'V', 'F', 'X', 'R', 'A', 'W', '1', '\0' };
+
+// Round a byte count up to the next multiple of the frame alignment
+static uint64_t alignUp(uint64_t bytes) {
+    return (bytes + RAW_FRAME_ALIGNMENT - 1) / RAW_FRAME_ALIGNMENT * RAW_FRAME_ALIGNMENT;
+}
+
+RawFrameWriter::RawFrameWriter() : file(NULL), failed(false) {
+    memset(&header, 0, sizeof(header));
+}
+
+RawFrameWriter::~RawFrameWriter() {
+    close();
+}
+
+bool RawFrameWriter::open(const std::string& path, cv::Size size, int type, double fps) {
+    close();
+
+    file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, rawFrameMagic, sizeof(rawFrameMagic));
+    header.headerSize = sizeof(RawFrameHeader);
+    header.width = size.width;
+    header.height = size.height;
+    header.type = type;
+    header.frameBytes = (uint64_t)size.width * size.height * CV_ELEM_SIZE(type);
+    header.frameStride = alignUp(header.frameBytes);
+    header.dataOffset = alignUp(sizeof(RawFrameHeader));
+    header.frameCount = 0;
+    header.fps = fps;
+
+    // The header page is written now with a zero count and patched in close()
+    padding.assign(RAW_FRAME_ALIGNMENT, 0);
+    size_t headerPadding = header.dataOffset - sizeof(header);
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(padding.data(), 1, headerPadding, file) != headerPadding) {
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool RawFrameWriter::write(const cv::Mat& frame) {
+    if (file == NULL || frame.cols != header.width || frame.rows != header.height || frame.type() != header.type) {
+        return false;
+    }
+
+    // Rows are written one at a time so ROIs and padded images are packed as well
+    size_t rowBytes = (size_t)frame.cols * frame.elemSize();
+    bool ok;
+    if (frame.isContinuous()) {
+        ok = fwrite(frame.data, 1, header.frameBytes, file) == header.frameBytes;
+    }
+    else {
+        ok = true;
+        for (int y = 0; y < frame.rows && ok; ++y) {
+            ok = fwrite(frame.ptr(y), 1, rowBytes, file) == rowBytes;
+        }
+    }
+    size_t framePadding = header.frameStride - header.frameBytes;
+    ok = ok && fwrite(padding.data(), 1, framePadding, file) == framePadding;
+
+    // A partly written frame isn't counted, the reader stops before it
+    if (!ok) {
+        failed = true;
+        return false;
+    }
+    header.frameCount++;
+    return true;
+}
+
+bool RawFrameWriter::close() {
+    bool ok = !failed;
+    if (file != NULL) {
+        ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1 && ok;
+        ok = fclose(file) == 0 && ok;
+        file = NULL;
+    }
+    failed = false;
+    return ok;
+}
+
+#ifdef _WIN32
+RawFrameReader::RawFrameReader() : base(NULL), mappedBytes(0), fileHandle(NULL), mappingHandle(NULL) {
+    memset(&header, 0, sizeof(header));
+}
+#else
+RawFrameReader::RawFrameReader() : base(NULL), mappedBytes(0), fd(-1) {
+    memset(&header, 0, sizeof(header));
+}
+#endif
+
+RawFrameReader::~RawFrameReader() {
+    close();
+}
+
+bool RawFrameReader::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedBytes = (size_t)fileSize.QuadPart;
+    base = (uchar*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (base == NULL) {
+        close();
+        return false;
+    }
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(RawFrameHeader)) {
+        close();
+        return false;
+    }
+    mappedBytes = (size_t)st.st_size;
+
+    // Private writable mapping: pages are shared with the page cache until something draws into them
+    void* mapped = mmap(NULL, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close();
+        return false;
+    }
+    base = (uchar*)mapped;
+    madvise(mapped, mappedBytes, MADV_SEQUENTIAL);
+#endif
+
+    if (mappedBytes < sizeof(RawFrameHeader)) {
+        close();
+        return false;
+    }
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, rawFrameMagic, sizeof(rawFrameMagic)) != 0 || header.headerSize != sizeof(RawFrameHeader) ||
+        header.width <= 0 || header.height <= 0 || header.type < 0 || header.type != CV_MAT_TYPE(header.type)) {
+        close();
+        return false;
+    }
+
+    // The frames have to be as large as their size and type say and start after the header, inside
+    // the file, or the views would reach past the mapping. The padding after a frame is less than a
+    // page, so the frame count below can't overflow either.
+    uint64_t pixels = (uint64_t)header.width * (uint64_t)header.height;
+    uint64_t packedBytes = pixels * CV_ELEM_SIZE(header.type);
+    if (packedBytes / pixels != (uint64_t)CV_ELEM_SIZE(header.type) || header.frameBytes != packedBytes ||
+        header.frameStride < header.frameBytes || header.frameStride - header.frameBytes >= RAW_FRAME_ALIGNMENT ||
+        header.dataOffset < sizeof(RawFrameHeader) || header.dataOffset > mappedBytes) {
+        close();
+        return false;
+    }
+
+    // A writer that didn't close leaves a zero count, trust the file size in that case
+    uint64_t framesInFile = mappedBytes > header.dataOffset ? (mappedBytes - header.dataOffset + header.frameStride - header.frameBytes) / header.frameStride : 0;
+    if (header.frameCount == 0 || header.frameCount > framesInFile) {
+        header.frameCount = framesInFile;
+    }
+    return true;
+}
+
+void RawFrameReader::close() {
+#ifdef _WIN32
+    if (base != NULL) {
+        UnmapViewOfFile(base);
+    }
+    if (mappingHandle != NULL) {
+        CloseHandle((HANDLE)mappingHandle);
+    }
+    if (fileHandle != NULL) {
+        CloseHandle((HANDLE)fileHandle);
+    }
+    mappingHandle = NULL;
+    fileHandle = NULL;
+#else
+    if (base != NULL) {
+        munmap(base, mappedBytes);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    fd = -1;
+#endif
+    base = NULL;
+    mappedBytes = 0;
+    memset(&header, 0, sizeof(header));
+}
+
+cv::Mat RawFrameReader::frame(uint64_t i) const {
+    if (base == NULL || i >= header.frameCount) {
+        return cv::Mat();
+    }
+    uchar* data = base + header.dataOffset + i * header.frameStride;
+    return cv::Mat(header.height, header.width, header.type, data);
+}
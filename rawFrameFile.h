@@ -0,0 +1,86 @@
+// File: rawFrameFile.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 7, 2024
+// Raw frame container for replaying captured sessions without any decoding.
+//
+// Layout: one page holding the header, then every frame starting on a page boundary.
+// All frames share the size and type recorded in the header.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Page size used for the alignment of the frames inside the file
+#define RAW_FRAME_ALIGNMENT 4096
+
+struct RawFrameHeader {
+    char magic[8];         // "VFXRAW1\0"
+    uint32_t headerSize;   // sizeof(RawFrameHeader), for forward compatibility
+    int32_t width;
+    int32_t height;
+    int32_t type;          // OpenCV type, e.g. CV_8UC3
+    uint64_t frameBytes;   // bytes of pixel data per frame, rows packed without padding
+    uint64_t frameStride;  // distance between consecutive frames, a multiple of RAW_FRAME_ALIGNMENT
+    uint64_t dataOffset;   // offset of the first frame
+    uint64_t frameCount;   // patched when the writer is closed
+    double fps;            // nominal frame rate of the capture
+};
+
+// Writes frames of a single size and type into a raw frame file
+class RawFrameWriter {
+public:
+    RawFrameWriter();
+    ~RawFrameWriter();
+
+    // Returns false if the file can't be created
+    bool open(const std::string& path, cv::Size size, int type, double fps);
+
+    // Returns false if the frame doesn't match the size and type given to open, or the write failed
+    bool write(const cv::Mat& frame);
+
+    // Patch the frame count into the header and close the file. Returns false if a write failed
+    // since open.
+    bool close();
+
+    bool isOpen() const { return file != NULL; }
+    uint64_t framesWritten() const { return header.frameCount; }
+
+private:
+    FILE* file;
+    RawFrameHeader header;
+    std::vector<char> padding;
+    bool failed;
+};
+
+// Memory-maps a raw frame file and hands out zero-copy views of its frames
+class RawFrameReader {
+public:
+    RawFrameReader();
+    ~RawFrameReader();
+
+    // Returns false if the file can't be mapped or its header is invalid or doesn't fit the file
+    bool open(const std::string& path);
+    void close();
+
+    // View of frame i, the data stays valid until the reader is closed. The file is mapped
+    // copy-on-write, so drawing into a view never touches the file.
+    cv::Mat frame(uint64_t i) const;
+
+    uint64_t frameCount() const { return header.frameCount; }
+    cv::Size frameSize() const { return cv::Size(header.width, header.height); }
+    int frameType() const { return header.type; }
+    double fps() const { return header.fps; }
+
+private:
+    RawFrameHeader header;
+    uchar* base;
+    size_t mappedBytes;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fd;
+#endif
+};
@@ -0,0 +1,66 @@
+// File: seqLock.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 19, 2024
+// Sequence lock publishing a small trivially copyable value. Readers never block or write
+// shared memory: they copy the value and retry in the rare case a writer was busy meanwhile.
+// Writers must be serialized by the caller.
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock values are copied word by word");
+    static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+    explicit SeqLock(const T& value = T()) : sequence(0) {
+        for (size_t i = 0; i < WORDS; i++) {
+            data[i].store(0, std::memory_order_relaxed);
+        }
+        store(value);
+    }
+
+    void store(const T& value) {
+        uint64_t words[WORDS] = {};
+        memcpy(words, &value, sizeof(T));
+
+        // An odd sequence tells readers a write is in progress
+        uint64_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++) {
+            data[i].store(words[i], std::memory_order_relaxed);
+        }
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    T load() const {
+        uint64_t words[WORDS];
+        uint64_t before, after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++) {
+                words[i] = data[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) != 0 || before != after);
+
+        T value;
+        memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    // Number of stores so far, cheap way for a reader to see if anything changed
+    uint64_t version() const {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> data[WORDS];
+};
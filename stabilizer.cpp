@@ -0,0 +1,302 @@
+// File: stabilizer.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 24, 2024
+// Motion estimation, path smoothing and warping of the stabilization stage, see stabilizer.h
+
+#include <algorithm>
+#include <cmath>
+#include "perfCounters.h"
+#include "stabilizer.h"
+
+void initStabilizer(StabilizerState& state, int window, double margin, double maxAngle) {
+    state.window = std::max(window, 2);
+    state.margin = margin;
+    state.maxAngle = maxAngle;
+    state.previous.release();
+    state.frameSize = cv::Size();
+    state.position = cv::Vec3d(0, 0, 0);
+    state.path.clear();
+    state.transform.release();
+    state.frames = 0;
+    state.fallbacks = 0;
+    state.resets = 0;
+}
+
+// Size of the small copy of a frame of this size, scale is its size over the frame's
+static cv::Size workSize(cv::Size frameSize, double& scale) {
+    scale = std::min(1.0, (double)STABILIZER_WORK_WIDTH / std::max(frameSize.width, 1));
+    return cv::Size(std::max(1, cvRound(frameSize.width * scale)), std::max(1, cvRound(frameSize.height * scale)));
+}
+
+// Reduce image, the frame or a pyramid level of it, to size and convert it to grey
+static void reduceToGrey(const cv::Mat& image, cv::Size size, cv::Mat& small) {
+    static thread_local cv::Mat reduced;
+
+    // Reduce before converting, so only the small image goes through cvtColor
+    const cv::Mat* input = &image;
+    if (size != image.size()) {
+        cv::resize(image, reduced, size, 0, 0, cv::INTER_AREA);
+        input = &reduced;
+    }
+    if (input->channels() == 3) {
+        cv::cvtColor(*input, small, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        input->copyTo(small);
+    }
+}
+
+void stabilizerInput(const cv::Mat& frame, cv::Mat& small, double& scale) {
+    reduceToGrey(frame, workSize(frame.size(), scale), small);
+}
+
+void stabilizerInput(ImagePyramid& pyramid, cv::Mat& small, double& scale) {
+    cv::Size size = workSize(pyramid.levels[0].size(), scale);
+    reduceToGrey(pyramidLevel(pyramid, pyramidLevelFor(pyramid, size)), size, small);
+}
+
+// Motion of the content from previous to current: rotation about the image centre and the
+// translation that follows it, in small image pixels
+static bool estimateMotion(const cv::Mat& previous, const cv::Mat& current, cv::Vec3d& motion, bool& fallback) {
+    std::vector<cv::Point2f> from, to;
+    cv::goodFeaturesToTrack(previous, from, 200, 0.01, 8);
+    if (from.size() >= 10) {
+        std::vector<uchar> status;
+        std::vector<float> error;
+        cv::calcOpticalFlowPyrLK(previous, current, from, to, status, error, cv::Size(21, 21), 2);
+        size_t kept = 0;
+        for (size_t i = 0; i < from.size(); i++) {
+            if (status[i]) {
+                from[kept] = from[i];
+                to[kept] = to[i];
+                kept++;
+            }
+        }
+        from.resize(kept);
+        to.resize(kept);
+
+        // Rotation, translation and a scale we ignore, robust against things moving in the scene
+        if (kept >= 10) {
+            cv::Mat m = cv::estimateAffinePartial2D(from, to, cv::noArray(), cv::RANSAC, 1.0);
+            if (!m.empty()) {
+                double angle = std::atan2(m.at<double>(1, 0), m.at<double>(0, 0));
+                double c = std::cos(angle), s = std::sin(angle);
+                double cx = previous.cols * 0.5, cy = previous.rows * 0.5;
+                motion = cv::Vec3d(m.at<double>(0, 2) + c * cx - s * cy - cx, m.at<double>(1, 2) + s * cx + c * cy - cy, angle);
+                fallback = false;
+                return true;
+            }
+        }
+    }
+
+    // Too little texture for corners: translation only, from the phase correlation peak
+    cv::Mat a, b;
+    previous.convertTo(a, CV_32F);
+    current.convertTo(b, CV_32F);
+    double response = 0.0;
+    cv::Point2d shift = cv::phaseCorrelate(a, b, cv::noArray(), &response);
+    fallback = true;
+    if (response < 0.1) {
+        return false;
+    }
+    motion = cv::Vec3d(shift.x, shift.y, 0.0);
+    return true;
+}
+
+// Value at the newest frame of the least squares line through the path
+static cv::Vec3d fitPath(const std::deque<cv::Vec3d>& path) {
+    double n = (double)path.size();
+    if (path.size() < 3) {
+        return path.back();
+    }
+    double sumT = 0.0, sumTT = 0.0;
+    cv::Vec3d sumV(0, 0, 0), sumTV(0, 0, 0);
+    for (size_t i = 0; i < path.size(); i++) {
+        double t = (double)i;
+        sumT += t;
+        sumTT += t * t;
+        sumV += path[i];
+        sumTV += path[i] * t;
+    }
+    double denominator = n * sumTT - sumT * sumT;
+    double last = n - 1.0;
+    cv::Vec3d fitted;
+    for (int k = 0; k < 3; k++) {
+        double slope = (n * sumTV[k] - sumT * sumV[k]) / denominator;
+        double intercept = (sumV[k] - slope * sumT) / n;
+        fitted[k] = intercept + slope * last;
+    }
+    return fitted;
+}
+
+// Rotate about the centre and shift by the correction, then zoom about the centre so the
+// borders the correction uncovers stay outside the frame
+static void buildTransform(StabilizerState& state, const cv::Vec3d& correction) {
+    double zoom = 1.0 / (1.0 - 2.0 * state.margin);
+    double cx = state.frameSize.width * 0.5, cy = state.frameSize.height * 0.5;
+    double c = std::cos(correction[2]) * zoom, s = std::sin(correction[2]) * zoom;
+    state.transform.create(2, 3, CV_64F);
+    double* m = state.transform.ptr<double>(0);
+    m[0] = c;
+    m[1] = -s;
+    m[2] = cx - c * cx + s * cy + zoom * correction[0];
+    m[3] = s;
+    m[4] = c;
+    m[5] = cy - s * cx - c * cy + zoom * correction[1];
+}
+
+int updateStabilizer(StabilizerState& state, const cv::Mat& small, double scale, cv::Size frameSize) {
+    int result = 0;
+    if (frameSize != state.frameSize || state.previous.size() != small.size()) {
+        state.frameSize = frameSize;
+        state.position = cv::Vec3d(0, 0, 0);
+        state.path.clear();
+    }
+    else {
+        cv::Vec3d motion;
+        bool fallback = false;
+        if (estimateMotion(state.previous, small, motion, fallback)) {
+            state.position += cv::Vec3d(motion[0] / scale, motion[1] / scale, motion[2]);
+        }
+        else {
+            // A cut or a blank frame, the old path means nothing for the new scene
+            state.position = cv::Vec3d(0, 0, 0);
+            state.path.clear();
+            state.resets++;
+            result = -1;
+        }
+        state.fallbacks += fallback ? 1 : 0;
+    }
+    small.copyTo(state.previous);
+    state.frames++;
+
+    state.path.push_back(state.position);
+    while ((int)state.path.size() > state.window) {
+        state.path.pop_front();
+    }
+
+    // Move the content from where the shaky path has it to the smooth path, within the margins
+    cv::Vec3d correction = fitPath(state.path) - state.position;
+    double maxX = state.margin * frameSize.width, maxY = state.margin * frameSize.height;
+    correction[0] = std::max(-maxX, std::min(maxX, correction[0]));
+    correction[1] = std::max(-maxY, std::min(maxY, correction[1]));
+    correction[2] = std::max(-state.maxAngle, std::min(state.maxAngle, correction[2]));
+    buildTransform(state, correction);
+    return result;
+}
+
+int warpStabilized(const StabilizerState& state, const cv::Mat& src, cv::Mat& dst, cv::Size dstSize) {
+    if (src.empty() || state.transform.empty() || src.size() != state.frameSize) {
+        return -1;
+    }
+    if (dstSize.area() == 0 || dstSize == src.size()) {
+        cv::warpAffine(src, dst, state.transform, src.size(), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+        return 0;
+    }
+
+    // Scaling folded into the warp, so a proxy frame is stabilized and upscaled in one pass
+    cv::Mat scaled = state.transform.clone();
+    double* m = scaled.ptr<double>(0);
+    double sx = (double)dstSize.width / src.cols, sy = (double)dstSize.height / src.rows;
+    for (int i = 0; i < 3; i++) {
+        m[i] *= sx;
+        m[3 + i] *= sy;
+    }
+    cv::warpAffine(src, dst, scaled, dstSize, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    return 0;
+}
+
+int stabilize(StabilizerState& state, const cv::Mat& src, cv::Mat& dst) {
+    if (src.empty()) {
+        return -1;
+    }
+    cv::Mat small;
+    double scale;
+    stabilizerInput(src, small, scale);
+    updateStabilizer(state, small, scale, src.size());
+    return warpStabilized(state, src, dst);
+}
+
+StabilizerEngine::StabilizerEngine() : scale(1.0), running(false), stopping(false) {
+    initStabilizer(state);
+    worker = std::thread(&StabilizerEngine::workerLoop, this);
+}
+
+StabilizerEngine::~StabilizerEngine() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        waitIdle(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void StabilizerEngine::waitIdle(std::unique_lock<std::mutex>& lock) {
+    done.wait(lock, [this] { return !running; });
+}
+
+void StabilizerEngine::begin(const cv::Mat& frame) {
+    cv::Mat next;
+    double nextScale;
+    stabilizerInput(frame, next, nextScale);
+    start(next, nextScale, frame.size());
+}
+
+void StabilizerEngine::begin(ImagePyramid& pyramid) {
+    cv::Mat next;
+    double nextScale;
+    stabilizerInput(pyramid, next, nextScale);
+    start(next, nextScale, pyramid.levels[0].size());
+}
+
+void StabilizerEngine::start(const cv::Mat& next, double nextScale, cv::Size nextFrameSize) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        waitIdle(lock);
+        small = next;
+        scale = nextScale;
+        frameSize = nextFrameSize;
+        running = true;
+    }
+    wake.notify_one();
+}
+
+int StabilizerEngine::warp(const cv::Mat& src, cv::Mat& dst, cv::Size dstSize) {
+    std::unique_lock<std::mutex> lock(mutex);
+    waitIdle(lock);
+    return warpStabilized(state, src, dst, dstSize);
+}
+
+void StabilizerEngine::reset() {
+    std::unique_lock<std::mutex> lock(mutex);
+    waitIdle(lock);
+    if (state.frames > 0) {
+        initStabilizer(state, state.window, state.margin, state.maxAngle);
+    }
+}
+
+StabilizerState StabilizerEngine::snapshot() {
+    std::unique_lock<std::mutex> lock(mutex);
+    waitIdle(lock);
+    return state;
+}
+
+void StabilizerEngine::workerLoop() {
+    excludeThreadFromProfiling();
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return running || stopping; });
+        if (stopping) {
+            return;
+        }
+
+        // Only this thread touches the state while running is set
+        lock.unlock();
+        updateStabilizer(state, small, scale, frameSize);
+        lock.lock();
+
+        running = false;
+        done.notify_all();
+    }
+}
@@ -0,0 +1,95 @@
+// File: stabilizer.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 24, 2024
+// Video stabilization. The motion between consecutive frames (translation and rotation) is
+// estimated on a small grey copy of the frame from tracked corners, with phase correlation as the
+// fallback for frames without enough texture. The accumulated camera path is smoothed by a line
+// fitted through the last frames, which removes the shake but follows steady pans without lag,
+// and each frame is warped once by the difference, zoomed slightly to keep the borders hidden.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "imagePyramid.h"
+
+// Width of the grey copy the motion is estimated on
+#define STABILIZER_WORK_WIDTH 320
+
+struct StabilizerState {
+    int window;                         // frames the camera path is smoothed over
+    double margin;                      // share of the frame size a correction may shift it by
+    double maxAngle;                    // largest rotation a correction may apply, radians
+
+    cv::Mat previous;                   // small grey copy of the last frame
+    cv::Size frameSize;                 // size of the frames being stabilized
+    cv::Vec3d position;                 // accumulated x, y and angle of the camera path
+    std::deque<cv::Vec3d> path;         // the last window positions
+    cv::Mat transform;                  // 2x3 CV_64F warp of the newest frame
+    long long frames;
+    long long fallbacks;                // frames estimated by phase correlation
+    long long resets;                   // frames whose motion couldn't be estimated at all
+};
+
+void initStabilizer(StabilizerState& state, int window = 30, double margin = 0.05, double maxAngle = 0.05);
+
+// The small grey copy of frame the motion is estimated on, scale is its size over the frame's
+void stabilizerInput(const cv::Mat& frame, cv::Mat& small, double& scale);
+
+// The same from the pyramid of the frame (BGR or grey), reduced from its smallest level that is
+// still STABILIZER_WORK_WIDTH wide instead of from the frame
+void stabilizerInput(ImagePyramid& pyramid, cv::Mat& small, double& scale);
+
+// Estimate the motion from the previous small frame to this one and update the warp of the
+// frame, see state.transform. Returns -1 if the motion couldn't be estimated; the path then
+// starts over and the frame is only zoomed.
+int updateStabilizer(StabilizerState& state, const cv::Mat& small, double scale, cv::Size frameSize);
+
+// Warp src (the size of the frames given to updateStabilizer) by the current transform. A
+// dstSize other than the frame size scales in the same pass, e.g. a proxy frame to the display.
+int warpStabilized(const StabilizerState& state, const cv::Mat& src, cv::Mat& dst, cv::Size dstSize = cv::Size());
+
+// All of the above for one frame, on the calling thread
+int stabilize(StabilizerState& state, const cv::Mat& src, cv::Mat& dst);
+
+// Runs the estimation on a worker thread while the filters work on the frame. begin() takes the
+// small copy on the calling thread, so the frame may be changed right after it returns.
+class StabilizerEngine {
+public:
+    StabilizerEngine();
+    ~StabilizerEngine();
+
+    // Start estimating the motion of frame
+    void begin(const cv::Mat& frame);
+
+    // The same, taking the small copy from the pyramid of the frame
+    void begin(ImagePyramid& pyramid);
+
+    // Warp an image of the frame given to begin, e.g. the filtered frame, waiting for the estimate
+    int warp(const cv::Mat& src, cv::Mat& dst, cv::Size dstSize = cv::Size());
+
+    // Forget the camera path, e.g. when stabilization was off for a while
+    void reset();
+
+    // Copy of the state after the last estimate
+    StabilizerState snapshot();
+
+private:
+    void start(const cv::Mat& next, double nextScale, cv::Size nextFrameSize);
+    void workerLoop();
+    void waitIdle(std::unique_lock<std::mutex>& lock);
+
+    StabilizerState state;
+    cv::Mat small;              // small copy of the frame being estimated
+    double scale;
+    cv::Size frameSize;
+    bool running;               // the worker is estimating
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::thread worker;
+};
@@ -0,0 +1,237 @@
+// File: streamHost.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 12, 2024
+// Multi-stream host: one capture thread per feed and a shared pool of processing workers.
+// Workers always pick the waiting stream with the fewest processed frames, so a heavy chain
+// can't starve the others. The cascade text and the sprite cache are shared by all streams.
+
+#include <chrono>
+#include "streamHost.h"
+
+StreamHost::StreamHost(int workerCount) : workerCount(std::max(1, workerCount)), stopping(false), reportStart(0) {
+}
+
+StreamHost::~StreamHost() {
+    stopping = true;
+    workReady.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (HostedStream* stream : streams) {
+        if (stream->captureThread.joinable()) {
+            stream->captureThread.join();
+        }
+        delete stream->source;
+        delete stream;
+    }
+}
+
+bool StreamHost::addStream(const StreamConfig& config, bool paced) {
+    FrameSource* source = openFrameSource(config.source, paced);
+    if (source == NULL) {
+        return false;
+    }
+
+    HostedStream* stream = new HostedStream();
+    stream->config = config;
+    stream->source = source;
+    stream->pendingTick = 0;
+    stream->busy = false;
+    stream->finished = false;
+    stream->framesProcessed = 0;
+    stream->framesDropped = 0;
+    stream->latencySumMs = 0.0;
+    stream->latencyMaxMs = 0.0;
+    stream->reportFrames = 0;
+    stream->reportLatencyMs = 0.0;
+    streams.push_back(stream);
+    return true;
+}
+
+// Capture thread of one stream. Live sources replace a frame nobody took yet (and count it as
+// dropped) so latency stays bounded; with an unpaced source the thread waits for the slot to
+// empty instead, so every frame is processed and the pipeline runs as fast as the workers allow.
+void StreamHost::captureLoop(HostedStream* stream, long long maxFrames) {
+    bool waitForSlot = !stream->source->isLive();
+    long long captured = 0;
+
+    while (!stopping) {
+        if (maxFrames > 0 && captured >= maxFrames) {
+            break;
+        }
+
+        cv::Mat frame;
+        if (!stream->source->read(frame)) {
+            break;
+        }
+        int64 tick = cv::getTickCount();
+        captured++;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (waitForSlot) {
+            workReady.wait(lock, [&] { return stopping || stream->pending.empty(); });
+        }
+        if (!stream->pending.empty()) {
+            stream->framesDropped++;
+        }
+        stream->pending = frame;
+        stream->pendingTick = tick;
+        lock.unlock();
+        workReady.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stream->finished = true;
+    workReady.notify_all();
+}
+
+// Pick the waiting stream that has processed the fewest frames, called with the mutex held
+HostedStream* StreamHost::takeWork(cv::Mat& frame, int64& tick) {
+    HostedStream* best = NULL;
+    for (HostedStream* stream : streams) {
+        if (!stream->busy && !stream->pending.empty() &&
+            (best == NULL || stream->framesProcessed < best->framesProcessed)) {
+            best = stream;
+        }
+    }
+    if (best != NULL) {
+        best->busy = true;
+        frame = best->pending;
+        tick = best->pendingTick;
+        best->pending = cv::Mat();
+    }
+    return best;
+}
+
+void StreamHost::workerLoop() {
+    cv::Mat frame, output;
+    for (;;) {
+        HostedStream* stream = NULL;
+        int64 tick = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workReady.wait(lock, [&] {
+                if (stopping) {
+                    return true;
+                }
+                stream = takeWork(frame, tick);
+                if (stream != NULL) {
+                    return true;
+                }
+                // Done once every stream is finished and drained
+                for (HostedStream* s : streams) {
+                    if (!s->finished || !s->pending.empty() || s->busy) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+            if (stream == NULL) {
+                return;
+            }
+        }
+        // Wake the capture thread waiting for this slot
+        workReady.notify_all();
+
+        applyEffectChain(stream->config.chain, frame, output, stream->context);
+        double latencyMs = (cv::getTickCount() - tick) * 1000.0 / cv::getTickFrequency();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::swap(stream->output, output);
+            stream->busy = false;
+            stream->framesProcessed++;
+            stream->latencySumMs += latencyMs;
+            stream->latencyMaxMs = std::max(stream->latencyMaxMs, latencyMs);
+            stream->reportFrames++;
+            stream->reportLatencyMs += latencyMs;
+        }
+        workReady.notify_all();
+    }
+}
+
+void StreamHost::run(long long maxFrames, double seconds, double reportSeconds) {
+    // Parallelism comes from running streams side by side, so each filter runs single-threaded
+    cv::setNumThreads(1);
+
+    stopping = false;
+    reportStart = cv::getTickCount();
+    int64 runStart = reportStart;
+    for (HostedStream* stream : streams) {
+        stream->captureThread = std::thread(&StreamHost::captureLoop, this, stream, maxFrames);
+    }
+    for (int i = 0; i < workerCount; i++) {
+        workers.push_back(std::thread(&StreamHost::workerLoop, this));
+    }
+
+    // Report until everything is done or the time is up
+    int64 lastReport = runStart;
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        double elapsed = (cv::getTickCount() - runStart) / cv::getTickFrequency();
+
+        bool allDone = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (HostedStream* stream : streams) {
+                if (!stream->finished || !stream->pending.empty() || stream->busy) {
+                    allDone = false;
+                }
+            }
+        }
+        if (allDone || (seconds > 0.0 && elapsed >= seconds)) {
+            break;
+        }
+        if (reportSeconds > 0.0 && (cv::getTickCount() - lastReport) / cv::getTickFrequency() >= reportSeconds) {
+            printStats();
+            lastReport = cv::getTickCount();
+        }
+    }
+
+    stopping = true;
+    workReady.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    for (HostedStream* stream : streams) {
+        stream->captureThread.join();
+    }
+    cv::setNumThreads(-1);
+}
+
+std::vector<StreamStats> StreamHost::collectStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    double elapsed = std::max((cv::getTickCount() - reportStart) / cv::getTickFrequency(), 1e-9);
+    reportStart = cv::getTickCount();
+
+    std::vector<StreamStats> stats;
+    for (HostedStream* stream : streams) {
+        StreamStats s;
+        s.framesProcessed = stream->framesProcessed;
+        s.framesDropped = stream->framesDropped;
+        s.fps = stream->reportFrames / elapsed;
+        s.avgLatencyMs = stream->reportFrames > 0 ? stream->reportLatencyMs / stream->reportFrames : 0.0;
+        s.maxLatencyMs = stream->latencyMaxMs;
+        stream->reportFrames = 0;
+        stream->reportLatencyMs = 0.0;
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+void StreamHost::printStats() {
+    std::vector<StreamStats> stats = collectStats();
+    double totalFps = 0.0;
+    for (size_t i = 0; i < stats.size(); i++) {
+        std::string chain;
+        for (const std::string& name : streams[i]->config.chain) {
+            chain += (chain.empty() ? "" : "+") + name;
+        }
+        printf("Stream %zu [%s -> %s]: %.1f fps, latency avg %.1f ms max %.1f ms, %lld frames, %lld dropped\n",
+            i, streams[i]->config.source.c_str(), chain.empty() ? "none" : chain.c_str(), stats[i].fps,
+            stats[i].avgLatencyMs, stats[i].maxLatencyMs, stats[i].framesProcessed, stats[i].framesDropped);
+        totalFps += stats[i].fps;
+    }
+    printf("Total: %.1f fps over %zu streams on %d workers\n", totalFps, stats.size(), workerCount);
+}
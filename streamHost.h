@@ -0,0 +1,80 @@
+// File: streamHost.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 12, 2024
+// Runs several camera or file feeds, each with its own effect chain, on one shared worker pool
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "effectChain.h"
+#include "frameSource.h"
+
+struct StreamConfig {
+    std::string source;              // frame source specification, see frameSource.h
+    std::vector<std::string> chain;  // effects applied to every frame, see effectChain.h
+};
+
+struct StreamStats {
+    long long framesProcessed;
+    long long framesDropped;   // captured frames replaced by a newer one before a worker got to them
+    double fps;                // processed frames per second since the last report
+    double avgLatencyMs;       // capture to end of processing
+    double maxLatencyMs;
+};
+
+// One feed: a capture thread keeps the newest frame in a single slot, the workers process it
+struct HostedStream {
+    StreamConfig config;
+    FrameSource* source;
+    EffectContext context;
+    std::thread captureThread;
+
+    // Guarded by the host mutex
+    cv::Mat pending;          // newest captured frame not yet taken by a worker
+    int64 pendingTick;        // when it was captured
+    cv::Mat output;           // last processed frame
+    bool busy;                // a worker is processing this stream
+    bool finished;            // the source ran out of frames
+    long long framesProcessed;
+    long long framesDropped;
+    double latencySumMs;
+    double latencyMaxMs;
+    long long reportFrames;   // counters since the last report
+    double reportLatencyMs;
+};
+
+class StreamHost {
+public:
+    explicit StreamHost(int workerCount);
+    ~StreamHost();
+
+    // Open the source of a stream, returns false if it can't be opened
+    bool addStream(const StreamConfig& config, bool paced);
+
+    // Run until every source is exhausted, maxFrames frames per stream were captured (0: no
+    // limit; live streams may drop some of them) or seconds have passed (0: no limit).
+    // Per-stream statistics are printed every reportSeconds.
+    void run(long long maxFrames, double seconds, double reportSeconds);
+
+    // Statistics since the last call for each stream
+    std::vector<StreamStats> collectStats();
+    void printStats();
+
+private:
+    void captureLoop(HostedStream* stream, long long maxFrames);
+    void workerLoop();
+    HostedStream* takeWork(cv::Mat& frame, int64& tick);
+
+    int workerCount;
+    std::vector<HostedStream*> streams;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable workReady;
+    std::atomic<bool> stopping;
+    int64 reportStart;
+};
@@ -0,0 +1,223 @@
+// File: stripImage.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 25, 2024
+// PPM/PGM band reader and writer and the band scheduling of the strip streaming, see stripImage.h
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <functional>
+#include "stripImage.h"
+#include "effectChain.h"
+
+// Files of hundreds of megapixels need 64-bit offsets
+static bool seekTo(FILE* file, long long offset) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static long long tellFrom(FILE* file) {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return (long long)ftello(file);
+#endif
+}
+
+// Next number of a PNM header, skipping white space and comments; -1 if there is none
+static long long headerNumber(FILE* file) {
+    int c = fgetc(file);
+    for (;;) {
+        if (c == '#') {
+            while (c != EOF && c != '\n') {
+                c = fgetc(file);
+            }
+        }
+        else if (c != EOF && std::isspace(c)) {
+            c = fgetc(file);
+        }
+        else {
+            break;
+        }
+    }
+    if (c == EOF || !std::isdigit(c)) {
+        return -1;
+    }
+    long long value = 0;
+    while (c != EOF && std::isdigit(c) && value < (1LL << 40)) {
+        value = value * 10 + (c - '0');
+        c = fgetc(file);
+    }
+
+    // A single white space character ends the header, the samples start right after it
+    return c != EOF && std::isspace(c) ? value : -1;
+}
+
+StripReader::StripReader() : file(NULL), width(0), height(0), channels(0), dataOffset(0) {
+}
+
+StripReader::~StripReader() {
+    close();
+}
+
+bool StripReader::open(const std::string& path) {
+    close();
+    file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    char magic[2];
+    if (fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6')) {
+        close();
+        return false;
+    }
+    channels = magic[1] == '6' ? 3 : 1;
+    long long w = headerNumber(file), h = headerNumber(file), maxval = headerNumber(file);
+    if (w <= 0 || h <= 0 || w > INT_MAX / 3 || h > INT_MAX || maxval != 255) {
+        close();
+        return false;
+    }
+    width = (int)w;
+    height = (int)h;
+    dataOffset = tellFrom(file);
+    return true;
+}
+
+void StripReader::close() {
+    if (file != NULL) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+bool StripReader::readRows(int y0, int y1, cv::Mat& rows) {
+    if (file == NULL || y0 < 0 || y1 > height || y0 >= y1) {
+        return false;
+    }
+    static thread_local cv::Mat grey;
+    cv::Mat& target = channels == 3 ? rows : grey;
+    target.create(y1 - y0, width, channels == 3 ? CV_8UC3 : CV_8UC1);
+    size_t bytes = (size_t)(y1 - y0) * width * channels;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!seekTo(file, dataOffset + (long long)y0 * width * channels) || fread(target.data, 1, bytes, file) != bytes) {
+            return false;
+        }
+    }
+
+    // The colour conversion runs outside the lock, so the bands only queue for the file itself
+    cv::cvtColor(target, rows, channels == 3 ? cv::COLOR_RGB2BGR : cv::COLOR_GRAY2BGR);
+    return true;
+}
+
+StripWriter::StripWriter() : file(NULL), width(0), height(0), dataOffset(0), failed(false) {
+}
+
+StripWriter::~StripWriter() {
+    close();
+}
+
+bool StripWriter::open(const std::string& path, cv::Size size) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+    width = size.width;
+    height = size.height;
+    failed = fprintf(file, "P6\n%d %d\n255\n", width, height) < 0;
+    dataOffset = tellFrom(file);
+    return true;
+}
+
+bool StripWriter::writeRows(int y0, const cv::Mat& rows) {
+    if (file == NULL || rows.type() != CV_8UC3 || rows.cols != width || y0 < 0 || y0 + rows.rows > height) {
+        return false;
+    }
+    static thread_local cv::Mat rgb;
+    cv::cvtColor(rows, rgb, cv::COLOR_BGR2RGB);
+    size_t bytes = rgb.total() * rgb.elemSize();
+
+    // Bands may arrive in any order, writing past the end leaves a gap a later band fills
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!seekTo(file, dataOffset + (long long)y0 * width * 3) || fwrite(rgb.data, 1, bytes, file) != bytes) {
+        failed = true;
+    }
+    return !failed;
+}
+
+bool StripWriter::close() {
+    bool ok = !failed;
+    if (file != NULL) {
+        ok = fflush(file) == 0 && ok;
+        ok = fclose(file) == 0 && ok;
+        file = NULL;
+    }
+    failed = false;
+    return ok;
+}
+
+typedef std::function<bool(int y0, int y1, cv::Mat& rows)> RowSource;
+typedef std::function<bool(int y0, const cv::Mat& rows)> RowSink;
+
+// Run the chain over the bands of an image of the given size, in parallel. Each thread takes a
+// run of bands and keeps its effect context and buffers for all of them.
+static int processBands(cv::Size size, const std::vector<std::string>& chain, int bandRows,
+    const RowSource& read, const RowSink& write, StripStats* stats) {
+    int halo = effectChainHaloRows(chain);
+    if (halo < 0 || bandRows < 1 || size.area() == 0) {
+        return -1;
+    }
+    int bands = (size.height + bandRows - 1) / bandRows;
+    if (stats != NULL) {
+        stats->bands = bands;
+        stats->bandRows = bandRows;
+        stats->haloRows = halo;
+        stats->bandBytes = (size_t)std::min(bandRows + 2 * halo, size.height) * size.width * 3;
+    }
+
+    std::atomic<bool> ok(true);
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        EffectContext ctx;
+        cv::Mat input, output;
+        for (int band = range.start; band < range.end && ok; band++) {
+            int y0 = band * bandRows, y1 = std::min(y0 + bandRows, size.height);
+            int r0 = std::max(y0 - halo, 0), r1 = std::min(y1 + halo, size.height);
+            if (!read(r0, r1, input) || applyEffectChain(chain, input, output, ctx) != 0 ||
+                !write(y0, output.rowRange(y0 - r0, y1 - r0))) {
+                ok = false;
+            }
+        }
+    }, std::max(1, std::min(bands, cv::getNumThreads())));
+    return ok ? 0 : -1;
+}
+
+int processImageStrips(const std::string& inputPath, const std::string& outputPath, const std::vector<std::string>& chain,
+    int bandRows, StripStats* stats) {
+    StripReader reader;
+    StripWriter writer;
+    if (effectChainHaloRows(chain) < 0 || !reader.open(inputPath) || !writer.open(outputPath, reader.size())) {
+        return -1;
+    }
+    int result = processBands(reader.size(), chain, bandRows,
+        [&](int y0, int y1, cv::Mat& rows) { return reader.readRows(y0, y1, rows); },
+        [&](int y0, const cv::Mat& rows) { return writer.writeRows(y0, rows); }, stats);
+    return writer.close() ? result : -1;
+}
+
+int processImageBands(const cv::Mat& src, cv::Mat& dst, const std::vector<std::string>& chain, int bandRows, StripStats* stats) {
+    if (src.empty() || src.type() != CV_8UC3 || src.data == dst.data) {
+        return -1;
+    }
+    dst.create(src.size(), CV_8UC3);
+
+    // Bands are views of src, full rows of a continuous image stay continuous
+    return processBands(src.size(), chain, bandRows,
+        [&](int y0, int y1, cv::Mat& rows) { rows = src.rowRange(y0, y1); return true; },
+        [&](int y0, const cv::Mat& rows) { rows.copyTo(dst.rowRange(y0, y0 + rows.rows)); return true; }, stats);
+}
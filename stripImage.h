@@ -0,0 +1,89 @@
+// File: stripImage.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 25, 2024
+// Strip streaming of images too large to hold in memory with their intermediates. The image is
+// processed in horizontal bands, each read with enough rows of context above and below for the
+// effects (see effectChainHaloRows), filtered, and only its own rows written out, so the result
+// is exactly that of the whole image. Bands run in parallel, and memory is bounded by the band
+// size times the number of threads instead of by the image size.
+//
+// Binary PPM (P6) and PGM (P5) files with 8-bit samples are decoded and encoded a band at a time;
+// other formats can only be decoded whole, see processImageBands.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define STRIP_DEFAULT_BAND_ROWS 256
+
+// Reads rows of a binary PPM or PGM file as 8-bit BGR
+class StripReader {
+public:
+    StripReader();
+    ~StripReader();
+
+    // Returns false if the file can't be opened or isn't a P5/P6 file with a maxval of 255
+    bool open(const std::string& path);
+    void close();
+
+    // Rows [y0, y1) as CV_8UC3, grey images are expanded to three channels. Safe to call from
+    // several threads.
+    bool readRows(int y0, int y1, cv::Mat& rows);
+
+    bool isOpen() const { return file != NULL; }
+    cv::Size size() const { return cv::Size(width, height); }
+
+private:
+    FILE* file;
+    std::mutex mutex;
+    int width;
+    int height;
+    int channels;
+    long long dataOffset;
+};
+
+// Writes a binary PPM file from bands of BGR rows given in any order
+class StripWriter {
+public:
+    StripWriter();
+    ~StripWriter();
+
+    // Returns false if the file can't be created
+    bool open(const std::string& path, cv::Size size);
+
+    // Write CV_8UC3 rows starting at row y0. Safe to call from several threads.
+    bool writeRows(int y0, const cv::Mat& rows);
+
+    // Returns false if a write failed since open
+    bool close();
+
+    bool isOpen() const { return file != NULL; }
+
+private:
+    FILE* file;
+    std::mutex mutex;
+    int width;
+    int height;
+    long long dataOffset;
+    bool failed;
+};
+
+struct StripStats {
+    int bands;
+    int bandRows;
+    int haloRows;
+    size_t bandBytes;       // input pixels of the largest band, halo included
+};
+
+// Apply an effect chain to a PPM/PGM file band by band and write the result as a PPM file.
+// Returns -1 if the files can't be read or written or the chain can't run on bands.
+int processImageStrips(const std::string& inputPath, const std::string& outputPath, const std::vector<std::string>& chain,
+    int bandRows = STRIP_DEFAULT_BAND_ROWS, StripStats* stats = NULL);
+
+// The same for an image already in memory: only the intermediates are bounded by the bands.
+// dst must not be src.
+int processImageBands(const cv::Mat& src, cv::Mat& dst, const std::vector<std::string>& chain,
+    int bandRows = STRIP_DEFAULT_BAND_ROWS, StripStats* stats = NULL);
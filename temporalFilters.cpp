@@ -0,0 +1,165 @@
+// File: temporalFilters.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 16, 2024
+// Temporal effects. The per-pixel work runs in the dispatched fixed-point kernels of
+// filterKernels.h, one pass over the frame each, split into row bands.
+
+#include "temporalFilters.h"
+#include "filterKernels.h"
+
+void initFrameHistory(FrameHistory& history, int capacity) {
+    history.slots.assign(std::max(1, capacity), cv::Mat());
+    history.head = -1;
+    history.count = 0;
+}
+
+void pushFrame(FrameHistory& history, const cv::Mat& frame) {
+    // A new frame size invalidates everything stored so far
+    const cv::Mat& newest = history.slots[std::max(history.head, 0)];
+    if (history.count > 0 && (newest.size() != frame.size() || newest.type() != frame.type())) {
+        history.count = 0;
+    }
+
+    history.head = (history.head + 1) % static_cast<int>(history.slots.size());
+    cv::Mat& slot = history.slots[history.head];
+    slot.create(frame.size(), frame.type());
+    frame.copyTo(slot);
+    history.count = std::min(history.count + 1, static_cast<int>(history.slots.size()));
+}
+
+const cv::Mat* historyFrame(const FrameHistory& history, int age) {
+    if (age < 0 || age >= history.count) {
+        return NULL;
+    }
+    int slots = static_cast<int>(history.slots.size());
+    return &history.slots[(history.head - age + slots) % slots];
+}
+
+void initTemporalState(TemporalState& state, int historyFrames) {
+    initFrameHistory(state.history, historyFrames);
+    state.owner = ACCUMULATOR_NONE;
+}
+
+// Make the accumulator ready for the given effect, restarting it from src when another effect
+// used it last or the frame size changed. Returns true when it was restarted.
+static bool claimAccumulator(TemporalState& state, const cv::Mat& src, TemporalAccumulator owner) {
+    int type = CV_MAKETYPE(CV_16U, src.channels());
+    if (state.owner == owner && state.accumulator.size() == src.size() && state.accumulator.type() == type) {
+        return false;
+    }
+
+    state.accumulator.create(src.size(), type);
+    state.owner = owner;
+    const FilterKernels& kernels = filterKernels();
+    const int count = src.cols * src.channels();
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            kernels.fixedScaleRow(state.accumulator.ptr<uint16_t>(y), src.ptr<uchar>(y), count, 256);
+        }
+    });
+    return true;
+}
+
+int motionBlur(cv::Mat& src, cv::Mat& dst, TemporalState& state, float strength) {
+    if (src.empty() || src.depth() != CV_8U || strength < 0.0f || strength >= 1.0f) {
+        return -1; // Invalid source image or strength
+    }
+
+    claimAccumulator(state, src, ACCUMULATOR_MOTION_BLUR);
+    dst.create(src.size(), src.type());
+
+    const FilterKernels& kernels = filterKernels();
+    const int count = src.cols * src.channels();
+    const int alpha = std::max(1, cvRound((1.0f - strength) * 256.0f));
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            kernels.emaRow(state.accumulator.ptr<uint16_t>(y), src.ptr<uchar>(y), dst.ptr<uchar>(y), count, alpha);
+        }
+    });
+    return 0;
+}
+
+int ghostTrails(cv::Mat& src, cv::Mat& dst, TemporalState& state, int spacing) {
+    if (src.empty() || src.depth() != CV_8U || spacing < 1) {
+        return -1; // Invalid source image or spacing
+    }
+
+    // Weights out of 256 of the ghosts, oldest last; the current frame gets the rest
+    static const int ghostWeights[] = { 48, 32, 16 };
+    const int ghostCount = sizeof(ghostWeights) / sizeof(ghostWeights[0]);
+    if (static_cast<int>(state.history.slots.size()) <= ghostCount * spacing) {
+        initFrameHistory(state.history, ghostCount * spacing + 1);
+    }
+    pushFrame(state.history, src);
+
+    const cv::Mat* ghosts[ghostCount];
+    int currentWeight = 256;
+    for (int i = 0; i < ghostCount; i++) {
+        ghosts[i] = historyFrame(state.history, (i + 1) * spacing);
+        if (ghosts[i] != NULL) {
+            currentWeight -= ghostWeights[i];
+        }
+    }
+
+    // The accumulator is only scratch space here
+    state.accumulator.create(src.size(), CV_MAKETYPE(CV_16U, src.channels()));
+    state.owner = ACCUMULATOR_NONE;
+    dst.create(src.size(), src.type());
+
+    const FilterKernels& kernels = filterKernels();
+    const int count = src.cols * src.channels();
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            uint16_t* acc = state.accumulator.ptr<uint16_t>(y);
+            kernels.fixedScaleRow(acc, src.ptr<uchar>(y), count, currentWeight);
+            for (int i = 0; i < ghostCount; i++) {
+                if (ghosts[i] != NULL) {
+                    kernels.fixedAddScaledRow(acc, ghosts[i]->ptr<uchar>(y), count, ghostWeights[i]);
+                }
+            }
+            kernels.fixedToRow(acc, dst.ptr<uchar>(y), count);
+        }
+    });
+    return 0;
+}
+
+int motionHighlight(cv::Mat& src, cv::Mat& dst, TemporalState& state, int threshold) {
+    if (src.empty() || src.type() != CV_8UC3) {
+        return -1; // Invalid source image
+    }
+
+    pushFrame(state.history, src);
+    const cv::Mat* previous = historyFrame(state.history, 1);
+    if (previous == NULL) {
+        previous = historyFrame(state.history, 0);
+    }
+    dst.create(src.size(), src.type());
+
+    const FilterKernels& kernels = filterKernels();
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            kernels.motionRow(src.ptr<uchar>(y), previous->ptr<uchar>(y), dst.ptr<uchar>(y), src.cols, threshold);
+        }
+    });
+    return 0;
+}
+
+int temporalDenoise(cv::Mat& src, cv::Mat& dst, TemporalState& state, int threshold) {
+    if (src.empty() || src.depth() != CV_8U || threshold < 0) {
+        return -1; // Invalid source image or threshold
+    }
+
+    claimAccumulator(state, src, ACCUMULATOR_DENOISE);
+    dst.create(src.size(), src.type());
+
+    // Static pixels converge over about four frames
+    const FilterKernels& kernels = filterKernels();
+    const int count = src.cols * src.channels();
+    const int alpha = 64;
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            kernels.denoiseRow(state.accumulator.ptr<uint16_t>(y), src.ptr<uchar>(y), dst.ptr<uchar>(y), count, alpha, threshold);
+        }
+    });
+    return 0;
+}
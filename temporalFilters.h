@@ -0,0 +1,53 @@
+// File: temporalFilters.h
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 16, 2024
+// Effects that depend on earlier frames: motion blur, ghost trails, motion highlight and
+// temporal denoise. Their state is allocated for the first frame and reused afterwards, so
+// a running pipeline doesn't allocate; it is only rebuilt when the frame size changes.
+
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Fixed-capacity ring of the most recent frames
+struct FrameHistory {
+    std::vector<cv::Mat> slots;   // preallocated frames, reused in turn
+    int head;                     // slot of the newest frame
+    int count;                    // number of valid frames, up to slots.size()
+};
+
+// Which effect the accumulator currently belongs to, another effect has to restart it
+enum TemporalAccumulator {
+    ACCUMULATOR_NONE,
+    ACCUMULATOR_MOTION_BLUR,
+    ACCUMULATOR_DENOISE,
+};
+
+struct TemporalState {
+    FrameHistory history;
+    cv::Mat accumulator;          // CV_16U, same channels as the frames, 8.8 fixed point
+    TemporalAccumulator owner;
+};
+
+void initFrameHistory(FrameHistory& history, int capacity);
+
+// Copy frame into the oldest slot. The slots are only reallocated when the frame size or type changes.
+void pushFrame(FrameHistory& history, const cv::Mat& frame);
+
+// Frame pushed age frames ago (0 is the newest), NULL if the history isn't that long yet
+const cv::Mat* historyFrame(const FrameHistory& history, int age);
+
+void initTemporalState(TemporalState& state, int historyFrames = 10);
+
+// Exponential motion blur, strength in [0, 1) is the share of the previous result kept each frame
+int motionBlur(cv::Mat& src, cv::Mat& dst, TemporalState& state, float strength = 0.8f);
+
+// Fading copies of the frames spacing, 2 * spacing and 3 * spacing frames back over the current one
+int ghostTrails(cv::Mat& src, cv::Mat& dst, TemporalState& state, int spacing = 3);
+
+// Tint pixels that changed by more than threshold since the previous frame, dim the rest
+int motionHighlight(cv::Mat& src, cv::Mat& dst, TemporalState& state, int threshold = 24);
+
+// Average static pixels over time to remove sensor noise. Values that moved by more than
+// threshold restart from the new frame, so moving objects don't smear.
+int temporalDenoise(cv::Mat& src, cv::Mat& dst, TemporalState& state, int threshold = 12);
@@ -0,0 +1,240 @@
+// File: vfxBench.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 14, 2024
+// Purpose: Time every effect with each filter kernel variant the CPU supports. With --baseline the
+//          timings are compared against stored ones and the run fails when an effect got slower
+//          than the threshold allows; --update-baseline stores the current timings instead. --perf
+//          adds hardware counters per effect and kernel variant, see perfCounters.h. A missing
+//          baseline returns 77, which ctest reports as skipped.
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include "effectChain.h"
+#include "filterKernels.h"
+#include "frameSource.h"
+#include "perfCounters.h"
+
+static void printUsage() {
+    printf("Usage: vfxBench [--isa name|all] [--effects a+b] [--size WxH] [--iterations N] [--threads N] [--perf]\n");
+    printf("                [--baseline file [--update-baseline] [--threshold fraction]] [image]\n");
+    printf("  Without an image a synthetic frame of the given size is used (default 1280x720).\n");
+    printf("  The face and privacy effects are left out unless named with --effects, they need the cascade.\n");
+    printf("  --perf also reports cycles, IPC, cache miss bytes and branch misses per pixel of each effect.\n");
+}
+
+// Median time of one effect in milliseconds. With a profiler the timed calls are also counted
+// under kernel.
+static double timeEffect(const std::string& name, cv::Mat& frame, int iterations, PerfProfiler* profiler, const std::string& kernel) {
+    EffectContext ctx;
+    cv::Mat output;
+
+    // Warm up so buffers are allocated and caches are hot
+    for (int i = 0; i < 2; i++) {
+        applyEffect(name, frame, output, ctx);
+    }
+
+    std::vector<double> times;
+    for (int i = 0; i < iterations; i++) {
+        if (profiler != NULL) {
+            profiler->begin(kernel, (double)frame.total());
+        }
+        int64 start = cv::getTickCount();
+        applyEffect(name, frame, output, ctx);
+        times.push_back((cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency());
+        if (profiler != NULL) {
+            profiler->end();
+        }
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// Stored timings, one "effect,isa,ms" line each
+static bool readBaseline(const std::string& path, std::map<std::string, double>& baseline) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t comma = line.find_last_of(',');
+        if (comma != std::string::npos) {
+            baseline[line.substr(0, comma)] = atof(line.c_str() + comma + 1);
+        }
+    }
+    return true;
+}
+
+static bool writeBaseline(const std::string& path, const std::map<std::string, double>& timings) {
+    std::ofstream file(path);
+    for (const auto& timing : timings) {
+        file << timing.first << "," << timing.second << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+int main(int argc, char* argv[]) {
+    std::string isa = "all";
+    std::string imagePath;
+    std::vector<std::string> effects;
+    std::string size = "1280x720";
+    int iterations = 20;
+    int threads = -1;
+    std::string baselinePath;
+    bool updateBaseline = false;
+    double threshold = 0.25;
+    bool perf = false;
+
+    // Parse the command line
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--isa" && i + 1 < argc) {
+            isa = argv[++i];
+        }
+        else if (arg == "--effects" && i + 1 < argc) {
+            if (!parseEffectChain(argv[++i], effects)) {
+                printf("Unknown effect in %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            size = argv[++i];
+        }
+        else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        }
+        else if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        }
+        else if (arg == "--update-baseline") {
+            updateBaseline = true;
+        }
+        else if (arg == "--threshold" && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        }
+        else if (arg == "--perf") {
+            perf = true;
+        }
+        else if (arg[0] != '-' && imagePath.empty()) {
+            imagePath = arg;
+        }
+        else {
+            printUsage();
+            return -1;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (!baselinePath.empty() && !updateBaseline && !readBaseline(baselinePath, baseline)) {
+        printf("No benchmark baseline in %s, create it with --update-baseline\n", baselinePath.c_str());
+        return 77;
+    }
+
+    if (effects.empty()) {
+        for (const std::string& name : effectNames()) {
+            if (name != "faces" && name != "hearts" && name != "privacy" && name != "privacy-blur") {
+                effects.push_back(name);
+            }
+        }
+    }
+
+    cv::Mat frame;
+    if (!imagePath.empty()) {
+        frame = cv::imread(imagePath);
+    }
+    else {
+        FrameSource* source = openFrameSource("synthetic:" + size + "@30", false);
+        if (source != NULL) {
+            source->read(frame);
+            frame = frame.clone();
+            delete source;
+        }
+    }
+    if (frame.empty()) {
+        printf("Unable to get a frame to benchmark\n");
+        return -1;
+    }
+
+    std::vector<const FilterKernels*> variants;
+    for (const FilterKernels* variant : availableFilterKernels()) {
+        if (isa == "all" || isa == variant->isa) {
+            variants.push_back(variant);
+        }
+    }
+    if (variants.empty()) {
+        printf("Kernel variant %s is not available on this CPU\n", isa.c_str());
+        return -1;
+    }
+
+    cv::setNumThreads(threads);
+    printf("Frame %dx%d, %d iterations, %d threads, median ms per frame\n",
+        frame.cols, frame.rows, iterations, cv::getNumThreads());
+
+    // One column per kernel variant
+    printf("%-12s", "effect");
+    for (const FilterKernels* variant : variants) {
+        printf(" %10s", variant->isa);
+    }
+    printf("\n");
+
+    // The counters are opened before the first effect starts the thread pool; its threads are
+    // picked up as they appear
+    PerfProfiler profiler;
+    if (perf) {
+        profiler.open();
+    }
+
+    std::map<std::string, double> timings;
+    for (const std::string& name : effects) {
+        printf("%-12s", name.c_str());
+        for (const FilterKernels* variant : variants) {
+            selectFilterKernels(variant->isa);
+            double ms = timeEffect(name, frame, iterations, perf ? &profiler : NULL, name + " " + variant->isa);
+            timings[name + "," + variant->isa] = ms;
+            printf(" %10.3f", ms);
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    if (perf) {
+        printf("\n");
+        profiler.print();
+    }
+
+    if (updateBaseline) {
+        if (baselinePath.empty() || !writeBaseline(baselinePath, timings)) {
+            printf("Unable to write the benchmark baseline %s\n", baselinePath.c_str());
+            return -1;
+        }
+        printf("Wrote %zu timings to %s\n", timings.size(), baselinePath.c_str());
+        return 0;
+    }
+
+    // Slower than the baseline by more than the threshold fails. Differences under 0.05 ms are
+    // timer noise on the fast effects and never count.
+    int slower = 0;
+    for (const auto& timing : timings) {
+        auto stored = baseline.find(timing.first);
+        if (stored == baseline.end()) {
+            continue;
+        }
+        double limit = std::max(stored->second * (1.0 + threshold), stored->second + 0.05);
+        if (timing.second > limit) {
+            printf("SLOWER %s: %.3f ms, baseline %.3f ms (+%.0f%%)\n", timing.first.c_str(), timing.second,
+                stored->second, (timing.second / stored->second - 1.0) * 100.0);
+            slower++;
+        }
+    }
+    if (!baseline.empty()) {
+        printf("%d of %zu timings slower than the baseline by more than %.0f%%\n", slower, timings.size(), threshold * 100.0);
+    }
+
+    return slower > 0 ? 1 : 0;
+}
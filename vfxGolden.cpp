@@ -0,0 +1,206 @@
+// File: vfxGolden.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 15, 2024
+// Purpose: Golden-image regression check. --update stores the output of every effect on every
+//          test image, computed with the baseline kernels on one thread. Without it, each kernel
+//          variant is run single-threaded and multi-threaded and compared against those references
+//          with the tolerance of the effect. The test images are the ones named on the command
+//          line, or all images in --images. Returns 1 on a mismatch or a missing reference.
+
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <string>
+#include "effectChain.h"
+#include "filterKernels.h"
+
+// How far an output may drift from its reference: no pixel value may differ by more than maxDiff,
+// and at most maxFraction of the values may differ at all
+struct Tolerance {
+    int maxDiff;
+    double maxFraction;
+};
+
+static Tolerance effectTolerance(const std::string& name) {
+    // cvtColor is OpenCV's own code and may round differently between its builds
+    if (name == "grey") {
+        return { 1, 1.0 };
+    }
+    // exp and pow come from the C library, the truncation can flip on a few pixels
+    if (name == "vignette") {
+        return { 1, 0.001 };
+    }
+    // Everything else is our own integer or exactly rounded code and must not change at all.
+    // quantize blurs with cv::GaussianBlur, whose 8-bit path is bit-exact fixed point.
+    return { 0, 0.0 };
+}
+
+static std::string imageStem(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static std::string goldenPath(const std::string& goldenDir, const std::string& image, const std::string& effect) {
+    return goldenDir + "/" + imageStem(image) + "_" + effect + ".png";
+}
+
+// Compares against the reference, fills the largest difference and the fraction of values that differ
+static bool withinTolerance(const cv::Mat& output, const cv::Mat& golden, const Tolerance& tolerance,
+    double& maxDiff, double& fraction) {
+    if (output.size() != golden.size() || output.type() != golden.type()) {
+        maxDiff = 255;
+        fraction = 1.0;
+        return false;
+    }
+    cv::Mat diff;
+    cv::absdiff(output, golden, diff);
+    diff = diff.reshape(1);
+    cv::minMaxLoc(diff, NULL, &maxDiff);
+    fraction = static_cast<double>(cv::countNonZero(diff)) / diff.total();
+    return maxDiff <= tolerance.maxDiff && fraction <= tolerance.maxFraction;
+}
+
+static void printUsage() {
+    printf("Usage: vfxGolden [--images dir] [--golden dir] [--effects a+b] [--update] [image ...]\n");
+}
+
+int main(int argc, char* argv[]) {
+    std::string imageDir = "Project1_Images";
+    std::string goldenDir = "golden";
+    std::vector<std::string> effects;
+    std::vector<cv::String> files;
+    bool update = false;
+
+    // Parse the command line
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--images" && i + 1 < argc) {
+            imageDir = argv[++i];
+        }
+        else if (arg == "--golden" && i + 1 < argc) {
+            goldenDir = argv[++i];
+        }
+        else if (arg == "--effects" && i + 1 < argc) {
+            if (!parseEffectChain(argv[++i], effects)) {
+                printf("Unknown effect in %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (arg == "--update") {
+            update = true;
+        }
+        else if (arg[0] != '-') {
+            files.push_back(arg);
+        }
+        else {
+            printUsage();
+            return -1;
+        }
+    }
+
+    // The face and privacy effects depend on the cascade, so they aren't part of the references
+    if (effects.empty()) {
+        for (const std::string& name : effectNames()) {
+            if (name != "faces" && name != "hearts" && name != "privacy" && name != "privacy-blur") {
+                effects.push_back(name);
+            }
+        }
+    }
+
+    bool listed = !files.empty();
+    if (!listed) {
+        cv::glob(imageDir + "/*", files);
+    }
+    std::vector<std::string> imagePaths;
+    std::vector<cv::Mat> images;
+    for (const cv::String& file : files) {
+        cv::Mat img = cv::imread(file);
+        if (!img.empty()) {
+            imagePaths.push_back(file);
+            images.push_back(img);
+        }
+    }
+    if (images.empty()) {
+        printf("No test images in %s\n", listed ? "the listed files" : imageDir.c_str());
+        return -1;
+    }
+
+    cv::Mat output;
+
+    // The references are committed, so they are compressed as far as PNG goes
+    if (update) {
+        std::vector<int> pngParams = { cv::IMWRITE_PNG_COMPRESSION, 9 };
+        selectFilterKernels("baseline");
+        cv::setNumThreads(1);
+        int written = 0;
+        for (size_t i = 0; i < images.size(); i++) {
+            // A fresh context per image, so the temporal effects don't depend on the image order
+            EffectContext ctx;
+            for (const std::string& effect : effects) {
+                applyEffect(effect, images[i], output, ctx);
+                std::string path = goldenPath(goldenDir, imagePaths[i], effect);
+                if (!cv::imwrite(path, output, pngParams)) {
+                    printf("Unable to write %s\n", path.c_str());
+                    return -1;
+                }
+                written++;
+            }
+        }
+        printf("Wrote %d reference images to %s\n", written, goldenDir.c_str());
+        return 0;
+    }
+
+    // Load the references once, they are shared by every variant
+    std::vector<std::vector<cv::Mat> > golden(images.size());
+    int found = 0;
+    for (size_t i = 0; i < images.size(); i++) {
+        for (const std::string& effect : effects) {
+            golden[i].push_back(cv::imread(goldenPath(goldenDir, imagePaths[i], effect), cv::IMREAD_UNCHANGED));
+            found += golden[i].back().empty() ? 0 : 1;
+        }
+    }
+    if (found == 0) {
+        printf("No reference images in %s, create them with --update\n", goldenDir.c_str());
+        return 1;
+    }
+
+    int defaultThreads = cv::getNumThreads();
+    int failed = 0, missing = 0, compared = 0;
+    for (const FilterKernels* variant : availableFilterKernels()) {
+        selectFilterKernels(variant->isa);
+        for (int threads : { 1, defaultThreads }) {
+            cv::setNumThreads(threads);
+            int variantFailed = 0;
+            for (size_t i = 0; i < images.size(); i++) {
+                EffectContext ctx;
+                for (size_t e = 0; e < effects.size(); e++) {
+                    if (golden[i][e].empty()) {
+                        missing++;
+                        continue;
+                    }
+                    applyEffect(effects[e], images[i], output, ctx);
+                    double maxDiff, fraction;
+                    compared++;
+                    if (!withinTolerance(output, golden[i][e], effectTolerance(effects[e]), maxDiff, fraction)) {
+                        printf("  FAILED %s %s: max diff %.0f, %.3f%% of values differ\n",
+                            imageStem(imagePaths[i]).c_str(), effects[e].c_str(), maxDiff, fraction * 100.0);
+                        variantFailed++;
+                    }
+                }
+            }
+            printf("%-10s %2d threads: %s\n", variant->isa, threads, variantFailed == 0 ? "ok" : "FAILED");
+            failed += variantFailed;
+            if (threads == defaultThreads) {
+                break;
+            }
+        }
+    }
+    cv::setNumThreads(-1);
+
+    if (missing > 0) {
+        printf("%d reference images missing, create them with --update\n", missing);
+    }
+    printf("%d comparisons, %d failed\n", compared, failed);
+    return failed > 0 || missing > 0 ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+// File: vfxServer.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 12, 2024
+// Purpose: Process several camera or file feeds in one process, each with its own effect chain,
+//          and report per-stream frame rate and latency.
+
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <string>
+#include "streamHost.h"
+
+static void printUsage() {
+    printf("Usage: vfxServer [--workers N] [--frames N] [--seconds S] [--report S] [--unpaced] source=effect+effect ...\n");
+    printf("  e.g. vfxServer cam:0=sepia+vignette synthetic:1280x720@30=hearts file:clip.mp4=emboss\n");
+    printf("Effects:");
+    for (const std::string& name : effectNames()) {
+        printf(" %s", name.c_str());
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    int workers = std::max(1, cv::getNumberOfCPUs());
+    long long maxFrames = 0;
+    double seconds = 0.0;
+    double reportSeconds = 2.0;
+    bool paced = true;
+    std::vector<StreamConfig> configs;
+
+    // Parse the command line
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--workers" && i + 1 < argc) {
+            workers = std::atoi(argv[++i]);
+        }
+        else if (arg == "--frames" && i + 1 < argc) {
+            maxFrames = std::atoll(argv[++i]);
+        }
+        else if (arg == "--seconds" && i + 1 < argc) {
+            seconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--report" && i + 1 < argc) {
+            reportSeconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--unpaced") {
+            paced = false;
+        }
+        else {
+            // The last '=' separates the source from its effect chain
+            StreamConfig config;
+            size_t equals = arg.rfind('=');
+            config.source = arg.substr(0, equals);
+            if (equals != std::string::npos && !parseEffectChain(arg.substr(equals + 1), config.chain)) {
+                printf("Unknown effect in %s\n", arg.c_str());
+                printUsage();
+                return -1;
+            }
+            configs.push_back(config);
+        }
+    }
+
+    if (configs.empty()) {
+        printUsage();
+        return -1;
+    }
+
+    StreamHost host(workers);
+    for (const StreamConfig& config : configs) {
+        if (!host.addStream(config, paced)) {
+            printf("Unable to open video device %s\n", config.source.c_str());
+            return -1;
+        }
+    }
+
+    printf("Running %zu streams on %d workers\n", configs.size(), workers);
+    host.run(maxFrames, seconds, reportSeconds);
+    host.printStats();
+
+    return 0;
+}
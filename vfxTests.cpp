@@ -0,0 +1,1138 @@
+// File: vfxTests.cpp
+// Author: Keval Visaria and Chirag Dhoka Jain
+// Date: February 14, 2024
+// Purpose: Self-checks of the optimized filters. Every kernel variant the CPU supports must give
+//          exactly the baseline results, and the fast filters must match straightforward versions.
+//          Returns 0 when everything passes, so it can run under ctest.
+
+#include <opencv2/opencv.hpp>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "backgroundModel.h"
+#include "colorLut.h"
+#include "controlPlane.h"
+#include "derivedImages.h"
+#include "effectChain.h"
+#include "effectGrid.h"
+#include "filter.h"
+#include "filterKernels.h"
+#include "frameRing.h"
+#include "frameStats.h"
+#include "imagePyramid.h"
+#include "perfCounters.h"
+#include "pixelPipeline.h"
+#include "privacyMask.h"
+#include "rawFrameFile.h"
+#include "stabilizer.h"
+#include "stripImage.h"
+#include "temporalFilters.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static bool sameImage(const cv::Mat& a, const cv::Mat& b) {
+    return a.size() == b.size() && a.type() == b.type() && cv::norm(a, b, cv::NORM_INF) == 0;
+}
+
+// Random BGR image with an odd width, so the vector loops also run their scalar tails
+static cv::Mat randomImage(int rows = 61, int cols = 97, int type = CV_8UC3) {
+    cv::Mat img(rows, cols, type);
+    cv::RNG rng(0x5eed);
+    if (CV_MAT_DEPTH(type) == CV_16S) {
+        rng.fill(img, cv::RNG::UNIFORM, -1100, 1100);
+    }
+    else {
+        rng.fill(img, cv::RNG::UNIFORM, 0, 256);
+    }
+    return img;
+}
+
+// Every variant must match the baseline bit for bit
+static void testKernelVariants() {
+    printf("kernel variants\n");
+    std::vector<const FilterKernels*> variants = availableFilterKernels();
+    CHECK(!variants.empty() && std::string(variants[0]->isa) == "baseline");
+
+    cv::Mat src = randomImage();
+    cv::Mat sx = randomImage(61, 97, CV_16SC3), sy = randomImage(61, 97, CV_16SC3);
+    cv::Mat sepia, altGrey, strong, magnitude, box, graded, halved;
+    cv::Mat expectSepia, expectAltGrey, expectStrong, expectMagnitude, expectBox, expectGraded, expectHalved;
+
+    // A LUT with a random grid, large enough to span several bricks
+    std::vector<float> grid(33 * 33 * 33 * 3);
+    cv::RNG rng(0x107);
+    for (float& value : grid) {
+        value = rng.uniform(0.0f, 1.0f);
+    }
+    ColorLut lut;
+    CHECK(buildColorLut(lut, 33, grid) == 0);
+
+    for (const FilterKernels* variant : variants) {
+        printf("  %s\n", variant->isa);
+        CHECK(selectFilterKernels(variant->isa));
+        CHECK(std::string(filterKernels().isa) == variant->isa);
+
+        sepiaTone(src, sepia);
+        altGreyScale(src, altGrey);
+        pickStrongColor(src, strong);
+        gradientMagnitudeEuclidean(sx, sy, magnitude);
+        boxBlur(src, box, 3);
+        applyColorLut(src, graded, lut);
+        halveImage(src, halved);
+
+        if (variant == variants[0]) {
+            expectSepia = sepia.clone();
+            expectAltGrey = altGrey.clone();
+            expectStrong = strong.clone();
+            expectMagnitude = magnitude.clone();
+            expectBox = box.clone();
+            expectGraded = graded.clone();
+            expectHalved = halved.clone();
+            continue;
+        }
+        CHECK(sameImage(sepia, expectSepia));
+        CHECK(sameImage(altGrey, expectAltGrey));
+        CHECK(sameImage(strong, expectStrong));
+        CHECK(sameImage(magnitude, expectMagnitude));
+        CHECK(sameImage(box, expectBox));
+        CHECK(sameImage(graded, expectGraded));
+        CHECK(sameImage(halved, expectHalved));
+    }
+    CHECK(!selectFilterKernels("no-such-isa"));
+    selectFilterKernels(variants.back()->isa);
+}
+
+// The row kernels against the per-pixel loops they replaced
+static void testReferenceFilters() {
+    printf("reference filters\n");
+    cv::Mat src = randomImage();
+    cv::Mat sepia, altGrey, strong;
+    sepiaTone(src, sepia);
+    altGreyScale(src, altGrey);
+    pickStrongColor(src, strong, 100);
+
+    bool sepiaOk = true, altGreyOk = true, strongOk = true;
+    for (int y = 0; y < src.rows; ++y) {
+        for (int x = 0; x < src.cols; ++x) {
+            cv::Vec3b p = src.at<cv::Vec3b>(y, x);
+            double r = 0.272 * p[2] + 0.534 * p[1] + 0.131 * p[0];
+            double g = 0.349 * p[2] + 0.686 * p[1] + 0.168 * p[0];
+            double b = 0.393 * p[2] + 0.769 * p[1] + 0.189 * p[0];
+            cv::Vec3b expect((uchar)std::min(255.0, r), (uchar)std::min(255.0, g), (uchar)std::min(255.0, b));
+            sepiaOk = sepiaOk && sepia.at<cv::Vec3b>(y, x) == expect;
+
+            uchar grey = 255 - p[2];
+            altGreyOk = altGreyOk && altGrey.at<cv::Vec3b>(y, x) == cv::Vec3b(grey, grey, grey);
+
+            uchar intensity = (uchar)((p[0] + p[1] + p[2]) / 3);
+            cv::Vec3b strongExpect = intensity > 100 ? p : cv::Vec3b(intensity, intensity, intensity);
+            strongOk = strongOk && strong.at<cv::Vec3b>(y, x) == strongExpect;
+        }
+    }
+    CHECK(sepiaOk);
+    CHECK(altGreyOk);
+    CHECK(strongOk);
+}
+
+// Box blur with replicated borders, each pass summing the whole window
+static void naiveBoxBlur(const cv::Mat& src, cv::Mat& dst, int radius) {
+    const float inv = 1.0f / (2 * radius + 1);
+    cv::Mat rows(src.size(), src.type());
+    dst.create(src.size(), src.type());
+    for (int y = 0; y < src.rows; ++y) {
+        for (int x = 0; x < src.cols; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                int sum = 0;
+                for (int k = -radius; k <= radius; ++k) {
+                    sum += src.at<cv::Vec3b>(y, std::min(std::max(x + k, 0), src.cols - 1))[c];
+                }
+                rows.at<cv::Vec3b>(y, x)[c] = (uchar)(sum * inv + 0.5f);
+            }
+        }
+    }
+    for (int y = 0; y < src.rows; ++y) {
+        for (int x = 0; x < src.cols; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                int sum = 0;
+                for (int k = -radius; k <= radius; ++k) {
+                    sum += rows.at<cv::Vec3b>(std::min(std::max(y + k, 0), src.rows - 1), x)[c];
+                }
+                dst.at<cv::Vec3b>(y, x)[c] = (uchar)(sum * inv + 0.5f);
+            }
+        }
+    }
+}
+
+static void testBoxBlur() {
+    printf("box blur\n");
+    cv::Mat src = randomImage(300, 97);
+    for (int radius : { 1, 2, 5, 17 }) {
+        cv::Mat fast, naive;
+        CHECK(boxBlur(src, fast, radius) == 0);
+        naiveBoxBlur(src, naive, radius);
+        CHECK(sameImage(fast, naive));
+    }
+
+    // In place gives the same result
+    cv::Mat inPlace = src.clone(), expect;
+    boxBlur(src, expect, 4);
+    boxBlur(inPlace, inPlace, 4);
+    CHECK(sameImage(inPlace, expect));
+
+    cv::Mat empty, dst;
+    CHECK(boxBlur(empty, dst, 2) == -1);
+    CHECK(boxBlur(src, dst, -1) == -1);
+}
+
+// Cartoon effect as separate full-frame passes: binomial blur, grey, Sobel edges, quantize and mask
+static void naiveCartoon(const cv::Mat& src, cv::Mat& dst, int levels, int edgeThreshold) {
+    const int binomial[5] = { 1, 4, 6, 4, 1 };
+    auto clampRow = [&](int y) { return std::min(std::max(y, 0), src.rows - 1); };
+    auto clampCol = [&](int x) { return std::min(std::max(x, 0), src.cols - 1); };
+    cv::Mat rows(src.size(), CV_32SC3), blurred(src.size(), CV_8UC3), grey(src.size(), CV_8UC1);
+    for (int y = 0; y < src.rows; ++y) {
+        for (int x = 0; x < src.cols; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                int sum = 0;
+                for (int k = -2; k <= 2; ++k) {
+                    sum += binomial[k + 2] * src.at<cv::Vec3b>(y, clampCol(x + k))[c];
+                }
+                rows.at<cv::Vec3i>(y, x)[c] = sum;
+            }
+        }
+    }
+    for (int y = 0; y < src.rows; ++y) {
+        for (int x = 0; x < src.cols; ++x) {
+            cv::Vec3b& p = blurred.at<cv::Vec3b>(y, x);
+            for (int c = 0; c < 3; ++c) {
+                int sum = 0;
+                for (int k = -2; k <= 2; ++k) {
+                    sum += binomial[k + 2] * rows.at<cv::Vec3i>(clampRow(y + k), x)[c];
+                }
+                p[c] = (uchar)((sum + 128) >> 8);
+            }
+            grey.at<uchar>(y, x) = (uchar)((29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8);
+        }
+    }
+    float bucketSize = 255.0f / levels;
+    dst.create(src.size(), CV_8UC3);
+    for (int y = 0; y < src.rows; ++y) {
+        for (int x = 0; x < src.cols; ++x) {
+            auto g = [&](int dy, int dx) { return (int)grey.at<uchar>(clampRow(y + dy), clampCol(x + dx)); };
+            int gx = g(-1, 1) + 2 * g(0, 1) + g(1, 1) - g(-1, -1) - 2 * g(0, -1) - g(1, -1);
+            int gy = g(1, -1) + 2 * g(1, 0) + g(1, 1) - g(-1, -1) - 2 * g(-1, 0) - g(-1, 1);
+            bool edge = std::abs(gx) + std::abs(gy) > edgeThreshold;
+            for (int c = 0; c < 3; ++c) {
+                float value = blurred.at<cv::Vec3b>(y, x)[c];
+                dst.at<cv::Vec3b>(y, x)[c] = edge ? 0 : (uchar)(floor(value / bucketSize + 0.5) * bucketSize);
+            }
+        }
+    }
+}
+
+static void testCartoon() {
+    printf("cartoon\n");
+    // Sizes around the tile size, so partial tiles and frame-edge tiles are covered
+    for (cv::Size size : { cv::Size(97, 61), cv::Size(300, 130), cv::Size(129, 65), cv::Size(2, 3) }) {
+        cv::Mat src = randomImage(size.height, size.width), tiled, naive;
+        cv::GaussianBlur(src, src, cv::Size(7, 7), 0);
+        CHECK(cartoon(src, tiled, 8, 96) == 0);
+        naiveCartoon(src, naive, 8, 96);
+        CHECK(sameImage(tiled, naive));
+    }
+    cv::Mat empty, dst;
+    CHECK(cartoon(empty, dst) == -1);
+}
+
+static void testColorLut() {
+    printf("color lut\n");
+    cv::Mat src = randomImage(), graded, expect;
+
+    // The built-in looks on the LUT path: linear ones match the filters, sepia's clamp and
+    // truncation are only approximated
+    CHECK(applyColorLut(src, graded, *colorLutPreset("identity")) == 0);
+    CHECK(sameImage(graded, src));
+    applyColorLut(src, graded, *colorLutPreset("altgrey"));
+    altGreyScale(src, expect);
+    CHECK(sameImage(graded, expect));
+    applyColorLut(src, graded, *colorLutPreset("sepia"));
+    sepiaTone(src, expect);
+    CHECK(cv::norm(graded, expect, cv::NORM_INF) <= 5);
+    CHECK(colorLutPreset("nope") == NULL);
+    std::vector<std::string> presets = colorLutPresetNames();
+    CHECK(presets.size() == 4);
+    for (const std::string& name : presets) {
+        CHECK(colorLutPreset(name) != NULL && colorLutPreset(name)->size >= 2);
+    }
+
+    // A .cube file swapping red and blue, with the table in the file's red-fastest order
+    std::string path = cv::tempfile(".cube");
+    FILE* file = fopen(path.c_str(), "w");
+    fprintf(file, "# swap\nTITLE \"Swap red and blue\"\nLUT_3D_SIZE 2\nDOMAIN_MIN 0 0 0\nDOMAIN_MAX 1 1 1\n");
+    for (int i = 0; i < 8; i++) {
+        fprintf(file, "%d.0 %d.0 %d.0\n", i >> 2, (i >> 1) & 1, i & 1);
+    }
+    fclose(file);
+    ColorLut swap;
+    CHECK(loadCubeLut(path, swap) == 0);
+    CHECK(swap.title == "Swap red and blue" && swap.size == 2);
+    applyColorLut(src, graded, swap);
+    cv::cvtColor(src, expect, cv::COLOR_BGR2RGB);
+    CHECK(sameImage(graded, expect));
+
+    // In place, and a truncated table
+    cv::Mat inPlace = src.clone();
+    applyColorLut(inPlace, inPlace, swap);
+    CHECK(sameImage(inPlace, expect));
+    file = fopen(path.c_str(), "w");
+    fprintf(file, "LUT_3D_SIZE 3\n0 0 0\n1 1 1\n");
+    fclose(file);
+    CHECK(loadCubeLut(path, swap) == -1);
+    remove(path.c_str());
+}
+
+static void testFrameStats() {
+    printf("frame stats\n");
+    cv::Mat grey = randomImage(61, 97, CV_8UC1), frame;
+    cv::cvtColor(grey, frame, cv::COLOR_GRAY2BGR);
+
+    // Sampling every pixel: the luma is the grey image and its equalization is equalizeHist's
+    FrameStats stats;
+    computeFrameStats(frame, stats, 1);
+    CHECK(stats.samples == grey.rows * grey.cols);
+    CHECK(std::abs(stats.mean[STATS_LUMA] - cv::mean(grey)[0]) < 1e-9);
+    cv::Mat lut, viaStats, expect;
+    equalizationLut(stats, lut);
+    cv::LUT(grey, lut, viaStats);
+    cv::equalizeHist(grey, expect);
+    CHECK(sameImage(viaStats, expect));
+
+    // The step^2 grid phases cover every pixel exactly once
+    int samples = 0;
+    for (int phase = 0; phase < 16; phase++) {
+        FrameStats part;
+        computeFrameStats(frame, part, 4, phase % 4, phase / 4);
+        samples += part.samples;
+    }
+    CHECK(samples == stats.samples);
+
+    // The engine samples the same pixels on its worker
+    FrameStatsEngine engine;
+    FrameStats direct;
+    computeFrameStats(frame, direct, 4, 0, 0);
+    engine.begin(frame);
+    CHECK(memcmp(engine.wait().histogram, direct.histogram, sizeof(direct.histogram)) == 0);
+
+    // A dull frame gets stretched and stays centred
+    cv::Mat dull = grey / 8 + cv::Scalar::all(100), dullFrame, stretched;
+    cv::cvtColor(dull, dullFrame, cv::COLOR_GRAY2BGR);
+    computeFrameStats(dullFrame, stats, 2);
+    AutoLevels levels;
+    initAutoLevels(levels);
+    updateAutoLevels(levels, stats);
+    CHECK(levels.primed && levels.contrast > 2.0f);
+    toneLut(levels.brightness, levels.contrast, lut);
+    cv::LUT(dull, lut, stretched);
+    double low, high;
+    cv::minMaxLoc(stretched, &low, &high);
+    CHECK(high - low > 2.0 * 31 && std::abs(cv::mean(stretched)[0] - 128.0) < 16.0);
+
+    cv::Mat equalized;
+    CHECK(localEqualize(dullFrame, equalized, stats) == 0 && equalized.size() == dullFrame.size());
+    CHECK(localEqualize(randomImage(48, 64), equalized, stats) == -1);
+
+    // A frame large enough to be split over the pool equalizes the same on every thread count
+    cv::Mat large, single;
+    cv::resize(dullFrame, large, cv::Size(640, 480), 0, 0, cv::INTER_NEAREST);
+    computeFrameStats(large, stats, 2);
+    int defaultThreads = cv::getNumThreads();
+    cv::setNumThreads(1);
+    CHECK(localEqualize(large, single, stats) == 0);
+    cv::setNumThreads(defaultThreads);
+    CHECK(localEqualize(large, equalized, stats) == 0 && sameImage(equalized, single));
+    cv::minMaxLoc(equalized.reshape(1), &low, &high);
+    CHECK(high - low > 2.0 * 31);
+}
+
+// Runs a short sequence through the temporal effects, concatenating the outputs
+static cv::Mat runTemporalSequence(const std::vector<cv::Mat>& frames) {
+    TemporalState state;
+    initTemporalState(state);
+    std::vector<cv::Mat> outputs;
+    for (const cv::Mat& frame : frames) {
+        cv::Mat src = frame.clone(), blurred, ghost, motion, denoised;
+        motionBlur(src, blurred, state);
+        ghostTrails(src, ghost, state, 1);
+        motionHighlight(src, motion, state);
+        temporalDenoise(src, denoised, state);
+        outputs.push_back(blurred);
+        outputs.push_back(ghost);
+        outputs.push_back(motion);
+        outputs.push_back(denoised);
+    }
+    cv::Mat all;
+    cv::vconcat(outputs, all);
+    return all;
+}
+
+// The per-pixel Vignette loop pixelPipeline replaced
+static void naiveVignette(const cv::Mat& src, cv::Mat& dst, double strength, double radius) {
+    dst.create(src.size(), src.type());
+    cv::Point center(src.cols / 2, src.rows / 2);
+    for (int y = 0; y < src.rows; ++y) {
+        for (int x = 0; x < src.cols; ++x) {
+            cv::Vec3b pixel = src.at<cv::Vec3b>(y, x);
+            double dist = cv::norm(center - cv::Point(x, y)) / cv::norm(center);
+            double vignette = 1.0 - strength * (1.0 - std::exp(-0.5 * std::pow(dist / radius, 2)));
+            pixel[0] *= vignette;
+            pixel[1] *= vignette;
+            pixel[2] *= vignette;
+            dst.at<cv::Vec3b>(y, x) = pixel;
+        }
+    }
+}
+
+static void testPixelPipeline() {
+    using namespace pixelPipeline;
+    printf("pixel pipeline\n");
+    cv::Mat src = randomImage(), fused, expect, step;
+
+    // Single operations are the filters they stand for
+    applyPixelPipeline(src, fused, sepia());
+    sepiaTone(src, expect);
+    CHECK(sameImage(fused, expect));
+    applyPixelPipeline(src, fused, altGrey());
+    altGreyScale(src, expect);
+    CHECK(sameImage(fused, expect));
+    applyPixelPipeline(src, fused, strongColor(100));
+    pickStrongColor(src, expect, 100);
+    CHECK(sameImage(fused, expect));
+    applyPixelPipeline(src, fused, threshold(77));
+    cv::threshold(src, expect, 77, 255, cv::THRESH_BINARY);
+    CHECK(sameImage(fused, expect));
+    cv::Mat lut(1, 256, CV_8UC1);
+    for (int i = 0; i < 256; i++) {
+        lut.at<uchar>(i) = cv::saturate_cast<uchar>(255 - i * i / 200);
+    }
+    applyPixelPipeline(src, fused, table(lut));
+    cv::LUT(src, lut, expect);
+    CHECK(sameImage(fused, expect));
+    applyPixelPipeline(src, fused, contrast(1.3f, -20.0f));
+    src.convertTo(expect, -1, 1.3, -20.0);
+    CHECK(cv::norm(fused, expect, cv::NORM_INF) <= 1);
+    Vignette(src, fused, 0.6, 0.8);
+    naiveVignette(src, expect, 0.6, 0.8);
+    CHECK(sameImage(fused, expect));
+
+    // A fused pipeline gives what the separate passes give, also in place
+    VignetteMap map;
+    const cv::Mat& gains = vignetteMap(map, src.size(), 0.8, 0.7);
+    auto pipeline = sepia() | vignette(gains) | table(lut) | strongColor(90);
+    applyPixelPipeline(src, fused, pipeline);
+    sepiaTone(src, step);
+    Vignette(step, step);
+    cv::LUT(step, lut, step);
+    pickStrongColor(step, expect, 90);
+    CHECK(sameImage(fused, expect));
+    cv::Mat inPlace = src.clone();
+    applyPixelPipeline(inPlace, inPlace, pipeline);
+    CHECK(sameImage(inPlace, expect));
+    CHECK(applyPixelPipeline(randomImage(61, 97, CV_8UC1), fused, sepia()) == -1);
+}
+
+static void testPrivacyMask() {
+    printf("privacy mask\n");
+    PrivacyState state;
+    initPrivacyState(state, 3, 0.25f, 0.1f);
+    std::vector<cv::Rect> faces(1, cv::Rect(40, 30, 40, 40));
+    updatePrivacyRegions(state, faces, true);
+    CHECK(state.regions.size() == 1);
+
+    // Only the padded face changes, and the mosaic flattens it
+    cv::Mat original = randomImage(120, 160);
+    for (PrivacyStyle style : { PRIVACY_PIXELATE, PRIVACY_BLUR }) {
+        cv::Mat frame = original.clone();
+        CHECK(applyPrivacyMask(frame, state, style) == 1);
+        cv::Rect rect = privacyRect(state, state.regions[0], frame.size());
+        CHECK(rect == cv::Rect(30, 20, 60, 60));
+        cv::Mat outside = frame.clone(), originalOutside = original.clone();
+        outside(rect).setTo(cv::Scalar::all(0));
+        originalOutside(rect).setTo(cv::Scalar::all(0));
+        CHECK(sameImage(outside, originalOutside));
+        cv::Scalar mean, before, after;
+        cv::meanStdDev(original(rect), mean, before);
+        cv::meanStdDev(frame(rect), mean, after);
+        CHECK(after[0] < before[0] / 3);
+    }
+
+    // Proxy frames mask the scaled rectangle
+    cv::Mat half = randomImage(60, 80), halfOriginal = half.clone();
+    applyPrivacyMask(half, state, PRIVACY_PIXELATE, 0.5f);
+    CHECK(privacyRect(state, state.regions[0], half.size(), 0.5f) == cv::Rect(15, 10, 30, 30));
+    CHECK(sameImage(half(cv::Rect(0, 0, 80, 10)), halfOriginal(cv::Rect(0, 0, 80, 10))));
+
+    // Frames between detections keep the region as it is, a lost face is held and grows
+    updatePrivacyRegions(state, faces, false);
+    CHECK(state.regions.size() == 1 && state.regions[0].framesMissing == 0);
+    std::vector<cv::Rect> none;
+    for (int i = 1; i <= 3; i++) {
+        updatePrivacyRegions(state, none, i == 1);
+        CHECK(state.regions.size() == 1 && state.regions[0].framesMissing == i);
+    }
+    CHECK(privacyRect(state, state.regions[0], cv::Size(160, 120)).width > 60);
+    updatePrivacyRegions(state, none, false);
+    CHECK(state.regions.empty());
+
+    // A moved face keeps its region, a second face gets its own
+    updatePrivacyRegions(state, faces, true);
+    faces[0].x += 10;
+    faces.push_back(cv::Rect(100, 60, 30, 30));
+    updatePrivacyRegions(state, faces, true);
+    CHECK(state.regions.size() == 2 && state.regions[0].face == faces[0]);
+}
+
+// Textured scene moved by dx, dy and rotated by angle about the centre
+static cv::Mat shakenFrame(const cv::Mat& scene, double dx, double dy, double angle) {
+    cv::Mat m = cv::getRotationMatrix2D(cv::Point2f(scene.cols * 0.5f, scene.rows * 0.5f), angle * 180.0 / CV_PI, 1.0);
+    m.at<double>(0, 2) += dx;
+    m.at<double>(1, 2) += dy;
+    cv::Mat frame;
+    cv::warpAffine(scene, frame, m, scene.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT);
+    return frame;
+}
+
+// Shift of the content a stabilizer transform applies besides its zoom
+static cv::Point2d stabilizerShift(const StabilizerState& state) {
+    const double* m = state.transform.ptr<double>(0);
+    double zoom = std::sqrt(m[0] * m[0] + m[3] * m[3]);
+    double cx = state.frameSize.width * 0.5, cy = state.frameSize.height * 0.5;
+    return cv::Point2d((m[2] - cx * (1.0 - zoom)) / zoom, (m[5] - cy * (1.0 - zoom)) / zoom);
+}
+
+static void testStabilizer() {
+    printf("stabilizer\n");
+    cv::Mat scene = randomImage(240, 320);
+    cv::GaussianBlur(scene, scene, cv::Size(7, 7), 2.0);
+
+    // A steady camera is only zoomed
+    StabilizerState state;
+    initStabilizer(state);
+    cv::Mat out;
+    for (int i = 0; i < 5; i++) {
+        CHECK(stabilize(state, scene, out) == 0);
+    }
+    CHECK(out.size() == scene.size());
+    CHECK(cv::norm(stabilizerShift(state)) < 0.1);
+    CHECK(std::abs(state.position[2]) < 0.001);
+
+    // Shake around a steady view is undone: the corrected content moves far less than the frames
+    const double jitter[] = { 0, 3, -2, 4, -3, 2, -4, 1, 3, -2 };
+    StabilizerEngine engine;
+    double shaken = 0.0, corrected = 0.0;
+    for (int i = 0; i < 10; i++) {
+        cv::Mat frame = shakenFrame(scene, jitter[i], -jitter[9 - i], 0.0);
+        stabilize(state, frame, out);
+        engine.begin(frame);
+        CHECK(engine.warp(frame, out) == 0);
+        CHECK(std::abs(state.position[0] - jitter[i]) < 0.5 && std::abs(state.position[1] + jitter[9 - i]) < 0.5);
+        cv::Point2d shift = stabilizerShift(state);
+        shaken += jitter[i] * jitter[i] + jitter[9 - i] * jitter[9 - i];
+        corrected += std::pow(state.position[0] + shift.x, 2) + std::pow(state.position[1] + shift.y, 2);
+    }
+    CHECK(corrected < shaken / 4);
+
+    // The worker gives the same estimates as the calling thread
+    StabilizerState threaded = engine.snapshot();
+    CHECK(threaded.frames == 10 && std::abs(threaded.position[0] - jitter[9]) < 0.5);
+
+    // Rotation is tracked as well
+    initStabilizer(state);
+    stabilize(state, scene, out);
+    stabilize(state, shakenFrame(scene, 0.0, 0.0, 0.02), out);
+    CHECK(std::abs(state.position[2] + 0.02) < 0.005);
+    CHECK(std::abs(state.position[0]) < 0.5 && std::abs(state.position[1]) < 0.5);
+
+    // The warp can scale a proxy frame to the display size, and only takes frames of its size
+    CHECK(warpStabilized(state, scene, out, cv::Size(640, 480)) == 0 && out.size() == cv::Size(640, 480));
+    CHECK(warpStabilized(state, randomImage(10, 10), out) == -1);
+
+    // A new frame size starts the path over
+    CHECK(updateStabilizer(state, cv::Mat(60, 80, CV_8UC1, cv::Scalar(0)), 0.25, cv::Size(320, 240)) == 0);
+    CHECK(state.path.size() == 1);
+}
+
+static void testTemporalFilters() {
+    printf("temporal filters\n");
+
+    // The ring keeps the newest frames and reuses its slots
+    FrameHistory history;
+    initFrameHistory(history, 3);
+    CHECK(historyFrame(history, 0) == NULL);
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < 6; i++) {
+        frames.push_back(randomImage() / (i + 1));
+    }
+    pushFrame(history, frames[0]);
+    const uchar* slotData = history.slots[history.head].data;
+    for (int i = 1; i < 6; i++) {
+        pushFrame(history, frames[i]);
+    }
+    CHECK(history.count == 3);
+    CHECK(historyFrame(history, 3) == NULL);
+    CHECK(sameImage(*historyFrame(history, 0), frames[5]));
+    CHECK(sameImage(*historyFrame(history, 2), frames[3]));
+    CHECK(history.slots[(history.head + 1) % 3].data == slotData);
+
+    // A static scene stays as it is
+    TemporalState state;
+    initTemporalState(state);
+    cv::Mat still = randomImage(), out;
+    for (int i = 0; i < 4; i++) {
+        CHECK(motionBlur(still, out, state) == 0);
+    }
+    CHECK(sameImage(out, still));
+    for (int i = 0; i < 4; i++) {
+        CHECK(temporalDenoise(still, out, state) == 0);
+    }
+    CHECK(sameImage(out, still));
+    CHECK(motionBlur(still, out, state, 1.0f) == -1);
+
+    // Every kernel variant gives the baseline results
+    std::vector<const FilterKernels*> variants = availableFilterKernels();
+    selectFilterKernels("baseline");
+    cv::Mat expect = runTemporalSequence(frames);
+    for (size_t i = 1; i < variants.size(); i++) {
+        selectFilterKernels(variants[i]->isa);
+        CHECK(sameImage(runTemporalSequence(frames), expect));
+    }
+    selectFilterKernels(variants.back()->isa);
+}
+
+static void testBackgroundModel() {
+    printf("background model\n");
+    BackgroundModel model;
+    initBackgroundModel(model, 0.25f, 5);
+    cv::Mat scene = randomImage(240, 320) / 4 + cv::Scalar::all(100), mask;
+    cv::GaussianBlur(scene, scene, cv::Size(9, 9), 0);
+
+    // Nothing is segmented while learning
+    for (int i = 0; i < 5; i++) {
+        CHECK(!segmentForeground(model, scene, mask));
+    }
+    CHECK(segmentForeground(model, scene, mask));
+    CHECK(mask.size() == scene.size() && cv::countNonZero(mask) == 0);
+
+    // A dark object in front of the learned scene is foreground, the rest stays background
+    cv::Mat withObject = scene.clone();
+    cv::rectangle(withObject, cv::Rect(120, 80, 80, 80), cv::Scalar(10, 10, 10), cv::FILLED);
+    CHECK(segmentForeground(model, withObject, mask));
+    CHECK(mask.at<uchar>(120, 160) == 255);
+    CHECK(mask.at<uchar>(20, 20) == 0);
+    CHECK(cv::countNonZero(mask(cv::Rect(0, 0, 100, 240))) == 0);
+
+    cv::Mat replacement(scene.size(), scene.type(), cv::Scalar(0, 255, 0)), replaced;
+    CHECK(replaceBackground(withObject, replacement, mask, replaced) == 0);
+    CHECK(replaced.at<cv::Vec3b>(120, 160) == cv::Vec3b(10, 10, 10));
+    CHECK(replaced.at<cv::Vec3b>(20, 20) == cv::Vec3b(0, 255, 0));
+
+    // Resetting learns again
+    resetBackgroundModel(model);
+    CHECK(!segmentForeground(model, withObject, mask));
+}
+
+// Words of one published value always belong together
+struct SeqLockCheck {
+    uint64_t value;
+    uint64_t inverted;
+    uint64_t tripled;
+};
+
+static void testControlPlane() {
+    printf("control plane\n");
+    SeqLock<SeqLockCheck> lock(SeqLockCheck{ 0, ~0ull, 0 });
+    std::atomic<bool> done(false);
+    std::thread writer([&] {
+        for (uint64_t i = 1; i <= 20000; i++) {
+            lock.store(SeqLockCheck{ i, ~i, i * 3 });
+            if (i % 16 == 0) {
+                std::this_thread::yield();
+            }
+        }
+        done = true;
+    });
+    bool consistent = true;
+    while (!done) {
+        SeqLockCheck check = lock.load();
+        consistent = consistent && check.inverted == ~check.value && check.tripled == check.value * 3;
+    }
+    writer.join();
+    CHECK(consistent);
+    CHECK(lock.version() == 20001);
+    CHECK(lock.load().value == 20000);
+
+    ControlChannel control;
+    std::string reply;
+    uint64_t version = control.version();
+    CHECK(control.applyCommand("sepia on", reply) && control.snapshot().sepiaToneMode);
+    CHECK(control.applyCommand("sepia toggle", reply) && !control.snapshot().sepiaToneMode);
+    CHECK(control.applyKey('t') && control.snapshot().sepiaToneMode);
+    CHECK(control.applyCommand("vignette-strength 0.5 0.9", reply));
+    CHECK(control.snapshot().vignetteStrength == 0.5 && control.snapshot().vignetteRadius == 0.9);
+    CHECK(control.applyCommand("quantize-levels 4", reply) && control.snapshot().quantizeLevels == 4);
+    CHECK(!control.applyCommand("quantize-levels 0", reply) && control.snapshot().quantizeLevels == 4);
+    CHECK(!control.applyCommand("brightness bright", reply));
+    CHECK(!control.applyCommand("nope", reply));
+    CHECK(control.applyCommand("save", reply) && control.snapshot().saveRequests == 1);
+    CHECK(!control.applyKey('#'));
+    CHECK(control.version() > version);
+}
+
+static void testRawFrameFile() {
+    printf("raw frame file\n");
+    std::string path = cv::tempfile(".vfxraw");
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < 3; i++) {
+        frames.push_back(randomImage(48, 64) + cv::Scalar::all(i * 10));
+    }
+
+    RawFrameWriter writer;
+    CHECK(writer.open(path, cv::Size(64, 48), CV_8UC3, 25.0));
+    for (const cv::Mat& frame : frames) {
+        CHECK(writer.write(frame));
+    }
+    CHECK(writer.close());
+
+    RawFrameReader reader;
+    CHECK(reader.open(path));
+    CHECK(reader.frameCount() == frames.size());
+    CHECK(reader.frameSize() == cv::Size(64, 48));
+    CHECK(reader.fps() == 25.0);
+    for (size_t i = 0; i < frames.size() && i < reader.frameCount(); i++) {
+        CHECK(sameImage(reader.frame(i), frames[i]));
+    }
+    reader.close();
+
+    // Headers whose frames don't match their size or lie outside the file are refused
+    RawFrameHeader good;
+    FILE* file = fopen(path.c_str(), "r+b");
+    CHECK(file != NULL && fread(&good, sizeof(good), 1, file) == 1);
+    for (int corruption = 0; file != NULL && corruption < 4; corruption++) {
+        RawFrameHeader bad = good;
+        if (corruption == 0) {
+            bad.frameBytes = good.frameBytes * 2;
+        }
+        else if (corruption == 1) {
+            bad.type = CV_16UC3;
+        }
+        else if (corruption == 2) {
+            bad.dataOffset = 0;
+        }
+        else {
+            bad.dataOffset = 1ULL << 40;
+        }
+        fseek(file, 0, SEEK_SET);
+        fwrite(&bad, sizeof(bad), 1, file);
+        fflush(file);
+        CHECK(!reader.open(path));
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    remove(path.c_str());
+}
+
+// Bands with their halo rows give exactly the whole image, through memory and through files
+static void testStripImage() {
+    printf("strip image\n");
+    cv::Mat image = randomImage(83, 97);
+    cv::GaussianBlur(image, image, cv::Size(5, 5), 1.5);
+    std::string inputPath = cv::tempfile(".ppm"), outputPath = cv::tempfile(".ppm");
+    FILE* file = fopen(inputPath.c_str(), "wb");
+    CHECK(file != NULL);
+    if (file == NULL) {
+        return;
+    }
+    cv::Mat rgb;
+    cv::cvtColor(image, rgb, cv::COLOR_BGR2RGB);
+    fprintf(file, "P6\n# test image\n%d %d\n255\n", image.cols, image.rows);
+    fwrite(rgb.data, 1, rgb.total() * rgb.elemSize(), file);
+    fclose(file);
+
+    for (const char* spec : { "sepia", "gauss", "cartoon", "quantize+magnitude", "sobelx+emboss+grey" }) {
+        std::vector<std::string> chain;
+        CHECK(parseEffectChain(spec, chain));
+        cv::Mat whole, banded;
+        EffectContext ctx;
+        applyEffectChain(chain, image, whole, ctx);
+
+        StripStats stats;
+        CHECK(processImageBands(image, banded, chain, 7, &stats) == 0);
+        CHECK(stats.bands == 12 && stats.haloRows == effectChainHaloRows(chain));
+        CHECK(sameImage(banded, whole));
+
+        CHECK(processImageStrips(inputPath, outputPath, chain, 10) == 0);
+        StripReader reader;
+        cv::Mat streamed;
+        CHECK(reader.open(outputPath) && reader.size() == image.size());
+        CHECK(reader.readRows(0, image.rows, streamed));
+        CHECK(sameImage(streamed, whole));
+    }
+
+    // Rows from the middle of the file, and effects that need the whole frame are refused
+    StripReader reader;
+    cv::Mat rows;
+    CHECK(reader.open(inputPath) && reader.readRows(40, 45, rows));
+    CHECK(sameImage(rows, image.rowRange(40, 45)));
+    CHECK(!reader.readRows(80, 90, rows));
+    std::vector<std::string> vignette(1, "vignette");
+    cv::Mat out;
+    CHECK(effectChainHaloRows(vignette) == -1);
+    CHECK(processImageBands(image, out, vignette) == -1);
+    reader.close();
+    remove(inputPath.c_str());
+    remove(outputPath.c_str());
+}
+
+static void testFrameRing() {
+#ifndef _WIN32
+    printf("frame ring\n");
+    std::string name = "/vfxTests-" + std::to_string(cv::getTickCount());
+    FrameRingWriter writer;
+    CHECK(writer.create(name, 3, 48 * 64 * 3));
+    FrameRingReader reader, slowReader;
+    CHECK(reader.open(name) && slowReader.open(name));
+    FrameRingView view;
+    CHECK(!reader.next(view));
+
+    // Frames come back as views with their metadata, and may change size and type
+    cv::Mat first = randomImage(48, 64);
+    CHECK(writer.publish(first, 10, 1234));
+    CHECK(reader.next(view) && sameImage(view.image, first));
+    CHECK(view.sequence == 1 && view.frameIndex == 10 && view.captureNs == 1234);
+    CHECK(reader.stillValid(view));
+    std::vector<cv::Mat> frames;
+    for (int i = 2; i <= 7; i++) {
+        frames.push_back(randomImage(20, 30, CV_8UC1) + cv::Scalar::all(i));
+        CHECK(writer.publish(frames.back(), 10 + i, 0));
+    }
+    CHECK(!reader.stillValid(view));
+
+    // A reader that fell behind skips to the oldest frame not about to be overwritten
+    CHECK(reader.next(view) && view.sequence == 6 && reader.dropped() == 4);
+    CHECK(sameImage(view.image, frames[4]) && reader.stillValid(view));
+    CHECK(reader.latest(view) && view.sequence == 7 && !reader.next(view));
+    CHECK(slowReader.next(view) && view.sequence == 6 && slowReader.dropped() == 5);
+
+    // Rendering into a slot, and frames too large for one
+    cv::Mat slot = writer.beginFrame(cv::Size(64, 48), CV_8UC3);
+    CHECK(!slot.empty());
+    first.copyTo(slot);
+    CHECK(writer.commitFrame(1, 0) == 8);
+    CHECK(reader.next(view) && sameImage(view.image, first));
+    CHECK(!writer.publish(randomImage(100, 100), 0, 0) && writer.rejected() == 1);
+
+    // A slot whose metadata doesn't fit it, as a corrupt or foreign writer might leave, is skipped
+    CHECK(writer.publish(first, 9, 0));
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    void* mapped = fd >= 0 ? mmap(NULL, sizeof(FrameRingHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    CHECK(mapped != MAP_FAILED);
+    if (mapped != MAP_FAILED) {
+        FrameRingSlot& corrupt = static_cast<FrameRingHeader*>(mapped)->slots[(9 - 1) % 3];
+        corrupt.height.store(4800);
+        CHECK(!reader.next(view) && reader.dropped() == 5);
+        CHECK(writer.publish(first, 10, 0) && reader.next(view) && view.sequence == 10 && sameImage(view.image, first));
+        CHECK(writer.publish(first, 11, 0));
+        static_cast<FrameRingHeader*>(mapped)->slots[(11 - 1) % 3].step.store(10);
+        CHECK(!reader.latest(view) && reader.dropped() == 6);
+        munmap(mapped, sizeof(FrameRingHeader));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    writer.close();
+    CHECK(reader.writerClosed() && !reader.waitNext(view, 1000));
+    CHECK(!reader.open(name));
+#endif
+}
+
+static void testEffectChain() {
+    printf("effect chain\n");
+    std::vector<std::string> chain;
+    CHECK(parseEffectChain("sepia+vignette", chain));
+    CHECK(chain.size() == 2 && chain[0] == "sepia" && chain[1] == "vignette");
+    CHECK(parseEffectChain("", chain) && chain.empty());
+    CHECK(!parseEffectChain("sepia+nope", chain));
+
+    // A chain gives the same result as applying the effects one after the other
+    EffectContext ctx;
+    cv::Mat src = randomImage(), chained, step, expect;
+    parseEffectChain("sepia+altgrey+blur", chain);
+    CHECK(applyEffectChain(chain, src, chained, ctx) == 0);
+    sepiaTone(src, step);
+    altGreyScale(step, expect);
+    blur5x5_B(expect, step);
+    CHECK(sameImage(chained, step));
+    CHECK(applyEffect("nope", src, chained, ctx) == -1);
+
+    // Two temporal effects of a chain keep their own history, as if each ran in its own context
+    cv::Mat tall = randomImage(70, 97);
+    for (const char* spec : { "motionblur+denoise", "ghost+motion" }) {
+        parseEffectChain(spec, chain);
+        EffectContext together, first, second;
+        for (int frame = 0; frame < 8; frame++) {
+            cv::Mat moved = tall.rowRange(frame, frame + 61).clone();
+            CHECK(applyEffectChain(chain, moved, chained, together) == 0);
+            applyEffect(chain[0], moved, step, first);
+            applyEffect(chain[1], step, expect, second);
+            CHECK(sameImage(chained, expect));
+        }
+    }
+}
+
+// Tiles share one downscale and one set of derived images and give the chains' own results
+static void testEffectGrid() {
+    printf("effect grid\n");
+    cv::Mat frame = randomImage(120, 160), small;
+    cv::resize(frame, small, cv::Size(80, 60), 0, 0, cv::INTER_AREA);
+
+    // Derived images prepared once serve several contexts without being computed again
+    std::vector<std::string> chain;
+    parseEffectChain("emboss+sepia", chain);
+    CHECK(effectChainDerivedKinds(chain) == (DERIVED_BIT(DERIVED_SOBEL_X) | DERIVED_BIT(DERIVED_SOBEL_Y)));
+    DerivedImages shared;
+    initDerivedImages(shared);
+    beginDerivedFrame(shared, small);
+    prepareDerivedImages(shared, effectChainDerivedKinds(chain));
+    EffectContext own, first, second;
+    cv::Mat expect, a, b;
+    applyEffectChain(chain, small, expect, own);
+    CHECK(applyEffectChainShared(chain, small, a, first, shared) == 0 && sameImage(a, expect));
+    CHECK(applyEffectChainShared(chain, small, b, second, shared) == 0 && sameImage(b, expect));
+    CHECK(first.source.computed[DERIVED_SOBEL_X] == 0 && shared.computed[DERIVED_SOBEL_X] == 1);
+    CHECK(applyEffectChainShared(chain, frame, a, first, shared) == -1);
+
+    // Three tiles make a 2 x 2 grid of the frame size, the fourth cell stays black. The labels
+    // cover the top of the cells, below them each cell is its chain on the downscaled frame.
+    EffectGrid grid;
+    CHECK(grid.configure("sepia,emboss,grey+cartoon"));
+    CHECK(!grid.configure("sepia,nope") && grid.tileCount() == 3);
+    cv::Mat out;
+    for (int round = 0; round < 2; round++) {
+        CHECK(grid.render(frame, out) == 0);
+        CHECK(out.size() == frame.size());
+        const char* specs[] = { "sepia", "emboss", "grey+cartoon" };
+        for (int i = 0; i < 3; i++) {
+            EffectContext ctx;
+            parseEffectChain(specs[i], chain);
+            applyEffectChain(chain, small, expect, ctx);
+            cv::Rect below(0, 24, 80, 36);
+            cv::Rect cell((i % 2) * 80 + below.x, (i / 2) * 60 + below.y, below.width, below.height);
+            CHECK(sameImage(out(cell), expect(below)));
+        }
+        CHECK(cv::countNonZero(out(cv::Rect(80, 60, 80, 60)).reshape(1)) == 0);
+    }
+
+    // Tiles round up to cover a frame they don't divide, the last column and row are cut
+    cv::Mat odd = randomImage(125, 165);
+    cv::resize(odd, small, cv::Size(83, 63), 0, 0, cv::INTER_AREA);
+    CHECK(grid.render(odd, out) == 0 && out.size() == odd.size());
+    const char* specs[] = { "sepia", "emboss", "grey+cartoon" };
+    cv::Rect cells[] = { cv::Rect(0, 0, 83, 63), cv::Rect(83, 0, 82, 63), cv::Rect(0, 63, 83, 62) };
+    for (int i = 0; i < 3; i++) {
+        EffectContext ctx;
+        parseEffectChain(specs[i], chain);
+        applyEffectChain(chain, small, expect, ctx);
+        cv::Rect below(0, 24, cells[i].width, cells[i].height - 24);
+        CHECK(sameImage(out(below + cells[i].tl()), expect(below)));
+    }
+    CHECK(cv::countNonZero(out(cv::Rect(83, 63, 82, 62)).reshape(1)) == 0);
+}
+
+static void testDerivedImages() {
+    printf("derived images\n");
+    DerivedImages derived;
+    initDerivedImages(derived);
+    cv::Mat frame = randomImage(), sobel, grey;
+
+    // Computed on the first request of a frame only, with the same results as the filters
+    beginDerivedFrame(derived, frame);
+    const cv::Mat& sx = derivedImage(derived, DERIVED_SOBEL_X);
+    sobelX3x3(frame, sobel);
+    CHECK(sameImage(sx, sobel));
+    derivedImage(derived, DERIVED_SOBEL_X);
+    CHECK(derived.computed[DERIVED_SOBEL_X] == 1 && derived.reused[DERIVED_SOBEL_X] == 1);
+
+    // The half size equalized image builds on the grey one
+    cv::cvtColor(frame, grey, cv::COLOR_BGR2GRAY);
+    CHECK(derivedImage(derived, DERIVED_HALF_EQUALIZED).size() == cv::Size(frame.cols / 2, frame.rows / 2));
+    CHECK(sameImage(derivedImage(derived, DERIVED_GREY), grey));
+    CHECK(derived.computed[DERIVED_GREY] == 1 && derived.reused[DERIVED_GREY] == 1);
+
+    // A new frame of the same size recomputes into the same buffers
+    const uchar* buffer = sx.data;
+    cv::Mat next = randomImage() + cv::Scalar::all(7);
+    beginDerivedFrame(derived, next);
+    sobelX3x3(next, sobel);
+    CHECK(sameImage(derivedImage(derived, DERIVED_SOBEL_X), sobel));
+    CHECK(derived.images[DERIVED_SOBEL_X].data == buffer);
+    CHECK(derived.computed[DERIVED_SOBEL_X] == 2 && derived.computed[DERIVED_HSV] == 0);
+
+    // A chain keeps the derived images of its input apart from those of the intermediate results
+    EffectContext ctx;
+    std::vector<std::string> chain;
+    cv::Mat out, expect;
+    parseEffectChain("sepia+emboss", chain);
+    CHECK(applyEffectChain(chain, frame, out, ctx) == 0);
+    cv::Mat sepia;
+    sepiaTone(frame, sepia);
+    embossingEffect(sepia, sobel);
+    cv::convertScaleAbs(sobel, expect);
+    CHECK(sameImage(out, expect));
+    CHECK(ctx.stage.computed[DERIVED_SOBEL_X] == 1 && ctx.source.computed[DERIVED_SOBEL_X] == 0);
+}
+
+static void testImagePyramid() {
+    printf("image pyramid\n");
+
+    // The box halving is what cv::resize gives at half size; odd sizes drop the last row and column
+    cv::Mat src = randomImage(), grey, halved, expect;
+    cv::cvtColor(src, grey, cv::COLOR_BGR2GRAY);
+    CHECK(halveImage(src, halved) == 0);
+    cv::resize(src(cv::Rect(0, 0, 96, 60)), expect, cv::Size(48, 30), 0, 0, cv::INTER_AREA);
+    CHECK(sameImage(halved, expect));
+    CHECK(halveImage(grey, halved) == 0);
+    cv::resize(grey(cv::Rect(0, 0, 96, 60)), expect, cv::Size(48, 30), 0, 0, cv::INTER_AREA);
+    CHECK(sameImage(halved, expect));
+    CHECK(halveImage(halved, halved) == -1);
+
+    // Levels are built on request, each once per base, into buffers kept from base to base
+    cv::Mat frame;
+    cv::resize(randomImage(15, 20), frame, cv::Size(160, 120), 0, 0, cv::INTER_CUBIC);
+    ImagePyramid pyramid;
+    initImagePyramid(pyramid);
+    beginImagePyramid(pyramid, frame);
+    CHECK(pyramidLevelCount(frame.size()) == 7);
+    CHECK(pyramidLevel(pyramid, 2).size() == cv::Size(40, 30));
+    CHECK(pyramid.computed == 2);
+    cv::resize(frame, expect, cv::Size(80, 60), 0, 0, cv::INTER_AREA);
+    CHECK(sameImage(pyramidLevel(pyramid, 1), expect));
+    CHECK(pyramid.computed == 2 && pyramid.reused == 1);
+    CHECK(pyramidLevel(pyramid, 20).size() == cv::Size(2, 1));
+    CHECK(pyramidLevelFor(pyramid, cv::Size(64, 48)) == 1 && pyramidLevelFor(pyramid, cv::Size(200, 10)) == 0);
+    const uchar* buffer = pyramid.levels[1].data;
+    cv::Mat next = frame + cv::Scalar::all(9);
+    beginImagePyramid(pyramid, next);
+    cv::resize(next, expect, cv::Size(80, 60), 0, 0, cv::INTER_AREA);
+    CHECK(sameImage(pyramidLevel(pyramid, 1), expect));
+    CHECK(pyramid.levels[1].data == buffer);
+
+    // Small sigmas blur the base exactly like fastGaussianBlur, large ones stay close to it
+    cv::Mat blurred, reference;
+    CHECK(pyramidGaussianBlur(pyramid, blurred, 2.0f) == 0);
+    fastGaussianBlur(next, reference, 2.0f);
+    CHECK(sameImage(blurred, reference));
+    CHECK(pyramidGaussianBlur(pyramid, blurred, 12.0f) == 0);
+    fastGaussianBlur(next, reference, 12.0f);
+    CHECK(blurred.size() == next.size() && cv::norm(blurred, reference, cv::NORM_L1) / next.total() / 3 < 2.0);
+
+    // On a base of odd size the blur stays centred where it was: a line between columns 100 and
+    // 101 keeps its centre at 100.5
+    cv::Mat line(125, 167, CV_8UC3, cv::Scalar::all(0));
+    line.colRange(100, 102).setTo(cv::Scalar::all(255));
+    beginImagePyramid(pyramid, line);
+    CHECK(pyramidGaussianBlur(pyramid, blurred, 12.0f) == 0 && blurred.size() == line.size());
+    double mass = 0.0, moment = 0.0;
+    for (int x = 0; x < blurred.cols; x++) {
+        mass += blurred.at<cv::Vec3b>(60, x)[0];
+        moment += x * blurred.at<cv::Vec3b>(60, x)[0];
+    }
+    CHECK(mass > 0.0 && std::abs(moment / mass - 100.5) < 0.1);
+
+    // Face detection and stabilization take their small images from the pyramids of the frame
+    DerivedImages derived;
+    initDerivedImages(derived);
+    beginDerivedFrame(derived, frame);
+    cv::cvtColor(frame, grey, cv::COLOR_BGR2GRAY);
+    cv::resize(grey, expect, cv::Size(80, 60));
+    cv::equalizeHist(expect, expect);
+    CHECK(sameImage(derivedImage(derived, DERIVED_HALF_EQUALIZED), expect));
+    CHECK(derived.pyramids[PYRAMID_GREY].computed == 1);
+
+    cv::Mat big, small, fromPyramid;
+    double scale, pyramidScale;
+    cv::resize(frame, big, cv::Size(640, 480), 0, 0, cv::INTER_CUBIC);
+    beginDerivedFrame(derived, big);
+    stabilizerInput(big, small, scale);
+    stabilizerInput(derivedPyramid(derived, PYRAMID_BGR), fromPyramid, pyramidScale);
+    CHECK(sameImage(fromPyramid, small) && pyramidScale == scale);
+}
+
+static void testPerfCounters() {
+    printf("perf counters\n");
+
+    // Counted where the machine allows it, timed everywhere; either way the calls add up
+    PerfProfiler profiler;
+    bool available = profiler.open();
+    CHECK(available == profiler.countersAvailable());
+    CHECK(available || !profiler.unavailableReason().empty());
+    cv::Mat src = randomImage(240, 320), dst;
+    for (int i = 0; i < 3; i++) {
+        profiler.begin("sepia", (double)src.total());
+        sepiaTone(src, dst);
+        profiler.end();
+        profiler.end();
+    }
+    profiler.end();
+    CHECK(profiler.kernels().size() == 1);
+    const PerfKernelStats& sepia = profiler.kernels().at("sepia");
+    CHECK(sepia.calls == 3 && sepia.pixels == 3.0 * src.total() && sepia.ms > 0.0);
+    CHECK(!available || sepia.counts[PERF_CYCLES] > 0.0);
+    profiler.print();
+    profiler.reset();
+    CHECK(profiler.kernels().empty());
+}
+
+int main() {
+    testKernelVariants();
+    testReferenceFilters();
+    testBoxBlur();
+    testCartoon();
+    testColorLut();
+    testFrameStats();
+    testPixelPipeline();
+    testPrivacyMask();
+    testStabilizer();
+    testTemporalFilters();
+    testBackgroundModel();
+    testControlPlane();
+    testRawFrameFile();
+    testStripImage();
+    testFrameRing();
+    testEffectChain();
+    testEffectGrid();
+    testDerivedImages();
+    testImagePyramid();
+    testPerfCounters();
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -7,356 +7,609 @@
 #include "filter.h"
 #include "faceDetect.h"
 #include "VideoDisplay.h"
+#include "qualityGovernor.h"
+#include "frameSource.h"
+#include "rawFrameFile.h"
+#include "temporalFilters.h"
+#include "controlPlane.h"
+#include "derivedImages.h"
+#include "colorLut.h"
+#include "frameStats.h"
+#include "frameRing.h"
+#include "privacyMask.h"
+#include "pixelPipeline.h"
+#include "stabilizer.h"
+#include "effectGrid.h"
+#include "perfCounters.h"
+
+// When set, frames are processed without any window, e.g. for profiling on headless machines
+static bool headlessMode = false;
+
+// Shared memory ring every shown frame is also published to (--shm), created on the first frame
+// so the slots fit the display size. The capture index and time go along with each frame.
+static std::string sinkName;
+static int sinkSlots = FRAME_RING_DEFAULT_SLOTS;
+static FrameRingWriter frameSink;
+static uint64_t shownFrameIndex = 0;
+static int64_t shownCaptureNs = 0;
+
+// Stabilization of the shown frames, set while the 'S' mode is on. Its estimate for the frame is
+// made while the effect runs, showFrame waits for it and warps the processed image to the
+// display size in the same pass as the upscale.
+static StabilizerEngine* activeStabilizer = NULL;
+
+// Hardware counters of the filters, set while the 'H' mode is on. showFrame closes the effect
+// stage, so the upscale and the window aren't counted with the effect; work other threads do
+// meanwhile, like the stabilizer estimate, is.
+static PerfProfiler* activeProfiler = NULL;
+
+static void beginProfile(const char* kernel, const cv::Mat& frame) {
+    if (activeProfiler != NULL) {
+        activeProfiler->begin(kernel, (double)frame.total());
+    }
+}
+
+static void endProfile() {
+    if (activeProfiler != NULL) {
+        activeProfiler->end();
+    }
+}
 
 // Function to toggle the keepStrongColor effect
-int pickStrongColorToggle(cv::Mat& frame, cv::Mat& outputFrame, bool& isEnabled, uchar threshold = 128);
+int pickStrongColorToggle(cv::Mat& frame, cv::Mat& outputFrame, bool& isEnabled, const cv::Size& displaySize, uchar threshold = 128);
+
+// Display a processed frame, scaling it back up when it was processed at a proxy resolution
+void showFrame(const cv::Mat& image, const cv::Size& displaySize) {
+    static cv::Mat upscaled;
+    endProfile();
+    if (!sinkName.empty() && !frameSink.isOpen()) {
+        if (!frameSink.create(sinkName, sinkSlots, (size_t)displaySize.area() * 3)) {
+            printf("Unable to create the shared memory ring %s\n", sinkName.c_str());
+        }
+        sinkName.clear();
+    }
+
+    // The frame is rendered straight into the ring slot, the window shows it from there
+    cv::Mat slot = frameSink.beginFrame(displaySize, image.type());
+    if (headlessMode && slot.empty()) {
+        return;
+    }
+    cv::Mat& target = slot.empty() ? upscaled : slot;
+    const cv::Mat* shown = &image;
+    if (activeStabilizer != NULL && activeStabilizer->warp(image, target, displaySize) == 0) {
+        shown = &target;
+    }
+    else if (image.size() != displaySize) {
+        cv::resize(image, target, displaySize, 0, 0, cv::INTER_LINEAR);
+        shown = &target;
+    }
+    else if (!slot.empty()) {
+        image.copyTo(slot);
+    }
+    if (!headlessMode) {
+        cv::imshow("Video", *shown);
+    }
+    if (!slot.empty()) {
+        frameSink.commitFrame(shownFrameIndex, shownCaptureNs);
+    }
+}
+
+// Run the face cascade on the processing frame and keep the faces in full-resolution coordinates
+void updateFaces(DerivedImages& derived, std::vector<cv::Rect>& faces, float proxyScale, DetectionCache& cache) {
+    detectFacesCached(derived, faces, cache);
+    for (size_t i = 0; i < faces.size(); i++) {
+        faces[i].x = static_cast<int>(faces[i].x / proxyScale);
+        faces[i].y = static_cast<int>(faces[i].y / proxyScale);
+        faces[i].width = static_cast<int>(faces[i].width / proxyScale);
+        faces[i].height = static_cast<int>(faces[i].height / proxyScale);
+    }
+}
 
-// Function to adjust brightness and contrast of an image
+// Function to adjust brightness and contrast of an image, in one pass straight into outputFrame
 void adjustBrightnessContrast(cv::Mat& inputFrame, cv::Mat& outputFrame, float brightness, float contrast) {
-    inputFrame.convertTo(outputFrame, -1, contrast, brightness);
+    if (applyPixelPipeline(inputFrame, outputFrame, pixelPipeline::contrast(contrast, brightness)) != 0) {
+        inputFrame.convertTo(outputFrame, -1, contrast, brightness);
+    }
+}
+
+
+// Startup work that doesn't need the camera, run on a thread while the camera opens: parse and
+// run the face cascade once, and build the LUT presets, the requested one first
+static void warmUp(const std::string& lutSpec) {
+    colorLutPreset(lutSpec);
+    if (warmUpFaceDetection() != 0) {
+        printf("Face cascade not available, face detection will stop the program\n");
+    }
+    for (const std::string& name : colorLutPresetNames()) {
+        colorLutPreset(name);
+    }
 }
 
+// Append a frame to the recording, which is given up on the first frame it can't take
+static void recordFrame(RawFrameWriter& recorder, bool& recording, const std::string& recordPath, const cv::Mat& frame,
+                        double fps) {
+    if (!recording) {
+        return;
+    }
+    if (!recorder.isOpen() && !recorder.open(recordPath, frame.size(), frame.type(), fps)) {
+        printf("Unable to record to %s\n", recordPath.c_str());
+        recording = false;
+    }
+    else if (!recorder.write(frame)) {
+        printf("Frame size changed or the write failed, recording stopped\n");
+        recording = false;
+    }
+}
 
+// Usage: vidDisplay [source] [--unpaced] [--headless] [--frames N] [--keys chars] [--record file]
+//                   [--stdin-control] [--control-socket path] [--lut file.cube|preset] [--shm name] [--shm-slots N]
+//                   [--first-frame-target ms] [--grid chains]
+//   source      frame source specification, see frameSource.h (default: cam:0)
+//   --unpaced   deliver file and synthetic frames as fast as they are processed
+//   --headless  don't open a window, keys can then only come from --keys
+//   --frames N  stop after N frames and print the achieved frame rate
+//   --keys      keys pressed one per frame at startup, e.g. --keys tc enables sepia and hearts
+//   --record    write the captured frames to a raw frame file for replay with raw:file, with the
+//               faces masked while privacy is on
+//   --stdin-control         read control commands from stdin, see controlPlane.h
+//   --control-socket path   accept control commands on a unix domain socket
+//   --lut       3D LUT for the colour grading stage ('L' key), a .cube file or a preset of colorLut.h
+//   --shm       also publish the shown frames to a shared memory ring for other processes, see frameRing.h
+//   --shm-slots N  frames the ring holds (default 4): a reader has N - 1 frame times to use a view
+//   --first-frame-target ms  exit with status 2 if the first frame took longer than this after launch
+//   --grid      chains of the comparison grid ('G' key), separated by commas (default sepia,emboss,cartoon,vignette)
 int main(int argc, char* argv[]) {
+    int64 launchTick = cv::getTickCount();
+
+    // Parse the command line
+    std::string sourceSpec = "cam:0";
+    std::string scriptedKeys;
+    std::string recordPath;
+    std::string controlSocket;
+    std::string lutSpec;
+    std::string gridSpec = "sepia,emboss,cartoon,vignette";
+    bool stdinControl = false;
+    bool paced = true;
+    long long maxFrames = 0;
+    double firstFrameTargetMs = 0.0;
+    bool firstFrameMissed = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--unpaced") {
+            paced = false;
+        }
+        else if (arg == "--headless") {
+            headlessMode = true;
+        }
+        else if (arg == "--frames" && i + 1 < argc) {
+            maxFrames = std::atoll(argv[++i]);
+        }
+        else if (arg == "--keys" && i + 1 < argc) {
+            scriptedKeys = argv[++i];
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        else if (arg == "--stdin-control") {
+            stdinControl = true;
+        }
+        else if (arg == "--control-socket" && i + 1 < argc) {
+            controlSocket = argv[++i];
+        }
+        else if (arg == "--lut" && i + 1 < argc) {
+            lutSpec = argv[++i];
+        }
+        else if (arg == "--shm" && i + 1 < argc) {
+            sinkName = argv[++i];
+        }
+        else if (arg == "--shm-slots" && i + 1 < argc) {
+            sinkSlots = std::atoi(argv[++i]);
+        }
+        else if (arg == "--grid" && i + 1 < argc) {
+            gridSpec = argv[++i];
+        }
+        else if (arg == "--first-frame-target" && i + 1 < argc) {
+            firstFrameTargetMs = std::atof(argv[++i]);
+        }
+        else {
+            sourceSpec = arg;
+        }
+    }
+
+    // Opening a camera takes a while, the rest of the startup work happens meanwhile. OpenCV's
+    // worker pool is started now rather than by the first filter.
+    std::thread warmUpThread(warmUp, lutSpec);
+    cv::parallel_for_(cv::Range(0, std::max(cv::getNumThreads(), 1)), [](const cv::Range&) {});
 
     // Open the video device
-    cv::VideoCapture* capdev = new cv::VideoCapture(0);
-    if (!capdev->isOpened()) {
-        printf("Unable to open video device\n");
+    FrameSource* capdev = openFrameSource(sourceSpec, paced);
+    double openMs = (cv::getTickCount() - launchTick) * 1000.0 / cv::getTickFrequency();
+    if (capdev == NULL) {
+        printf("Unable to open video device %s\n", sourceSpec.c_str());
+        warmUpThread.join();
         return -1;
     }
     else {
-        printf("Stream Started!\n");
+        printf("Stream Started! (%s)\n", capdev->describe().c_str());
     }
 
     // Get properties of the image
-    cv::Size refS((int)capdev->get(cv::CAP_PROP_FRAME_WIDTH), (int)capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
+    cv::Size refS = capdev->frameSize();
     printf("Expected size: %d %d\n", refS.width, refS.height);
 
     // Create a window to display the video
-    cv::namedWindow("Video", 1);
+    if (!headlessMode) {
+        cv::namedWindow("Video", 1);
+    }
 
     // Initialize variables for image processing
-    cv::Mat frame, outputFrame, sobelX, sobelY, embosingFrame, gradientMagnitude, greyFrame, vignettFrame;
+    cv::Mat capturedFrame, proxyFrame, frame, outputFrame, embosingFrame, gradientMagnitude, vignettFrame;
     std::vector<cv::Rect> faces;
+    DetectionCache detectionCache;
+    initDetectionCache(detectionCache);
     cv::Rect last(0, 0, 0, 0);
 
-    // Flags for different image processing modes
-    bool greyScaleMode = false;
-    bool altGreyScaleMode = false;
-    bool sepiaToneMode = false;
-    bool vignetteMode = false;
-    bool sobelXMode = false;
-    bool sobelYMode = false;
-    bool blurEnabled = false;
-    bool gradientMagnitudeMode = false;
-    bool blurQuantizeMode = false;
-    bool faceDetectionMode = false;
-    bool heartsMode = false;
-    bool embossingEnabled = false;
-    bool pickStrongColorMode = false;
-
-    // Parameters for some effects
-    double vignetteStrength = 0.8;
-    double vignetteRadius = 0.7;
-
-    uchar pickStrongColorThreshold = 128;
+    // Grey, gradients and the detection input of the processing frame, each computed once per frame
+    // when the first effect asks for it
+    DerivedImages derived;
+    initDerivedImages(derived);
+
+    // Effect modes and parameters belong to the control plane. Keys, stdin and the socket publish
+    // changes there, and each frame works from one snapshot of them.
+    ControlChannel control;
+    if (stdinControl) {
+        control.startStdin();
+    }
+    if (!controlSocket.empty()) {
+        if (control.startSocket(controlSocket)) {
+            printf("Listening for control commands on %s\n", controlSocket.c_str());
+        }
+        else {
+            printf("Unable to listen on %s\n", controlSocket.c_str());
+        }
+    }
+
+    // Colour grading table, a preset name or a .cube file
+    ColorLut lutFile;
+    const ColorLut* gradeLut = NULL;
+    if (!lutSpec.empty()) {
+        gradeLut = colorLutPreset(lutSpec);
+        if (gradeLut == NULL && loadCubeLut(lutSpec, lutFile) == 0) {
+            gradeLut = &lutFile;
+        }
+        if (gradeLut != NULL) {
+            printf("Colour grading with %s (%d^3), toggle with 'L'\n", gradeLut->title.c_str(), gradeLut->size);
+        }
+    }
+    cv::Mat gradedFrame;
+
+    // Statistics of each frame, sampled on a worker while the frame is processed. They feed the
+    // automatic tone controls of the next frame and the equalization of face detection.
+    FrameStatsEngine statsEngine;
+    AutoLevels autoLevels;
+    initAutoLevels(autoLevels);
+    cv::Mat toneTable, leveledFrame, equalizedFrame;
+
+    // Face regions anonymized by the privacy mode, held across missed detections
+    PrivacyState privacy;
+    initPrivacyState(privacy);
+
+    // Camera motion of each frame, estimated on a worker while the effect runs
+    StabilizerEngine stabilizerEngine;
+
+    // Counters of the filter calls, reported every second while they are on
+    PerfProfiler profiler;
+
+    // Effect chains compared side by side, each tile on a worker of its own
+    EffectGrid effectGrid;
+    if (!effectGrid.configure(gridSpec)) {
+        printf("Unknown effect in the grid %s, known effects:", gridSpec.c_str());
+        for (const std::string& name : effectNames()) {
+            printf(" %s", name.c_str());
+        }
+        printf("\n");
+        effectGrid.configure("sepia,emboss,cartoon,vignette");
+    }
     int imageCounter = 0;
-    int quantizeLevels = 10;
-    float brightness = 1.0f; // Initial brightness value
-    float contrast = 1.0f;   // Initial contrast value
+    int savesDone = 0;
+
+    // Frame history and accumulators of the temporal effects
+    TemporalState temporal;
+    initTemporalState(temporal);
+
+    // Governor that trades quality for speed when frames take longer than the target
+    QualityGovernor governor;
+    initGovernor(governor, 30.0);
+    long long frameIndex = 0;
+    int framesSinceStats = 0;
+    int64 statsStart = cv::getTickCount();
+    int64 runStart = cv::getTickCount();
+    RawFrameWriter recorder;
+    bool recording = !recordPath.empty();
+    cv::Mat maskedCapture;
 
     // Main loop for capturing and processing frames
     for (;;) {
-        char key = cv::waitKey(10);
-        *capdev >> frame;
+        // The window only delivers keys while waitKey runs, so it is polled briefly every frame
+        // and the keys are handed to the control plane like any other input
+        char key = headlessMode ? -1 : cv::waitKey(1);
+        if (frameIndex < (long long)scriptedKeys.size()) {
+            key = scriptedKeys[frameIndex];
+        }
+        if (key != -1) {
+            control.applyKey(key);
+        }
+        ControlParams params = control.snapshot();
+        if (params.countersEnabled && activeProfiler == NULL) {
+            if (!profiler.open()) {
+                printf("Hardware counters unavailable (%s), timing the filters only\n", profiler.unavailableReason().c_str());
+            }
+            profiler.reset();
+        }
+        activeProfiler = params.countersEnabled ? &profiler : NULL;
+        if (params.quit) {
+            std::cout << "Quitting" << std::endl;
+            break;
+        }
+        if (maxFrames > 0 && frameIndex >= maxFrames) {
+            break;
+        }
 
         // Check if the frame is empty
-        if (frame.empty()) {
+        if (!capdev->read(capturedFrame)) {
             printf("Frame is empty\n");
             break;
         }
 
-        // Process user input to toggle various image processing modes
-        //GreyScale on 'g'
-        if (key == 'g') {
-            if (!greyScaleMode) {
-                printf("Grey Scale Enabled\n");
-                greyScaleMode = !greyScaleMode;
-            }
-            else {
-                printf("Grey Scale Disabled\n");
-                greyScaleMode = !greyScaleMode;
-            }
+        // Record the frame as captured, before any effect touches it. With privacy on it is
+        // recorded once its faces are masked.
+        if (!params.privacyEnabled) {
+            recordFrame(recorder, recording, recordPath, capturedFrame, capdev->fps());
         }
-        //Alternate Grey Scale on 'h'
-        else if (key == 'h') {
-            if (!altGreyScaleMode) {
-                printf("Alternate Grey Scale Enabled\n");
-                altGreyScaleMode = !altGreyScaleMode;
-            }
-            else {
-                printf("Alternate Grey Scale Disabled\n");
-                altGreyScaleMode = !altGreyScaleMode;
-            }
-        }
-        //SepiaTone Filter on 't'
-        else if (key == 't') {
-            if (!sepiaToneMode) {
-                printf("Sepia Tone Filter Enabled\n");
-                sepiaToneMode = !sepiaToneMode;
-            }
-            else {
-                printf("Sepia Tone Filter Disabled\n");
-                sepiaToneMode = !sepiaToneMode;
-            }
+
+        // Processing time is measured from here to the display of the frame
+        int64 frameStart = cv::getTickCount();
+        shownFrameIndex = frameIndex;
+        shownCaptureNs = frameRingClockNs();
+        const QualitySettings& quality = governor.settings;
+        cv::Size displaySize = capturedFrame.size();
+        if (quality.proxyScale < 1.0f) {
+            cv::resize(capturedFrame, proxyFrame, cv::Size(), quality.proxyScale, quality.proxyScale, cv::INTER_AREA);
+            frame = proxyFrame;
         }
-        //Vigent Filter on 'v'
-        else if (key == 'v') {
-            if (!vignetteMode) {
-                printf("Vignet Filter is Enabled\n");
-                vignetteMode = !vignetteMode;
-            }
-            else {
-                printf("Vignet Filter is Disabled\n");
-                vignetteMode = !vignetteMode;
-            }
+        else {
+            frame = capturedFrame;
         }
-        //Blur Filter on 'b'
-        else if (key == 'b') {
-            if (!blurEnabled) {
-                printf("Blur Filter Enabled\n");
-                blurEnabled = !blurEnabled;
-            }
-            else {
-                printf("Blur Filter Disabled\n");
-                blurEnabled = !blurEnabled;
-            }
+        bool detectThisFrame = frameIndex % quality.faceDetectEvery == 0;
+
+        // Grading comes first, so every effect works on the graded colours
+        if (params.gradeEnabled && gradeLut != NULL) {
+            beginProfile("grade", frame);
+            applyColorLut(frame, gradedFrame, *gradeLut);
+            endProfile();
+            frame = gradedFrame;
         }
-        //Sobel X filter on 'x'
-        else if (key == 'x') {
-            if (!sobelXMode) {
-                printf("Sobel X Filter Enabled\n");
-                sobelXMode = !sobelXMode;
-            }
-            else {
-                printf("Sobel X Filter Disabled\n");
-                sobelXMode = !sobelXMode;
-            }
+
+        // Sample this frame before the tone controls change it, so they don't chase their own
+        // output. They use the statistics of the previous frame.
+        const FrameStats& lastStats = statsEngine.latest();
+        statsEngine.begin(frame);
+        bool toneChanged = false;
+        bool equalized = false;
+        if (params.localEqualizeEnabled) {
+            beginProfile("localeq", frame);
+            equalized = localEqualize(frame, equalizedFrame, lastStats) == 0;
+            endProfile();
         }
-        //Sobel Y filter on 'y'
-        else if (key == 'y') {
-            if (!sobelYMode) {
-                printf("Sobel Y Filter Enabled\n");
-                sobelYMode = !sobelYMode;
-            }
-            else {
-                printf("Sobel Y Filter Disabled\n");
-                sobelYMode = !sobelYMode;
-            }
+        if (equalized) {
+            frame = equalizedFrame;
+            toneChanged = true;
         }
-        //Magnitude Gradient on 'm' 
-        else if (key == 'm') {
-            if (!gradientMagnitudeMode) {
-                printf("Gradient Magnitude Enabled\n");
-                gradientMagnitudeMode = !gradientMagnitudeMode;
-            }
-            else {
-                printf("Gradient Magnitude Disabled\n");
-                gradientMagnitudeMode = !gradientMagnitudeMode;
-            }
+        if (params.autoLevelsEnabled && autoLevels.primed) {
+            toneLut(autoLevels.brightness, autoLevels.contrast, toneTable);
+            cv::LUT(frame, toneTable, leveledFrame);
+            frame = leveledFrame;
+            toneChanged = true;
         }
-        //Blur Quantize on 'l'
-        else if (key == 'l') {
-            if (!blurQuantizeMode) {
-                printf("Blur and Quantize - Enabled\n");
-                blurQuantizeMode = !blurQuantizeMode;
-            }
-            else {
-                printf("Blur and Quantize - Disabled\n");
-                blurQuantizeMode = !blurQuantizeMode;
+
+        // Face detection equalizes with the sampled histogram when it describes the frame it sees
+        beginDerivedFrame(derived, frame);
+        useFrameStats(derived, toneChanged ? NULL : &statsEngine);
+
+        // Faces are anonymized before any effect sees the frame, so no output can show them. The
+        // detection is shared with the face effects, which must not detect again on the masked frame.
+        if (params.privacyEnabled) {
+            if (detectThisFrame) {
+                updateFaces(derived, faces, quality.proxyScale, detectionCache);
+            }
+            updatePrivacyRegions(privacy, faces, detectThisFrame);
+            detectThisFrame = false;
+            statsEngine.wait();
+            PrivacyStyle style = params.privacyBlur ? PRIVACY_BLUR : PRIVACY_PIXELATE;
+            if (applyPrivacyMask(frame, privacy, style, quality.proxyScale) > 0) {
+                beginDerivedFrame(derived, frame);
             }
-        }
-        //Face detection on 'f'
-        else if (key == 'f') {
-            if (!faceDetectionMode) {
-                printf("Face Detection Enabled");
-                faceDetectionMode = !faceDetectionMode;
+
+            // The recording holds the captured frame with the same regions masked at full size.
+            // Without proxy or grading, frame is the captured frame and already masked.
+            if (recording && frame.data != capturedFrame.data) {
+                capturedFrame.copyTo(maskedCapture);
+                applyPrivacyMask(maskedCapture, privacy, style);
+                recordFrame(recorder, recording, recordPath, maskedCapture, capdev->fps());
             }
             else {
-                printf("Face Detection Disabled");
-                faceDetectionMode = !faceDetectionMode;
+                recordFrame(recorder, recording, recordPath, capturedFrame, capdev->fps());
             }
         }
-        //Pick Strongest color on 'n'
-        else if (key == 'n') {
-            if (!pickStrongColorMode) {
-                printf("Strong Color Mode Enabled\n");
-                pickStrongColorMode = !pickStrongColorMode;
-            }
-            else {
-                printf("Strong Color Mode Disabled\n");
-                pickStrongColorMode = !pickStrongColorMode;
-            }
+
+        // Stabilization warps whatever the effect shows, so it follows the masked frame. The grid
+        // is left as it is, its tiles would be cut by the zoom.
+        if (params.stabilizeEnabled && !params.gridEnabled) {
+            stabilizerEngine.begin(derivedPyramid(derived, PYRAMID_BGR));
+            activeStabilizer = &stabilizerEngine;
         }
-        //Generate hearts on 'c'
-        else if (key == 'c') {
-            if (!heartsMode) {
-                printf("Halo Enabled\n");
-                heartsMode = !heartsMode;
-            }
-            else {
-                printf("Halo Disabled\n");
-                heartsMode = !heartsMode;
-            }
+        else if (activeStabilizer != NULL) {
+            activeStabilizer = NULL;
+            stabilizerEngine.reset();
         }
-        //Embossing effect on 'p'
-        else if (key == 'p') {
-            if (!embossingEnabled) {
-                printf("Embossing Enabled\n");
-                embossingEnabled = !embossingEnabled;
+
+        // Apply a governor switch, its thread count has to be set from this thread
+        if (params.governorEnabled != governor.enabled) {
+            if (params.governorEnabled) {
+                governor.enabled = true;
+                cv::setNumThreads(governor.settings.filterThreads);
             }
             else {
-                printf("Embossing Disabled\n");
-                embossingEnabled = !embossingEnabled;
+                initGovernor(governor, 1000.0 / governor.targetFrameMs);
+                cv::setNumThreads(-1);
             }
         }
-        else if (key == 'w') {
-            // Increase brightness
-            brightness += 0.1;
-            printf("Contrast: %.2f\n", contrast);
-        }
-        else if (key == 'e') {
-            // Decrease brightness
-            brightness -= 0.1;
-            printf("Contrast: %.2f\n", contrast);
-        }
-        else if (key == 'a') {
-            // Increase contrast
-            contrast += 0.1;
-            printf("Contrast: %.2f\n", contrast);
-        }
-        else if (key == 'd') {
-            // Decrease contrast
-            contrast -= 0.1;
-            printf("Contrast: %.2f\n", contrast);
-        }
 
+        beginProfile(activeEffectName(params), frame);
         try {
             // Applying the selected image processing effect based on the active mode
-            if (greyScaleMode) {
-                cv::cvtColor(frame, outputFrame, cv::COLOR_BGR2GRAY);
+            if (params.gridEnabled) {
+                if (effectGrid.render(frame, outputFrame, &derivedPyramid(derived, PYRAMID_BGR)) == 0) {
+                    showFrame(outputFrame, displaySize);
+                }
+                else {
+                    printf("Comparison grid is empty\n");
+                }
+            }
+            else if (params.greyScaleMode) {
+                outputFrame = derivedImage(derived, DERIVED_GREY);
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", outputFrame);
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Grayscale image is empty\n");
                 }
             }
-            else if (altGreyScaleMode) {
+            else if (params.altGreyScaleMode) {
                 altGreyScale(frame, outputFrame);
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", outputFrame);
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Greyscale image is empty\n");
                 }
             }
-            else if (sepiaToneMode) {
+            else if (params.sepiaToneMode) {
                 sepiaTone(frame, outputFrame);
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", outputFrame);
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Sepia tone image is empty\n");
                 }
             }
-            else if (vignetteMode) {
-                Vignette(frame, vignettFrame, vignetteStrength, vignetteRadius);
+            else if (params.vignetteMode) {
+                Vignette(frame, vignettFrame, params.vignetteStrength, params.vignetteRadius);
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", vignettFrame);
+                    showFrame(vignettFrame, displaySize);
                 }
                 else {
                     printf("Vignett Frame image is empty\n");
                 }
             }
-            else if (blurEnabled) {
-                blur5x5_B(frame, outputFrame);
+            else if (params.blurEnabled) {
+                if (params.blurSigma > 0.0f) {
+                    // Large sigmas blur a pyramid level and scale it back up
+                    pyramidGaussianBlur(derivedPyramid(derived, PYRAMID_BGR), outputFrame, params.blurSigma, quality.blurPasses);
+                }
+                else if (quality.fastKernels) {
+                    boxBlur(frame, outputFrame, 2);
+                }
+                else {
+                    blur5x5_B(frame, outputFrame);
+                }
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", outputFrame);
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Blurred image is empty\n");
                 }
             }
-            else if (sobelXMode) {
-                sobelX3x3(frame, sobelX);
-                cv::convertScaleAbs(sobelX, outputFrame);
+            else if (params.sobelXMode) {
+                cv::convertScaleAbs(derivedImage(derived, DERIVED_SOBEL_X), outputFrame);
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", outputFrame);
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Sobel X image is empty\n");
                 }
             }
-            else if (sobelYMode) {
-
-                sobelY3x3(frame, sobelY);
-                cv::convertScaleAbs(sobelY, outputFrame);
+            else if (params.sobelYMode) {
+                cv::convertScaleAbs(derivedImage(derived, DERIVED_SOBEL_Y), outputFrame);
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", outputFrame);
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Sobel Y image is empty\n");
                 }
             }
-            else if (gradientMagnitudeMode) {
-                cv::cvtColor(frame, outputFrame, cv::COLOR_BGR2GRAY);
-                sobelX3x3(outputFrame, sobelX);
-                sobelY3x3(outputFrame, sobelY);
-                magnitude(sobelX, sobelY, gradientMagnitude);
-                if (!gradientMagnitude.empty()) {
-                    cv::imshow("Video", gradientMagnitude);
+            else if (params.gradientMagnitudeMode) {
+                // The Sobel filters take colour frames, so the magnitude is of the colour gradients
+                cv::Mat sobelX = derivedImage(derived, DERIVED_SOBEL_X);
+                cv::Mat sobelY = derivedImage(derived, DERIVED_SOBEL_Y);
+                gradientMagnitudeEuclidean(sobelX, sobelY, gradientMagnitude);
+                gradientMagnitude.convertTo(outputFrame, CV_8U);
+                if (!outputFrame.empty()) {
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Gradient magnitude image is empty\n");
                 }
             }
-            else if (blurQuantizeMode) {
+            else if (params.blurQuantizeMode) {
 
-                blurQuantize(frame, outputFrame, quantizeLevels);
+                blurQuantize(frame, outputFrame, params.quantizeLevels, params.blurSigma);
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", outputFrame);
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Blurred and quantized image is empty\n");
                 }
             }
-            else if (faceDetectionMode) {
-                cv::cvtColor(frame, greyFrame, cv::COLOR_BGR2GRAY, 0);
-                detectFaces(greyFrame, faces);
-                
+            else if (params.cartoonMode) {
+                cartoon(frame, outputFrame, params.quantizeLevels);
+                if (!outputFrame.empty()) {
+                    showFrame(outputFrame, displaySize);
+                }
+                else {
+                    printf("Cartoon image is empty\n");
+                }
+            }
+            else if (params.faceDetectionMode) {
+                // The boxes are drawn into the frame, its sampling must be finished
+                statsEngine.wait();
+                if (detectThisFrame) {
+                    updateFaces(derived, faces, quality.proxyScale, detectionCache);
+                }
+
                 // Add a little smoothing by averaging the last two detections
-                drawBoxes(frame, faces);
+                drawBoxes(frame, faces, 50, quality.proxyScale);
                 if (faces.size() > 0) {
                     last.x = (faces[0].x + last.x) / 2;
                     last.y = (faces[0].y + last.y) / 2;
                     last.width = (faces[0].width + last.width) / 2;
                     last.height = (faces[0].height + last.height) / 2;
                 }
-                cv::imshow("Video", frame);
+                showFrame(frame, displaySize);
             }
-            else if (pickStrongColorMode) {
-                pickStrongColorToggle(frame, outputFrame, pickStrongColorMode, pickStrongColorThreshold);
+            else if (params.pickStrongColorMode) {
+                pickStrongColorToggle(frame, outputFrame, params.pickStrongColorMode, displaySize, params.strongColorThreshold);
             }
-            else if (heartsMode) {
-                cv::cvtColor(frame, greyFrame, cv::COLOR_BGR2GRAY, 0);
-                detectFaces(greyFrame, faces);
-                if (heartsMode) {
-                    drawHearts(frame, faces, 0, 1.0);  // Draw hearts instead of bubbles
+            else if (params.heartsMode) {
+                statsEngine.wait();
+                if (detectThisFrame) {
+                    updateFaces(derived, faces, quality.proxyScale, detectionCache);
+                }
+                if (params.heartsMode) {
+                    drawHearts(frame, faces, 0, quality.proxyScale);  // Draw hearts instead of bubbles
                 }
                 else {
-                    drawBoxes(frame, faces);  // Draw boxes if heartsMode is not enabled
+                    drawBoxes(frame, faces, 50, quality.proxyScale);  // Draw boxes if heartsMode is not enabled
                 }
 
                 // add a little smoothing by averaging the last two detections
@@ -368,23 +621,58 @@ int main(int argc, char* argv[]) {
                 }
 
                 // display the frame with the box or heart in it
-                cv::imshow("Video", frame);
+                showFrame(frame, displaySize);
             }
-            else if (embossingEnabled) {
-                embossingEffect(frame, embosingFrame);
+            else if (params.embossingEnabled) {
+                embossingFromGradients(derivedImage(derived, DERIVED_SOBEL_X), derivedImage(derived, DERIVED_SOBEL_Y), embosingFrame);
                 cv::convertScaleAbs(embosingFrame, outputFrame);
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", outputFrame);
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Embossing image is empty\n");
                 }
             }
+            else if (params.motionBlurMode) {
+                motionBlur(frame, outputFrame, temporal);
+                if (!outputFrame.empty()) {
+                    showFrame(outputFrame, displaySize);
+                }
+                else {
+                    printf("Motion blur image is empty\n");
+                }
+            }
+            else if (params.ghostTrailsMode) {
+                ghostTrails(frame, outputFrame, temporal);
+                if (!outputFrame.empty()) {
+                    showFrame(outputFrame, displaySize);
+                }
+                else {
+                    printf("Ghost trails image is empty\n");
+                }
+            }
+            else if (params.motionHighlightMode) {
+                motionHighlight(frame, outputFrame, temporal);
+                if (!outputFrame.empty()) {
+                    showFrame(outputFrame, displaySize);
+                }
+                else {
+                    printf("Motion highlight image is empty\n");
+                }
+            }
+            else if (params.temporalDenoiseMode) {
+                temporalDenoise(frame, outputFrame, temporal);
+                if (!outputFrame.empty()) {
+                    showFrame(outputFrame, displaySize);
+                }
+                else {
+                    printf("Denoised image is empty\n");
+                }
+            }
             else {
-                outputFrame = frame.clone();
-                adjustBrightnessContrast(outputFrame, outputFrame, brightness, contrast);
+                adjustBrightnessContrast(frame, outputFrame, params.brightness, params.contrast);
                 if (!outputFrame.empty()) {
-                    cv::imshow("Video", outputFrame);
+                    showFrame(outputFrame, displaySize);
                 }
                 else {
                     printf("Original image is empty\n");
@@ -395,12 +683,51 @@ int main(int argc, char* argv[]) {
             fprintf(stderr, "OpenCV Exception: %s\n", e.what());
             break;
         }
-        // Check for key presses to control the application
-        if (key == 'q') {
-            std::cout << "Quitting" << std::endl;
-            break;
+        endProfile();
+
+        // The sampled frame may be overwritten from here on
+        updateAutoLevels(autoLevels, statsEngine.wait());
+
+        // Time to the first processed frame, the number startup work is judged by
+        if (frameIndex == 0) {
+            double firstFrameMs = (cv::getTickCount() - launchTick) * 1000.0 / cv::getTickFrequency();
+            printf("First frame %.1f ms after launch (source open %.1f ms)\n", firstFrameMs, openMs);
+            if (firstFrameTargetMs > 0.0 && firstFrameMs > firstFrameTargetMs) {
+                printf("First frame missed the target of %.1f ms\n", firstFrameTargetMs);
+                firstFrameMissed = true;
+            }
         }
-        else if (key == 's') {
+
+        // Feed the processing time to the governor and apply any change of quality level
+        double frameMs = (cv::getTickCount() - frameStart) * 1000.0 / cv::getTickFrequency();
+        if (updateGovernor(governor, frameMs)) {
+            cv::setNumThreads(governor.settings.filterThreads);
+            printf("Quality governor %s\n", governor.lastDecision.c_str());
+        }
+        frameIndex++;
+
+        // Print the frame statistics once per second
+        framesSinceStats++;
+        double statsSeconds = (cv::getTickCount() - statsStart) / cv::getTickFrequency();
+        if (statsSeconds >= 1.0) {
+            if (params.statsEnabled) {
+                printGovernorStats(governor, framesSinceStats / statsSeconds);
+                printDetectionCacheStats(detectionCache);
+                printDerivedImageStats(derived);
+                if (params.gridEnabled) {
+                    printEffectGridStats(effectGrid);
+                }
+            }
+            if (activeProfiler != NULL) {
+                profiler.print();
+                profiler.reset();
+            }
+            framesSinceStats = 0;
+            statsStart = cv::getTickCount();
+        }
+        // Save the shown frame when a save was requested
+        if (params.saveRequests != savesDone) {
+            savesDone = params.saveRequests;
             std::cout << "Image is being Saved" << std::endl;
             std::string filename = "C:/Users/visar/Desktop/OneDrive - Northeastern University/PRCV/Project1_Images/Image_" + std::to_string(imageCounter) + ".jpg";
             cv::imwrite(filename, outputFrame);
@@ -408,20 +735,37 @@ int main(int argc, char* argv[]) {
             imageCounter++;
         }
     }
+    // Report the throughput of the whole run
+    double runSeconds = (cv::getTickCount() - runStart) / cv::getTickFrequency();
+    printf("Processed %lld frames in %.2f s (%.1f fps)\n", frameIndex, runSeconds, frameIndex / std::max(runSeconds, 1e-9));
+
     // Release resources
+    if (recorder.framesWritten() > 0) {
+        printf("Recorded %llu frames to %s\n", (unsigned long long)recorder.framesWritten(), recordPath.c_str());
+    }
+    if (!recorder.close()) {
+        printf("Unable to write the recording %s completely\n", recordPath.c_str());
+    }
+    if (frameSink.isOpen()) {
+        printf("Published %llu frames to %s\n", (unsigned long long)frameSink.published(), frameSink.name().c_str());
+        frameSink.close();
+    }
+    activeStabilizer = NULL;
+    activeProfiler = NULL;
     delete capdev;
-    return 0;
+    warmUpThread.join();
+    return firstFrameMissed ? 2 : 0;
 }
 
 
 // Function to toggle pickStrongColor effect
-int pickStrongColorToggle(cv::Mat& frame, cv::Mat& outputFrame, bool& isEnabled, uchar threshold) {
+int pickStrongColorToggle(cv::Mat& frame, cv::Mat& outputFrame, bool& isEnabled, const cv::Size& displaySize, uchar threshold) {
     if (isEnabled) {
         pickStrongColor(frame, outputFrame, threshold);
 
         // Check if outputFrame is not empty before displaying
         if (!outputFrame.empty()) {
-            cv::imshow("Video", outputFrame);
+            showFrame(outputFrame, displaySize);
         }
         else {
             printf("Pick strong color image is empty\n");
@@ -429,7 +773,7 @@ int pickStrongColorToggle(cv::Mat& frame, cv::Mat& outputFrame, bool& isEnabled,
     }
     else {
         // Display the original frame if pickStrongColor is not enabled
-        cv::imshow("Video", frame);
+        showFrame(frame, displaySize);
     }
     return 0;  // Success
 }
\ No newline at end of file